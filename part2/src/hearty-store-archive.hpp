@@ -0,0 +1,136 @@
+/**
+ * @file hearty-store-archive.hpp
+ * @author Nathadon Samairat
+ * @brief Store archives written by hearty-store-export and read by
+ *        hearty-store-import. An archive is a plain ustar (POSIX tar) stream with one
+ *        regular file per object: the file name is the object ID, the size is the
+ *        object's size and the modification time is its timestamp. Standard tools
+ *        can list and unpack it (tar tvf), and an archive made by tar from a
+ *        directory of files can be imported.
+ * @version 0.1
+ * @date 2024-12-17
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+const size_t TAR_RECORD_SIZE = 512;     // Headers and data are padded to records
+const unsigned long long TAR_OCTAL_MAX = 077777777777ULL;  // Largest 11-digit size or mtime
+
+struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char padding[12];
+};
+
+static_assert(sizeof(TarHeader) == TAR_RECORD_SIZE, "A tar header is one record");
+
+// One archive entry, as far as stores are concerned
+struct ArchiveEntry {
+    std::string name;
+    size_t size;
+    time_t mtime;
+    bool is_file;       // Regular file (other entries are skipped by imports)
+};
+
+namespace archive {
+    // Bytes of padding that round `size` up to a whole record
+    inline size_t padding(size_t size) {
+        return (TAR_RECORD_SIZE - size % TAR_RECORD_SIZE) % TAR_RECORD_SIZE;
+    }
+
+    inline unsigned int headerChecksum(const TarHeader& header) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&header);
+        unsigned int sum = 0;
+        for (size_t i = 0; i < sizeof(TarHeader); i++) {
+            bool in_field = i >= offsetof(TarHeader, checksum) &&
+                            i < offsetof(TarHeader, checksum) + sizeof(header.checksum);
+            sum += in_field ? ' ' : bytes[i];
+        }
+        return sum;
+    }
+
+    /**
+     * @brief Builds the ustar header of an object.
+     */
+    inline TarHeader makeHeader(const std::string& object_id, size_t size, time_t mtime) {
+        TarHeader header{};
+        std::strncpy(header.name, object_id.c_str(), sizeof(header.name) - 1);
+        std::snprintf(header.mode, sizeof(header.mode), "%07o", 0644);
+        std::snprintf(header.uid, sizeof(header.uid), "%07o", 0);
+        std::snprintf(header.gid, sizeof(header.gid), "%07o", 0);
+        // Clamped to what the 11-digit fields hold (objects are far smaller)
+        std::snprintf(header.size, sizeof(header.size), "%011llo",
+                      std::min<unsigned long long>(size, TAR_OCTAL_MAX));
+        std::snprintf(header.mtime, sizeof(header.mtime), "%011llo",
+                      std::min<unsigned long long>(mtime < 0 ? 0 : mtime, TAR_OCTAL_MAX));
+        header.typeflag = '0';
+        std::memcpy(header.magic, "ustar", 6);
+        std::memcpy(header.version, "00", 2);
+        std::strncpy(header.uname, "hearty", sizeof(header.uname) - 1);
+        std::strncpy(header.gname, "hearty", sizeof(header.gname) - 1);
+        std::snprintf(header.checksum, sizeof(header.checksum), "%06o", headerChecksum(header));
+        header.checksum[7] = ' ';
+        return header;
+    }
+
+    inline unsigned long long parseOctal(const char* field, size_t length) {
+        unsigned long long value = 0;
+        size_t i = 0;
+        while (i < length && field[i] == ' ') i++;
+        for (; i < length && field[i] >= '0' && field[i] <= '7'; i++) {
+            value = value * 8 + (field[i] - '0');
+        }
+        return value;
+    }
+
+    /**
+     * @brief Decodes a header record.
+     *
+     * @return true if the record is a valid header; false if it is corrupt.
+     */
+    inline bool parseHeader(const TarHeader& header, ArchiveEntry& entry) {
+        if (parseOctal(header.checksum, sizeof(header.checksum)) != headerChecksum(header)) {
+            return false;
+        }
+        std::string name(header.name, strnlen(header.name, sizeof(header.name)));
+        if (std::memcmp(header.magic, "ustar", 5) == 0 && header.prefix[0] != '\0') {
+            name = std::string(header.prefix, strnlen(header.prefix, sizeof(header.prefix))) + "/" + name;
+        }
+        entry.name = name;
+        entry.size = parseOctal(header.size, sizeof(header.size));
+        entry.mtime = static_cast<time_t>(parseOctal(header.mtime, sizeof(header.mtime)));
+        entry.is_file = header.typeflag == '0' || header.typeflag == '\0';
+        return true;
+    }
+
+    inline bool isZeroRecord(const TarHeader& header) {
+        const char* bytes = reinterpret_cast<const char*>(&header);
+        for (size_t i = 0; i < sizeof(TarHeader); i++) {
+            if (bytes[i] != 0) return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,248 @@
+/**
+ * @file hearty-store-async.hpp
+ * @author Nathadon Samairat
+ * @brief C++20 coroutine API for embedding the store in a process:
+ *
+ *            AsyncStore store(1);
+ *            std::string id = co_await store.put("/path/to/file");
+ *            std::optional<std::string> data = co_await store.get(id);
+ *
+ *        Each operation suspends the calling coroutine and runs the blocking
+ *        StorePut/StoreGet work as a task on the shared executor, resuming the
+ *        coroutine on that worker when it completes. Any number of operations can
+ *        be in flight while only the executor's threads do I/O. Requires -std=c++20.
+ *        Awaitables are kept in named locals: GCC 12 destroys lambda captures of a
+ *        temporary awaitable twice.
+ * @version 0.1
+ * @date 2024-12-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <latch>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-get.hpp"
+
+/**
+ * @brief Lazily started coroutine producing a T. Awaiting it starts it and resumes
+ *        the awaiting coroutine (by symmetric transfer) once it has finished.
+ */
+template <typename T>
+class Task {
+public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> self) noexcept {
+                std::coroutine_handle<> next = self.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T result) { value = std::move(result); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().error) {
+            std::rethrow_exception(handle.promise().error);
+        }
+        return std::move(*handle.promise().value);
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Awaitable that runs a blocking function on the shared executor and
+ *        resumes the awaiting coroutine with its result.
+ */
+template <typename F>
+class Offload {
+private:
+    using Result = decltype(std::declval<F&>()());
+    F fn;
+    std::optional<Result> result;
+    std::exception_ptr error;
+
+public:
+    explicit Offload(F f) : fn(std::move(f)) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> caller) {
+        Executor::shared().submit([this, caller] {
+            try {
+                result.emplace(fn());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            caller.resume();
+        });
+    }
+    Result await_resume() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*result);
+    }
+};
+
+/**
+ * @brief Coroutine type with no result that starts immediately and cleans up after
+ *        itself; used to drive Tasks from synchronous code.
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+namespace async {
+    /**
+     * @brief Starts every task concurrently and blocks until all have finished.
+     *
+     * @return The results in the order of the tasks.
+     */
+    template <typename T>
+    std::vector<T> syncWaitAll(std::vector<Task<T>> tasks) {
+        std::vector<std::optional<T>> results(tasks.size());
+        std::vector<std::exception_ptr> errors(tasks.size());
+        std::latch done(static_cast<std::ptrdiff_t>(tasks.size()));
+
+        auto drive = [](Task<T>& task, std::optional<T>& result,
+                        std::exception_ptr& error, std::latch& latch) -> DetachedTask {
+            try {
+                result.emplace(co_await task);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            latch.count_down();
+        };
+        for (size_t i = 0; i < tasks.size(); i++) {
+            drive(tasks[i], results[i], errors[i], done);
+        }
+        done.wait();
+
+        std::vector<T> values;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+            values.push_back(std::move(*results[i]));
+        }
+        return values;
+    }
+
+    /**
+     * @brief Runs one task to completion from synchronous code.
+     */
+    template <typename T>
+    T syncWait(Task<T> task) {
+        std::vector<Task<T>> tasks;
+        tasks.push_back(std::move(task));
+        return std::move(syncWaitAll(std::move(tasks))[0]);
+    }
+}
+
+class AsyncStore {
+private:
+    int store_id;
+
+public:
+    explicit AsyncStore(int id) : store_id(id) {}
+
+    /**
+     * @brief Stores a file as a new object.
+     *
+     * @param file_path Path of the file to store.
+     *
+     * @return The new object's ID, or an empty string on failure.
+     */
+    Task<std::string> put(std::string file_path) {
+        int id = store_id;
+        Offload operation([id, file_path] {
+            StorePut store_put(id);
+            return store_put.put(file_path);
+        });
+        co_return co_await operation;
+    }
+
+    /**
+     * @brief Stores an in-memory buffer as a new object.
+     *
+     * @param data Contents of the object.
+     *
+     * @return The new object's ID, or an empty string on failure.
+     */
+    Task<std::string> putData(std::string data) {
+        int id = store_id;
+        Offload operation([id, data = std::move(data)] {
+            std::istringstream input(data);
+            StorePut store_put(id);
+            return store_put.put(input);
+        });
+        co_return co_await operation;
+    }
+
+    /**
+     * @brief Reads an object (or a byte range of it).
+     *
+     * @param object_id ID of the object.
+     * @param offset Start of the range within the object.
+     * @param length Length of the range.
+     *
+     * @return The object's data, or std::nullopt if it could not be read.
+     */
+    Task<std::optional<std::string>> get(std::string object_id, size_t offset = 0,
+                                         size_t length = WHOLE_OBJECT) {
+        int id = store_id;
+        Offload operation([id, object_id, offset, length] {
+            StoreGet store_get(id);
+            std::ostringstream out;
+            bool ok = store_get.get(object_id, out, offset, length);
+            return ok ? std::optional<std::string>(out.str()) : std::nullopt;
+        });
+        co_return co_await operation;
+    }
+};
@@ -0,0 +1,175 @@
+/**
+ * @file hearty-store-batch-put.cpp
+ * @author Nathadon Samairat
+ * @brief Stores many files in one invocation. Every file is put through the
+ *        coroutine API (AsyncStore), so all puts are in flight at once and share
+ *        the executor's threads instead of taking one process (or thread) each.
+ *        With --spread, the files are spread over the members of the store's HA
+ *        group instead, one file per member at the same block index, so each group
+ *        of files is written as a full stripe without any parity reads.
+ *        Parity deltas of the batch are coalesced per stripe (ParityBuffer); with
+ *        --spread, the files of a stripe that cannot be written as a whole are put
+ *        at a block index free in each of their members, so their deltas fall into
+ *        one stripe and reach parity.bin in a single write.
+ * @version 0.1
+ * @date 2024-12-06
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include "hearty-store-common.hpp"
+#include "hearty-store-async.hpp"
+#include "hearty-store-fullstripe.hpp"
+#include "hearty-store-parity-buffer.hpp"
+#include "hearty-store-topology.hpp"
+
+/**
+ * @brief Stores files across the members of an HA group, a full stripe (one file
+ *        per member) at a time. Stripes that cannot be written as a whole (a member
+ *        is destroyed, no common free block, or the last partial stripe) fall back
+ *        to individual puts, aimed at one block index so their parity deltas are
+ *        coalesced.
+ *
+ * @param store_id Any member of the group.
+ * @param file_paths Files to store.
+ * @param out Receives "file-path object-id store-id" per stored file.
+ *
+ * @return The number of files that could not be stored, or -1 if the store is not
+ *         in an HA group.
+ */
+int spreadPut(int store_id, const std::vector<std::string>& file_paths, std::ostream& out) {
+    StoreMetadata metadata;
+    std::shared_ptr<const HATopology> group;
+    if (!utils::loadStoreMetadata(store_id, metadata) || metadata.ha_group_id == -1 ||
+        !(group = topology::load(metadata.ha_group_id))) {
+        return -1;
+    }
+
+    FullStripeWriter writer(group);
+    int failed = 0;
+    for (size_t first = 0; first < file_paths.size(); first += writer.width()) {
+        size_t count = std::min(writer.width(), file_paths.size() - first);
+
+        std::vector<StripeObject> stripe(count);
+        bool readable = true;
+        for (size_t i = 0; i < count; i++) {
+            std::ifstream input(file_paths[first + i], std::ios::binary);
+            readable = readable && input.is_open();
+            stripe[i].object_id = StorePut::generateUniqueId();
+            stripe[i].data.assign(std::istreambuf_iterator<char>(input), {});
+            readable = readable && stripe[i].data.size() <= BLOCK_SIZE;
+        }
+
+        StripeWriteResult result = StripeWriteResult::NOT_APPLICABLE;
+        if (readable && count == writer.width()) {
+            result = writer.write(stripe);
+        }
+
+        int preferred_block = result == StripeWriteResult::NOT_APPLICABLE ? writer.commonFreeBlock(count) : -1;
+        for (size_t i = 0; i < count; i++) {
+            const std::string& file_path = file_paths[first + i];
+            int member = group->members()[i];
+            std::string object_id = stripe[i].object_id;
+            if (result == StripeWriteResult::NOT_APPLICABLE) {
+                StorePut store_put(member);
+                object_id = store_put.put(file_path, "", preferred_block);
+            } else if (result == StripeWriteResult::FAILED) {
+                object_id.clear();
+            }
+
+            if (object_id.empty()) {
+                std::cerr << "Failed to store file " << file_path << std::endl;
+                failed++;
+                continue;
+            }
+            out << file_path << " " << object_id << " " << member << std::endl;
+        }
+    }
+    return failed;
+}
+
+/**
+ * @brief Stores one file, turning any failure into an empty ID so that one bad
+ *        file never stops the rest of the batch from being reported.
+ *
+ * @param store Store to put the file into.
+ * @param file_path File to store.
+ *
+ * @return The new object's ID, or an empty string on failure.
+ */
+Task<std::string> putFile(AsyncStore& store, std::string file_path) {
+    try {
+        co_return co_await store.put(file_path);
+    } catch (const std::exception& e) {
+        std::cerr << "Error storing " << file_path << ": " << e.what() << std::endl;
+        co_return "";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    bool spread = argc >= 3 && std::string(argv[2]) == "--spread";
+    if (argc < (spread ? 4 : 3)) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] [--spread] [file-path...]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        // Coalesce the parity updates of the whole batch per stripe
+        ParityBuffer::enable();
+
+        if (spread) {
+            int failed = spreadPut(store_id, std::vector<std::string>(argv + 3, argv + argc),
+                                   std::cout);
+            if (failed == -1) {
+                std::cerr << "Store " << store_id << " is not in an HA group" << std::endl;
+            }
+            if (!ParityBuffer::flushAll()) {
+                std::cerr << "Failed to flush parity updates" << std::endl;
+                failed = 1;
+            }
+            ParityBuffer::report(std::cerr);
+            return failed == 0 ? 0 : 1;
+        }
+
+        AsyncStore store(store_id);
+        std::vector<Task<std::string>> puts;
+        for (int i = 2; i < argc; i++) {
+            puts.push_back(putFile(store, argv[i]));
+        }
+        std::vector<std::string> object_ids = async::syncWaitAll(std::move(puts));
+        int failed = 0;
+        if (!ParityBuffer::flushAll()) {
+            std::cerr << "Failed to flush parity updates" << std::endl;
+            failed++;
+        }
+
+        ParityBuffer::report(std::cerr);
+
+        // Output "file-path object-id" for every stored file, in argument order
+        for (size_t i = 0; i < object_ids.size(); i++) {
+            if (object_ids[i].empty()) {
+                std::cerr << "Failed to store file " << argv[i + 2] << std::endl;
+                failed++;
+                continue;
+            }
+            std::cout << argv[i + 2] << " " << object_ids[i] << std::endl;
+        }
+        return failed == 0 ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,241 @@
+/**
+ * @file hearty-store-bench.cpp
+ * @author Nathadon Samairat
+ * @brief Startup benchmark of the CLIs. Every CLI is run in its minimal invocation
+ *        (its usage check), then the common operations are run against a scratch
+ *        store. For each, the wall time, minor and major page faults and peak RSS
+ *        of the child process are reported (medians over the runs), so an eager
+ *        allocation or a slow start shows up as a regression in these numbers.
+ * @version 0.1
+ * @date 2024-12-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "hearty-store-common.hpp"
+
+const int DEFAULT_BENCH_RUNS = 5;
+const int DEFAULT_BENCH_STORE = 9000;
+const size_t BENCH_OBJECT_SIZE = 64 * 1024;
+
+// The CLIs, each benchmarked in its minimal invocation (no arguments)
+const std::vector<std::string> BENCH_TOOLS = {
+    "init", "put", "get", "list", "destroy", "replicate", "ha", "ls", "snapshot",
+    "send", "receive", "pool", "verify", "rebuild", "find", "batch-put", "export",
+    "import", "fsck", "s3"
+};
+
+// CLIs that do real work without arguments (fsck checks every store, s3 starts
+// serving); they are given an invalid option so only the usage check runs
+const std::vector<std::string> BENCH_USAGE_ONLY = {"fsck", "s3"};
+
+struct RunSample {
+    double wall_ms;
+    long minor_faults;
+    long major_faults;
+    long max_rss_kb;
+};
+
+class StoreBench {
+private:
+    std::filesystem::path bin_dir;
+    std::map<std::string, std::vector<RunSample>> samples;
+    std::vector<std::string> order;     // Rows in the order first run
+
+    template <typename T>
+    static T median(std::vector<T> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    /**
+     * @brief Runs a CLI and records its sample under `label`.
+     *
+     * @param label Row of the report.
+     * @param tool CLI name without the "hearty-store-" prefix.
+     * @param args Arguments of the CLI.
+     * @param output Receives the CLI's stdout (its stderr is discarded).
+     *
+     * @return true if the CLI exits with status 0; false otherwise.
+     */
+    bool run(const std::string& label, const std::string& tool,
+             const std::vector<std::string>& args, std::string* output = nullptr) {
+        std::string path = (bin_dir / ("hearty-store-" + tool)).string();
+        std::vector<std::string> argv_strings = {path};
+        argv_strings.insert(argv_strings.end(), args.begin(), args.end());
+        std::vector<char*> argv;
+        for (std::string& arg : argv_strings) argv.push_back(arg.data());
+        argv.push_back(nullptr);
+
+        int pipe_fds[2];
+        if (pipe(pipe_fds) != 0) return false;
+
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(pipe_fds[1], STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(pipe_fds[0]);
+            execv(path.c_str(), argv.data());
+            _exit(127);
+        }
+        close(pipe_fds[1]);
+        if (pid < 0) {
+            close(pipe_fds[0]);
+            return false;
+        }
+
+        std::string text;
+        char buffer[4096];
+        ssize_t count;
+        while ((count = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+            text.append(buffer, count);
+        }
+        close(pipe_fds[0]);
+
+        int status = 0;
+        struct rusage usage{};
+        if (wait4(pid, &status, 0, &usage) != pid) return false;
+        double wall_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+
+        if (samples.find(label) == samples.end()) order.push_back(label);
+        samples[label].push_back(RunSample{wall_ms, usage.ru_minflt, usage.ru_majflt, usage.ru_maxrss});
+        if (output != nullptr) *output = text;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+public:
+    explicit StoreBench(std::filesystem::path dir) : bin_dir(std::move(dir)) {}
+
+    /**
+     * @brief Runs every CLI with no arguments, which for most only checks the usage,
+     *        or with --help where no arguments would start real work.
+     */
+    void runStartup() {
+        for (const std::string& tool : BENCH_TOOLS) {
+            if (std::find(BENCH_USAGE_ONLY.begin(), BENCH_USAGE_ONLY.end(), tool) !=
+                BENCH_USAGE_ONLY.end()) {
+                run(tool + " (--help)", tool, {"--help"});
+            } else {
+                run(tool + " (no args)", tool, {});
+            }
+        }
+    }
+
+    /**
+     * @brief Runs the common operations against a scratch store, then removes it.
+     *
+     * @param store_id ID of the scratch store; it must not exist.
+     * @param object_path File to put.
+     *
+     * @return true if every operation succeeds; false otherwise.
+     */
+    bool runOperations(int store_id, const std::string& object_path) {
+        std::string id = std::to_string(store_id);
+        if (!run("init", "init", {id})) {
+            return false;
+        }
+
+        // "Successfully put object id <id> ..."
+        std::string output;
+        std::string marker = "object id ";
+        bool ok = run("put", "put", {id, object_path}, &output) &&
+                  output.find(marker) != std::string::npos;
+        if (ok) {
+            std::string object_id = output.substr(output.find(marker) + marker.size());
+            object_id = object_id.substr(0, object_id.find_first_of(" \n"));
+            ok = run("get", "get", {id, object_id}) &&
+                 run("ls", "ls", {id}) &&
+                 run("list", "list", {}) &&
+                 run("find", "find", {object_id}) &&
+                 run("snapshot", "snapshot", {id});
+        }
+        return run("destroy", "destroy", {id}) && ok;
+    }
+
+    /**
+     * @brief Prints the median of every row.
+     */
+    void report(std::ostream& out) {
+        out << std::left << std::setw(20) << "invocation" << std::right
+            << std::setw(10) << "wall-ms" << std::setw(10) << "minflt"
+            << std::setw(10) << "majflt" << std::setw(12) << "maxrss-kb" << std::endl;
+        for (const std::string& label : order) {
+            std::vector<double> wall;
+            std::vector<long> minor, major, rss;
+            for (const RunSample& sample : samples[label]) {
+                wall.push_back(sample.wall_ms);
+                minor.push_back(sample.minor_faults);
+                major.push_back(sample.major_faults);
+                rss.push_back(sample.max_rss_kb);
+            }
+            out << std::left << std::setw(20) << label << std::right << std::fixed
+                << std::setprecision(2) << std::setw(10) << median(wall)
+                << std::setw(10) << median(minor) << std::setw(10) << median(major)
+                << std::setw(12) << median(rss) << std::endl;
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " [runs] [scratch-store-id]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int runs = argc > 1 ? std::stoi(argv[1]) : DEFAULT_BENCH_RUNS;
+        int store_id = argc > 2 ? std::stoi(argv[2]) : DEFAULT_BENCH_STORE;
+        if (runs < 1) {
+            std::cerr << "Runs must be at least 1" << std::endl;
+            return 1;
+        }
+        if (utils::storeExists(store_id)) {
+            std::cerr << "Scratch store " << store_id << " already exists" << std::endl;
+            return 1;
+        }
+
+        std::string object_path = BASE_PATH + "/hearty-bench-object.bin";
+        {
+            std::ofstream object(object_path, std::ios::binary | std::ios::trunc);
+            std::vector<char> data(BENCH_OBJECT_SIZE);
+            for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i * 31);
+            object.write(data.data(), data.size());
+        }
+
+        StoreBench bench(std::filesystem::read_symlink("/proc/self/exe").parent_path());
+        bool ok = true;
+        for (int i = 0; i < runs; i++) {
+            bench.runStartup();
+            if (!bench.runOperations(store_id, object_path)) {
+                std::cerr << "Operation run " << i << " failed" << std::endl;
+                ok = false;
+                break;
+            }
+        }
+        std::filesystem::remove(object_path);
+
+        bench.report(std::cout);
+        return ok ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
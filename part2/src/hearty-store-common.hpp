@@ -1,6 +1,16 @@
+#pragma once
+
+#include <array>
 #include <string>
 #include <cstring>
+#include <cstdint>
 #include <vector>
+#include <fstream>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "hearty-store-io.hpp"
 
 const size_t BLOCK_SIZE = 1024 * 1024;              // 1MB
 const size_t NUM_BLOCKS = 1024;                     // 1024 blocks
@@ -9,12 +19,28 @@ const std::string DATA_FILENAME = "/data.bin";      // Actual data file name
 const std::string META_FILENAME = "/metadata.bin";  // Meta data file name
 const std::string STORE_DIR = "/store_";            // Default path to storage
 const std::string PARITY_FILENAME = "/parity.bin";   // parity filename
+const std::string HA_MANIFEST_FILENAME = "/manifest.bin"; // HA group manifest (members, health, parity layout)
+const std::string SNAPSHOT_DIR = "/snapshots";     // Snapshots directory in a store
+const std::string PIN_MAP_FILENAME = "/pinned.bin"; // Per-block snapshot reference counts
+const std::string POOL_DIR = "/pool_";              // Storage pool directory prefix
+const std::string POOL_MEMBERS_FILENAME = "/members.bin"; // Member store IDs of a pool
+const std::string POOL_KEYS_FILENAME = "/keys.bin";     // Keys stored through a pool
+const std::string STRIPE_DIR = "/stripes";          // Stripe manifests in an HA group
+const std::string PARITY_JOURNAL_DIR = "/journal";  // Parity write-back journals in an HA group
+const std::string MERKLE_FILENAME = "/merkle.bin";  // Merkle tree of a store's block hashes
+const std::string FILTER_FILENAME = "/bloom.bin";  // Bloom filter of a store's object IDs
+const std::string REBUILD_FILENAME = "/rebuild.bin"; // Progress of a member rebuild in an HA group
+const std::string SPARES_FILENAME = "/hot_spares.bin"; // Store IDs of the hot-spare pool
+const size_t OBJECT_ID_SIZE = 64;                   // Max object ID length incl. NUL
+const size_t STREAM_CHUNK_SIZE = 64 * 1024;         // Streaming put chunk (64KB)
 
 struct BlockMetadata {
-    bool is_used;           // Is this block currently storing an object
-    std::string object_id;  // Unique identifier for the object in this block
+    bool is_used;                   // Is this block currently storing an object
+    char object_id[OBJECT_ID_SIZE]; // Unique identifier for the object in this block
     size_t data_size;       // Actual size of data in the block
     time_t timestamp;       // Last modification time will be used for object ID
+    uint32_t checksum;      // CRC-32 of the object's data
+    size_t extent;          // High-water mark of bytes ever written; the rest of the block is zero
 };
 
 struct StoreMetadata {
@@ -28,11 +54,37 @@ struct StoreMetadata {
     bool is_destroyed;       // If store is in destroyed state
 };
 
-struct HAGroupStatus {
-    int group_id;               // group ID
-    int store_count;            // how many store in ha left
-    int destroyed_count;        // how many store has been destroyed
-    std::vector<int> store_ids; // all store id in the ha
+struct RebuildState {
+    int store_id;               // destroyed member being rebuilt
+    int spare_id;               // hot spare receiving its blocks
+    size_t next_block;          // watermark: blocks below it are rebuilt on the spare
+};
+
+// Holds an exclusive flock() on a file or directory for the lifetime of the object.
+// Each lock opens its own descriptor, so it also excludes threads of the same process.
+class FileLock {
+private:
+    int fd;
+
+public:
+    explicit FileLock(const std::string& path) : fd(open(path.c_str(), O_RDONLY)) {
+        if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    ~FileLock() {
+        if (fd >= 0) {
+            flock(fd, LOCK_UN);
+            close(fd);
+        }
+    }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    bool locked() const { return fd >= 0; }
 };
 
 // Utility functions
@@ -53,8 +105,183 @@ namespace utils {
         return BASE_PATH + "/ha_group_" + std::to_string(ha_group_id);
     }
 
+    inline std::string getManifestPath(int ha_group_id) {
+        return getHAPath(ha_group_id) + HA_MANIFEST_FILENAME;
+    }
+
+    inline std::string getSnapshotDir(int store_id) {
+        return getStorePath(store_id) + SNAPSHOT_DIR;
+    }
+
+    inline std::string getSnapshotPath(int store_id, int snapshot_id) {
+        return getSnapshotDir(store_id) + "/" + std::to_string(snapshot_id);
+    }
+
+    inline std::string getPinMapPath(int store_id) {
+        return getSnapshotDir(store_id) + PIN_MAP_FILENAME;
+    }
+
+    inline std::string getStripePath(int ha_group_id, const std::string& object_id) {
+        return getHAPath(ha_group_id) + STRIPE_DIR + "/" + object_id;
+    }
+
+    // Checks whether an object ID can name a manifest inside the stripes directory
+    inline bool isStripeName(const std::string& object_id) {
+        return !object_id.empty() && object_id != "." && object_id != ".." &&
+               object_id.find_first_of(std::string("/\0", 2)) == std::string::npos;
+    }
+
+    // Checks whether an object ID has the "<id>.s<k>" form of a stripe chunk
+    inline bool isStripeChunkId(const std::string& object_id) {
+        size_t suffix = object_id.rfind(".s");
+        return suffix != std::string::npos && suffix > 0 && suffix + 2 < object_id.size() &&
+               object_id.find_first_not_of("0123456789", suffix + 2) == std::string::npos;
+    }
+
+    inline std::string getMerklePath(int store_id) {
+        return getStorePath(store_id) + MERKLE_FILENAME;
+    }
+
+    inline std::string getFilterPath(int store_id) {
+        return getStorePath(store_id) + FILTER_FILENAME;
+    }
+
+    inline std::string getRebuildPath(int ha_group_id) {
+        return getHAPath(ha_group_id) + REBUILD_FILENAME;
+    }
+
+    inline std::string getSparesPath() {
+        return BASE_PATH + SPARES_FILENAME;
+    }
+
+    inline std::string getPoolPath(int pool_id) {
+        return BASE_PATH + POOL_DIR + std::to_string(pool_id);
+    }
+
+    // Loads the number of snapshots referencing each block (all zero if there are none)
+    inline std::vector<uint16_t> loadPinMap(int store_id) {
+        std::vector<uint16_t> pins(NUM_BLOCKS, 0);
+        std::ifstream file(getPinMapPath(store_id), std::ios::binary);
+        if (file) {
+            file.read(reinterpret_cast<char*>(pins.data()), NUM_BLOCKS * sizeof(uint16_t));
+        }
+        return pins;
+    }
+
     // Checks if a store exists
     inline bool storeExists(int store_id) {
         return std::filesystem::exists(getStorePath(store_id));
     }
+
+    // Stores an object ID into a fixed-size metadata record (truncating if needed)
+    inline void setObjectId(BlockMetadata& block, const std::string& object_id) {
+        std::memset(block.object_id, 0, OBJECT_ID_SIZE);
+        std::strncpy(block.object_id, object_id.c_str(), OBJECT_ID_SIZE - 1);
+    }
+
+    // Extends a CRC-32 (IEEE) checksum with more data; start with crc = 0
+    inline uint32_t crc32(uint32_t crc, const char* data, size_t len) {
+        // Built once; function-local static initialization is thread-safe
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> entries{};
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[i] = c;
+            }
+            return entries;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < len; i++) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    // Extends a 64-bit hash with more data, 8 bytes per step (FNV-style multiply
+    // with an extra shift so high bits reach the low ones); start with seed = 0
+    inline uint64_t hash64(uint64_t seed, const void* data, size_t len) {
+        const uint64_t prime = 0x100000001b3ULL;
+        const char* bytes = static_cast<const char*>(data);
+        uint64_t h = seed ^ 0xcbf29ce484222325ULL ^ (len * prime);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            h = (h ^ word) * prime;
+            h ^= h >> 29;
+        }
+        for (; i < len; i++) {
+            h = (h ^ static_cast<unsigned char>(bytes[i])) * prime;
+        }
+        h ^= h >> 32;
+        return h;
+    }
+
+    // XORs src into dst; the bulk is done 32 bytes at a time with GCC vector
+    // extensions, which compile to SSE/AVX XORs
+    inline void xorInto(char* dst, const char* src, size_t len) {
+        typedef uint64_t Vec __attribute__((vector_size(32)));
+        size_t i = 0;
+        for (; i + sizeof(Vec) <= len; i += sizeof(Vec)) {
+            Vec a, b;
+            std::memcpy(&a, dst + i, sizeof(Vec));
+            std::memcpy(&b, src + i, sizeof(Vec));
+            a ^= b;
+            std::memcpy(dst + i, &a, sizeof(Vec));
+        }
+        for (; i < len; i++) {
+            dst[i] ^= src[i];
+        }
+    }
+
+    // Buffers covering a whole metadata file: the store header, then every block record
+    inline std::vector<iovec> metadataIov(StoreMetadata& store, std::vector<BlockMetadata>& blocks) {
+        return {{&store, sizeof(StoreMetadata)},
+                {blocks.data(), blocks.size() * sizeof(BlockMetadata)}};
+    }
+
+    // Reads the header of a store's metadata file
+    inline bool loadStoreMetadata(int store_id, StoreMetadata& metadata) {
+        RawFile file(getMetadataPath(store_id), O_RDONLY);
+        return file.isOpen() &&
+               file.readFull(reinterpret_cast<char*>(&metadata), sizeof(StoreMetadata), 0);
+    }
+
+    // Reads the record of a single block from a store's metadata file
+    inline bool loadBlockMetadata(int store_id, int block_num, BlockMetadata& block) {
+        RawFile file(getMetadataPath(store_id), O_RDONLY);
+        return file.isOpen() &&
+               file.readFull(reinterpret_cast<char*>(&block), sizeof(BlockMetadata),
+                             sizeof(StoreMetadata) + static_cast<size_t>(block_num) * sizeof(BlockMetadata));
+    }
+
+    // Reads the progress of the member rebuild running in an HA group, if any
+    inline bool loadRebuildState(int ha_group_id, RebuildState& state) {
+        RawFile file(getRebuildPath(ha_group_id), O_RDONLY);
+        return file.isOpen() &&
+               file.readFull(reinterpret_cast<char*>(&state), sizeof(RebuildState), 0);
+    }
+
+    // Data file holding a block of a store: its own, or for a destroyed HA member
+    // the hot spare's once the rebuild has passed the block. Empty if the block
+    // of a destroyed member is not rebuilt yet (it is only reachable through parity)
+    inline std::string memberDataPath(int ha_group_id, int store_id, bool destroyed, int block_num) {
+        if (!destroyed) {
+            return getDataPath(store_id);
+        }
+        RebuildState state;
+        if (ha_group_id != -1 && loadRebuildState(ha_group_id, state) &&
+            state.store_id == store_id && static_cast<size_t>(block_num) < state.next_block) {
+            return getDataPath(state.spare_id);
+        }
+        return "";
+    }
+
+    inline std::string memberDataPath(const StoreMetadata& store, int block_num) {
+        return memberDataPath(store.ha_group_id, store.store_id, store.is_destroyed, block_num);
+    }
 }
\ No newline at end of file
@@ -1,7 +1,8 @@
 /**
  * @file hearty-store-destroy.cpp
  * @author Nathadon Samairat
- * @brief Handles the destruction of stores and related metadata or files.
+ * @brief Handles the destruction of stores and related metadata or files. A
+ *        destroyed HA group member is rebuilt onto a hot spare in the background.
  * @version 0.1
  * @date 2024-11-27
  * 
@@ -10,7 +11,14 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <functional>
+#include <spawn.h>
 #include "hearty-store-common.hpp"
+#include "hearty-store-rebuild.hpp"
+#include "hearty-store-topology.hpp"
+
+extern char** environ;
 
 class StoreDestroy {
 private:
@@ -29,6 +37,74 @@ private:
         return true;
     }
 
+    /**
+     * @brief Rewrites a store's header under the store lock, so a put committing
+     *        metadata at the same time is neither overwritten nor overwrites it.
+     * 
+     * @param store_id ID of the store to update.
+     * @param change Edits the header read under the lock.
+     * 
+     * @return true if the header is written; false otherwise.
+     */
+    bool updateStoreHeader(int store_id, const std::function<void(StoreMetadata&)>& change) {
+        FileLock store_lock(utils::getStorePath(store_id));
+        StoreMetadata metadata;
+        if (!loadStoreMetadata(store_id, metadata)) {
+            return false;
+        }
+        change(metadata);
+        std::fstream file(utils::getMetadataPath(store_id), std::ios::binary | std::ios::in | std::ios::out);
+        return file && file.write(reinterpret_cast<char*>(&metadata), sizeof(StoreMetadata)) && file.flush();
+    }
+
+    /**
+     * @brief Claims a hot spare for a destroyed HA member and starts
+     *        hearty-store-rebuild (next to this tool) in the background to rebuild
+     *        the member onto it. Disabled with HEARTY_AUTO_REBUILD=0.
+     * 
+     * @param store_id ID of the destroyed member.
+     */
+    void startRebuild(int store_id) {
+        const char* automatic = std::getenv("HEARTY_AUTO_REBUILD");
+        if (automatic != nullptr && std::string(automatic) == "0") {
+            return;
+        }
+
+        StoreRebuild rebuild(store_id);
+        if (!rebuild.load()) {
+            return;
+        }
+        int spare_id = rebuild.start();
+        if (spare_id == -1) {
+            std::cerr << "No hot spare available, store " << store_id << " stays degraded" << std::endl;
+            return;
+        }
+
+        // Detach the rebuild into its own session so it outlives this process
+        std::string tool = (std::filesystem::read_symlink("/proc/self/exe").parent_path() /
+                            "hearty-store-rebuild").string();
+        std::string id = std::to_string(store_id);
+        char* args[] = {tool.data(), id.data(), nullptr};
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+
+        pid_t pid;
+        int error = posix_spawn(&pid, tool.c_str(), &actions, &attr, args, environ);
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if (error != 0) {
+            std::cerr << "Failed to start rebuild, run: hearty-store-rebuild " << store_id << std::endl;
+            return;
+        }
+        std::cout << "Rebuilding store " << store_id << " onto hot spare " << spare_id << std::endl;
+    }
+
     /**
      * @brief Destroys the specified store, handling related stores or HA group data.
      * 
@@ -46,86 +122,56 @@ private:
 
         // Handle HA group
         if (metadata.ha_group_id != -1) {
-            // Mark as destroyed but don't remove files
+            // Mark as destroyed but don't remove files (block metadata is kept
+            // so degraded reads can still locate objects)
             metadata.is_destroyed = true;
-            std::ofstream meta_file(utils::getMetadataPath(store_id), std::ios::binary);
-            if (!meta_file.write(reinterpret_cast<char*>(&metadata), 
-                               sizeof(StoreMetadata))) {
+            if (!updateStoreHeader(store_id, [](StoreMetadata& header) { header.is_destroyed = true; })) {
                 std::cerr << "Failed to update metadata" << std::endl;
                 return false;
             }
 
-            // Get the ha group status
-            HAGroupStatus status;
-            std::string ha_path = utils::getHAPath(metadata.ha_group_id);
-            std::string filename = ha_path + "/status.data";
-            std::ifstream inFile(filename, std::ios::binary);
-            inFile.read(reinterpret_cast<char*>(&status.group_id), sizeof(status.group_id));
-            inFile.read(reinterpret_cast<char*>(&status.store_count), sizeof(status.store_count));
-            inFile.read(reinterpret_cast<char*>(&status.destroyed_count), sizeof(status.destroyed_count));
-
-            // Update the ha group status
-            status.destroyed_count++;
-            if (status.destroyed_count > 1) {
+            // Mark the member destroyed in the group manifest
+            if (!topology::setHealth(metadata.ha_group_id, store_id, MemberHealth::DESTROYED)) {
+                std::cerr << "Failed to update HA group manifest" << std::endl;
+                return false;
+            }
+            std::shared_ptr<const HATopology> group = topology::load(metadata.ha_group_id);
+            if (!group) {
+                std::cerr << "Failed to load HA group manifest" << std::endl;
+                return false;
+            }
+
+            if (group->destroyedCount() > 1) {
                 // Delete ha group is more than one was destroyed
-                for (int i = 0; i < status.store_count; i++) {
-                    // Get metadata for all store in ha
-                    int store_id; 
-                    inFile.read(reinterpret_cast<char*>(&store_id), sizeof(store_id));
-                    StoreMetadata target_metadata = metadata;
-                    if (store_id != metadata.store_id) {
-                        if (!loadStoreMetadata(store_id, target_metadata)) {
-                            std::cerr << "Failed to load store metadata" << std::endl;
-                            return false;
-                        }
-                    } 
-
-                    // Update metadata
-                    int temp_ha_group_id = target_metadata.ha_group_id;
-                    target_metadata.ha_group_id = -1;
-                    std::ofstream file(utils::getMetadataPath(target_metadata.store_id), std::ios::binary);
-                    if (!file) {
-                        std::cerr << "Failed to open metadata file for writing" << std::endl;
+                for (int member_id : group->members()) {
+                    // Take every member out of the group
+                    bool destroyed = false;
+                    if (!updateStoreHeader(member_id, [&destroyed](StoreMetadata& header) {
+                            header.ha_group_id = -1;
+                            destroyed = header.is_destroyed;
+                        })) {
+                        std::cerr << "Failed to update metadata of store " << member_id << std::endl;
                         return false;
                     }
-                    file.write(reinterpret_cast<char*>(&target_metadata), sizeof(StoreMetadata));
-                    file.close();
 
                     // Destroy the store if any
-                    if (target_metadata.is_destroyed) {
+                    if (destroyed) {
                         // Remove all files
                         try {
-                            std::filesystem::remove_all(utils::getStorePath(store_id));
+                            std::filesystem::remove_all(utils::getStorePath(member_id));
                         } catch (const std::filesystem::filesystem_error& e) {
                             std::cerr << "Failed to remove store files: " << e.what() << std::endl;
                             return false;
                         }   
                     }
-
-                    // Remove all files
-                    std::filesystem::remove_all(utils::getHAPath(temp_ha_group_id));
                 }
+
+                // Remove all files
+                std::filesystem::remove_all(utils::getHAPath(group->groupId()));
             } else {
-                // Write the update for ha status
-                std::string ha_filepath = ha_path + "/status.data";
-                std::ofstream outFile(ha_filepath, std::ios::binary);
-                if (!outFile) {
-                    std::cerr << "Error opening file for writing!" << std::endl;
-                    return false;
-                }
-                outFile.write(reinterpret_cast<const char*>(&status.group_id), sizeof(status.group_id));
-                outFile.write(reinterpret_cast<const char*>(&status.store_count), sizeof(status.store_count));
-                outFile.write(reinterpret_cast<const char*>(&status.destroyed_count), sizeof(status.destroyed_count));
-                
-                // Read and write store ids
-                for (int i = 0; i < status.store_count; i++) {  
-                    int store_id;
-                    inFile.read(reinterpret_cast<char*>(&store_id), sizeof(store_id));
-                    outFile.write(reinterpret_cast<const char*>(&store_id), sizeof(store_id));
-                }
-                outFile.close();
+                // Claim a hot spare and rebuild onto it in the background
+                startRebuild(store_id);
             }
-            inFile.close();
             return true;
         }
 
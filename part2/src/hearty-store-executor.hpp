@@ -0,0 +1,290 @@
+/**
+ * @file hearty-store-executor.hpp
+ * @author Nathadon Samairat
+ * @brief Work-stealing task executor shared by the store tools. Each worker owns a
+ *        bounded deque: it pops its own newest task and, when empty, steals the
+ *        oldest task of another worker. Pool size, queue depth and CPU affinity are
+ *        read from the environment (HEARTY_THREADS, HEARTY_QUEUE_DEPTH,
+ *        HEARTY_CPU_AFFINITY, e.g. "0-7,16").
+ * @version 0.1
+ * @date 2024-12-05
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+const size_t DEFAULT_QUEUE_DEPTH = 256;     // Tasks per worker deque
+
+class Executor {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    size_t queue_depth;
+    std::atomic<size_t> next_worker{0};
+    std::atomic<size_t> pending{0};
+    std::atomic<bool> stopping{false};
+    std::mutex wait_mutex;
+    std::condition_variable work_available;
+    std::condition_variable space_available;
+
+    // Index of the worker running on this thread (-1 outside the pool)
+    static int& currentWorker() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    /**
+     * @brief Takes one task: the newest of the worker's own deque, otherwise the
+     *        oldest of another worker's deque.
+     *
+     * @param self Worker looking for work (-1 for a thread outside the pool).
+     * @param task Receives the task.
+     *
+     * @return true if a task was taken; false if all deques are empty.
+     */
+    bool takeTask(int self, std::function<void()>& task) {
+        if (self >= 0) {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i <= workers.size(); i++) {
+            Worker& victim = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Runs a task taken from the deques and updates the pending count.
+     */
+    void runTask(std::function<void()>& task) {
+        pending--;
+        space_available.notify_one();
+        task();
+    }
+
+    /**
+     * @brief Main loop of a worker thread.
+     */
+    void workerLoop(int self) {
+        currentWorker() = self;
+        std::function<void()> task;
+        while (true) {
+            if (takeTask(self, task)) {
+                runTask(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            if (stopping && pending == 0) {
+                return;
+            }
+            work_available.wait(lock, [this] { return stopping || pending > 0; });
+        }
+    }
+
+    /**
+     * @brief Pins a thread to the given CPU list (ignored if empty).
+     */
+    static void setAffinity(std::thread& thread, const std::vector<int>& cpus) {
+        if (cpus.empty()) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &set);
+    }
+
+    /**
+     * @brief Parses a CPU list such as "0-3,8,10-11".
+     */
+    static std::vector<int> parseCpuList(const std::string& spec) {
+        std::vector<int> cpus;
+        size_t start = 0;
+        while (start < spec.size()) {
+            size_t end = spec.find(',', start);
+            std::string item = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            size_t dash = item.find('-');
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+            if (end == std::string::npos) break;
+            start = end + 1;
+        }
+        return cpus;
+    }
+
+    /**
+     * @brief Reads a positive integer from the environment.
+     */
+    static size_t envSize(const char* name, size_t fallback) {
+        const char* value = std::getenv(name);
+        if (value == nullptr) return fallback;
+        try {
+            long parsed = std::stol(value);
+            return parsed > 0 ? static_cast<size_t>(parsed) : fallback;
+        } catch (const std::exception&) {
+            return fallback;
+        }
+    }
+
+public:
+    /**
+     * @brief Starts a pool of worker threads.
+     *
+     * @param num_threads Number of workers (at least one).
+     * @param depth Maximum number of queued tasks per worker.
+     * @param cpus CPUs the workers may run on (empty for no pinning).
+     */
+    Executor(size_t num_threads, size_t depth, const std::vector<int>& cpus = {})
+        : queue_depth(depth) {
+        num_threads = std::max<size_t>(1, num_threads);
+        for (size_t i = 0; i < num_threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            threads.emplace_back(&Executor::workerLoop, this, static_cast<int>(i));
+            setAffinity(threads.back(), cpus);
+        }
+    }
+
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /**
+     * @brief Returns the process-wide executor, configured from the environment on
+     *        first use.
+     */
+    static Executor& shared() {
+        static Executor executor(
+            envSize("HEARTY_THREADS", std::max(1u, std::thread::hardware_concurrency())),
+            envSize("HEARTY_QUEUE_DEPTH", DEFAULT_QUEUE_DEPTH),
+            std::getenv("HEARTY_CPU_AFFINITY") ? parseCpuList(std::getenv("HEARTY_CPU_AFFINITY"))
+                                               : std::vector<int>{});
+        return executor;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    /**
+     * @brief Queues a task and returns a future for its result.
+     *
+     * Tasks submitted from a worker go to the back of its own deque; other threads
+     * spread tasks round-robin. When the target deque is full, a worker runs the
+     * task inline and an outside thread blocks until space is available.
+     */
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using Result = decltype(f());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        std::future<Result> future = packaged->get_future();
+
+        int self = currentWorker();
+        size_t target = self >= 0 ? static_cast<size_t>(self) : next_worker++ % workers.size();
+        while (true) {
+            {
+                Worker& worker = *workers[target];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if (worker.tasks.size() < queue_depth) {
+                    worker.tasks.emplace_back([packaged] { (*packaged)(); });
+                    pending++;
+                    break;
+                }
+            }
+
+            if (self >= 0) {
+                (*packaged)();  // Queue full: run inline rather than deadlock
+                return future;
+            }
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            space_available.wait_for(lock, std::chrono::milliseconds(1));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+        }
+        work_available.notify_one();
+        return future;
+    }
+
+    /**
+     * @brief Waits for a future, running queued tasks meanwhile so that tasks
+     *        waiting on sub-tasks never starve the pool.
+     */
+    template <typename T>
+    T wait(std::future<T>& future) {
+        std::function<void()> task;
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (takeTask(currentWorker(), task)) {
+                runTask(task);
+            } else {
+                future.wait_for(std::chrono::microseconds(100));
+            }
+        }
+        return future.get();
+    }
+
+    /**
+     * @brief Runs body(begin, end) over [0, count) split into chunks of at most
+     *        grain items, and returns true only if every chunk returned true.
+     */
+    template <typename F>
+    bool parallelFor(size_t count, size_t grain, F body) {
+        std::vector<std::future<bool>> futures;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = std::min(count, begin + grain);
+            futures.push_back(submit([body, begin, end] { return body(begin, end); }));
+        }
+
+        bool ok = true;
+        for (auto& future : futures) {
+            ok = wait(future) && ok;
+        }
+        return ok;
+    }
+};
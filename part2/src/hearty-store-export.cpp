@@ -0,0 +1,221 @@
+/**
+ * @file hearty-store-export.cpp
+ * @author Nathadon Samairat
+ * @brief Writes every object of a store (or of a snapshot of it) to stdout as a tar
+ *        archive (see hearty-store-archive.hpp). The used blocks are read in offset
+ *        order with page-aligned reads into pooled buffers, under a sequential
+ *        readahead hint, by a reader thread that runs ahead of the writer through a
+ *        bounded queue, so reading the next objects overlaps writing the archive.
+ *        Whole objects are checked against their CRC-32 before they are written.
+ * @version 0.1
+ * @date 2024-12-17
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-archive.hpp"
+
+const size_t EXPORT_QUEUE_DEPTH = 8;        // Objects read ahead of the writer
+const size_t EXPORT_READ_ALIGN = 4096;      // Reads are rounded up to whole pages
+
+struct ExportItem {
+    int block_num;
+    BlockMetadata block;
+    BlockBuffer buffer;
+    bool ok;
+};
+
+class StoreExport {
+private:
+    int store_id;
+    int snapshot_id;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<ExportItem> queue;
+    bool reader_done = false;
+    bool writer_failed = false;
+
+    /**
+     * @brief Loads the block records of the store or snapshot.
+     */
+    bool loadMetadata(StoreMetadata& store, std::vector<BlockMetadata>& blocks) {
+        std::string metadata_path = snapshot_id == -1 ?
+            utils::getMetadataPath(store_id) :
+            utils::getSnapshotPath(store_id, snapshot_id) + META_FILENAME;
+        RawFile file(metadata_path, O_RDONLY);
+        blocks.resize(NUM_BLOCKS);
+        std::vector<iovec> iov = utils::metadataIov(store, blocks);
+        return file.isOpen() && file.readVec(iov, 0);
+    }
+
+    /**
+     * @brief Reads the used blocks in offset order and queues them for the writer.
+     *        Stops early if the writer failed.
+     */
+    void readBlocks(const RawFile& data_file, const std::vector<int>& used,
+                    const std::vector<BlockMetadata>& blocks) {
+        for (size_t i = 0; i < used.size(); i++) {
+            int block_num = used[i];
+            const BlockMetadata& block = blocks[block_num];
+
+            // Ask for the next object's pages while this one is read
+            if (i + 1 < used.size()) {
+                data_file.advise(static_cast<off_t>(used[i + 1]) * BLOCK_SIZE,
+                                 blocks[used[i + 1]].data_size, POSIX_FADV_WILLNEED);
+            }
+
+            ExportItem item{block_num, block, BlockBuffer(), false};
+            size_t aligned = std::min(BLOCK_SIZE, (block.data_size + EXPORT_READ_ALIGN - 1) /
+                                                   EXPORT_READ_ALIGN * EXPORT_READ_ALIGN);
+            {
+                IOGrant grant(IOClass::BACKGROUND, aligned);
+                ssize_t read = data_file.readAt(item.buffer.data(), aligned,
+                                                static_cast<off_t>(block_num) * BLOCK_SIZE);
+                item.ok = read >= static_cast<ssize_t>(block.data_size) &&
+                          utils::crc32(0, item.buffer.data(), block.data_size) == block.checksum;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return queue.size() < EXPORT_QUEUE_DEPTH || writer_failed; });
+            if (writer_failed) break;
+            bool stop = !item.ok;
+            queue.push_back(std::move(item));
+            changed.notify_all();
+            if (stop) break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        reader_done = true;
+        changed.notify_all();
+    }
+
+public:
+    StoreExport(int id, int snapshot = -1) : store_id(id), snapshot_id(snapshot) {}
+
+    /**
+     * @brief Writes the archive of the store to a stream.
+     *
+     * @param out Stream receiving the archive.
+     * @param exported Receives the number of objects written.
+     *
+     * @return true if every object is written; false otherwise.
+     */
+    bool exportTo(std::ostream& out, size_t& exported) {
+        StoreMetadata store;
+        std::vector<BlockMetadata> blocks;
+        if (!loadMetadata(store, blocks)) {
+            std::cerr << "Failed to load metadata" << std::endl;
+            return false;
+        }
+        if (store.is_destroyed) {
+            std::cerr << "Store " << store_id << " is destroyed; export its replica or rebuild it first"
+                      << std::endl;
+            return false;
+        }
+
+        RawFile data_file(utils::getDataPath(store_id), O_RDONLY);
+        if (!data_file.isOpen()) {
+            std::cerr << "Failed to open data file" << std::endl;
+            return false;
+        }
+        data_file.advise(0, 0, POSIX_FADV_SEQUENTIAL);
+
+        std::vector<int> used;
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            if (blocks[i].is_used) used.push_back(static_cast<int>(i));
+        }
+
+        std::thread reader([&] { readBlocks(data_file, used, blocks); });
+
+        static const char zeros[TAR_RECORD_SIZE] = {};
+        bool ok = true;
+        exported = 0;
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return !queue.empty() || reader_done; });
+            if (queue.empty()) break;
+            ExportItem item = std::move(queue.front());
+            queue.pop_front();
+            changed.notify_all();
+            lock.unlock();
+
+            if (!item.ok) {
+                std::cerr << "Failed to read object " << item.block.object_id << " (block "
+                          << item.block_num << "); it may have changed during the export,"
+                          << " export a snapshot instead" << std::endl;
+                ok = false;
+                break;
+            }
+
+            size_t size = item.block.data_size;
+            TarHeader header = archive::makeHeader(item.block.object_id, size, item.block.timestamp);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(TarHeader));
+            out.write(item.buffer.data(), size);
+            out.write(zeros, archive::padding(size));
+            if (!out) {
+                std::cerr << "Failed to write archive" << std::endl;
+                ok = false;
+                break;
+            }
+            exported++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writer_failed = !ok;
+            changed.notify_all();
+        }
+        reader.join();
+        if (!ok || exported != used.size()) {
+            return false;
+        }
+
+        // End of archive: two zero records
+        out.write(zeros, TAR_RECORD_SIZE);
+        out.write(zeros, TAR_RECORD_SIZE);
+        out.flush();
+        return static_cast<bool>(out);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "--snapshot")) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] [--snapshot snapshot-id] > archive.tar"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+        int snapshot_id = argc == 4 ? std::stoi(argv[3]) : -1;
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreExport exporter(store_id, snapshot_id);
+        size_t exported = 0;
+        if (!exporter.exportTo(std::cout, exported)) {
+            return 1;
+        }
+        std::cerr << "Exported " << exported << " objects from store " << store_id << std::endl;
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,173 @@
+/**
+ * @file hearty-store-filter.hpp
+ * @author Nathadon Samairat
+ * @brief Per-store Bloom filter of object IDs, kept in bloom.bin next to the object
+ *        indexes. It is a blocked filter: an ID's bits all fall in one 64-byte
+ *        block chosen by its hash, so asking a store whether it may hold an ID
+ *        reads 64 bytes. Puts add their IDs; removals leave their bits set (they
+ *        only cause false positives) and the filter is rebuilt from the ID index
+ *        once it has taken twice as many IDs as a store can hold.
+ * @version 0.1
+ * @date 2024-12-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-index.hpp"
+
+const uint32_t FILTER_MAGIC = 0x48534246;       // "HSBF"
+const uint32_t FILTER_VERSION = 1;
+const size_t FILTER_BLOCK_SIZE = 64;            // Bytes per block (one cache line)
+const size_t FILTER_BLOCKS = 64;                // 4KB of bits per store
+const size_t FILTER_PROBES = 7;                 // Bits set per ID
+const uint64_t FILTER_REBUILD_AFTER = 2 * NUM_BLOCKS;  // IDs added before a rebuild
+
+struct FilterHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t added;         // IDs added since the filter was last built
+};
+
+enum class FilterAnswer {
+    ABSENT,         // The store does not hold the ID
+    MAYBE,          // The store may hold the ID
+    NO_FILTER       // The store has no valid filter
+};
+
+class ObjectFilter {
+private:
+    int store_id;
+    FilterHeader header;
+    std::vector<unsigned char> bits;
+
+    /**
+     * @brief Block and bit positions of an ID: the block comes from the low bits
+     *        of its hash, the probes from two further hashes of it combined
+     *        (double hashing).
+     */
+    static size_t blockOf(uint64_t hash) { return hash % FILTER_BLOCKS; }
+
+    static size_t probeOf(uint64_t hash, size_t probe) {
+        uint64_t first = hash >> 6;
+        uint64_t step = (hash >> 35) | 1;
+        return (first + probe * step) % (FILTER_BLOCK_SIZE * 8);
+    }
+
+    static uint64_t hashOf(const std::string& object_id) {
+        return utils::hash64(0, object_id.data(), object_id.size());
+    }
+
+public:
+    ObjectFilter(int id)
+        : store_id(id), header{FILTER_MAGIC, FILTER_VERSION, 0},
+          bits(FILTER_BLOCKS * FILTER_BLOCK_SIZE, 0) {}
+
+    /**
+     * @brief Loads the store's filter.
+     *
+     * @return true if a valid filter is loaded; false otherwise.
+     */
+    bool load() {
+        RawFile file(utils::getFilterPath(store_id), O_RDONLY);
+        std::vector<iovec> iov = {{&header, sizeof(FilterHeader)}, {bits.data(), bits.size()}};
+        return file.isOpen() && file.readVec(iov, 0) &&
+               header.magic == FILTER_MAGIC && header.version == FILTER_VERSION;
+    }
+
+    /**
+     * @brief Saves the filter to the store's bloom.bin.
+     */
+    bool save() {
+        std::vector<iovec> iov = {{&header, sizeof(FilterHeader)}, {bits.data(), bits.size()}};
+        return io::replaceFile(utils::getFilterPath(store_id), iov);
+    }
+
+    void add(const std::string& object_id) {
+        uint64_t hash = hashOf(object_id);
+        unsigned char* block = bits.data() + blockOf(hash) * FILTER_BLOCK_SIZE;
+        for (size_t probe = 0; probe < FILTER_PROBES; probe++) {
+            size_t bit = probeOf(hash, probe);
+            block[bit / 8] |= static_cast<unsigned char>(1u << (bit % 8));
+        }
+        header.added++;
+    }
+
+    /**
+     * @brief Rebuilds the filter from the store's ID index, dropping the bits of
+     *        removed objects.
+     *
+     * @return true if the index is read; false otherwise.
+     */
+    bool rebuild() {
+        ObjectIndex index(store_id, IndexOrder::BY_ID);
+        if (!index.open()) {
+            return false;
+        }
+        std::fill(bits.begin(), bits.end(), 0);
+        header.added = 0;
+        IndexEntry entry;
+        for (uint64_t pos = 0; index.read(pos, entry); pos++) {
+            add(entry.object_id);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Adds a new object's ID and saves the filter, rebuilding it from the
+     *        ID index (which must already hold the object) when it is missing or
+     *        has taken too many IDs. The caller holds the store lock.
+     *
+     * @return true if the filter is saved; false otherwise.
+     */
+    bool insert(const std::string& object_id) {
+        return insertAll({object_id});
+    }
+
+    /**
+     * @brief Adds the IDs of a batch of new objects with one load and one save.
+     */
+    bool insertAll(const std::vector<std::string>& object_ids) {
+        if (!load() || header.added + object_ids.size() > FILTER_REBUILD_AFTER) {
+            return rebuild() && save();
+        }
+        for (const std::string& object_id : object_ids) {
+            add(object_id);
+        }
+        return save();
+    }
+
+    /**
+     * @brief Asks a store's filter whether the store may hold an ID. Reads only
+     *        the header and the ID's block.
+     */
+    static FilterAnswer query(int store_id, const std::string& object_id) {
+        RawFile file(utils::getFilterPath(store_id), O_RDONLY);
+        FilterHeader header;
+        if (!file.isOpen() ||
+            !file.readFull(reinterpret_cast<char*>(&header), sizeof(FilterHeader), 0) ||
+            header.magic != FILTER_MAGIC || header.version != FILTER_VERSION) {
+            return FilterAnswer::NO_FILTER;
+        }
+
+        uint64_t hash = hashOf(object_id);
+        unsigned char block[FILTER_BLOCK_SIZE];
+        if (!file.readFull(reinterpret_cast<char*>(block), FILTER_BLOCK_SIZE,
+                           sizeof(FilterHeader) + blockOf(hash) * FILTER_BLOCK_SIZE)) {
+            return FilterAnswer::NO_FILTER;
+        }
+        for (size_t probe = 0; probe < FILTER_PROBES; probe++) {
+            size_t bit = probeOf(hash, probe);
+            if (!(block[bit / 8] & (1u << (bit % 8)))) {
+                return FilterAnswer::ABSENT;
+            }
+        }
+        return FilterAnswer::MAYBE;
+    }
+};
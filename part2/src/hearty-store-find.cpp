@@ -0,0 +1,148 @@
+/**
+ * @file hearty-store-find.cpp
+ * @author Nathadon Samairat
+ * @brief Finds which stores hold an object, given only its ID. Each store's Bloom
+ *        filter is asked first (64 bytes read per store); only stores that may
+ *        hold the ID are checked in their ID index by binary search, so no
+ *        metadata.bin is opened.
+ * @version 0.1
+ * @date 2024-12-15
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "hearty-store-common.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-filter.hpp"
+#include "hearty-store-stripe.hpp"
+
+class StoreFind {
+private:
+    std::vector<int> store_ids;
+    size_t filters_read = 0;
+    size_t indexes_searched = 0;
+
+    /**
+     * @brief Binary searches a store's ID index for an object.
+     */
+    static bool inIndex(int store_id, const std::string& object_id) {
+        ObjectIndex index(store_id, IndexOrder::BY_ID);
+        if (!index.open()) return false;
+
+        IndexEntry probe{};
+        std::strncpy(probe.object_id, object_id.c_str(), OBJECT_ID_SIZE - 1);
+        IndexEntry entry;
+        return index.read(index.lowerBound(probe), entry) && object_id == entry.object_id;
+    }
+
+    /**
+     * @brief Checks whether a store holds an object: its filter first, then (if
+     *        the filter may hold the ID or is missing) its ID index.
+     */
+    bool holds(int store_id, const std::string& object_id) {
+        filters_read++;
+        if (ObjectFilter::query(store_id, object_id) == FilterAnswer::ABSENT) {
+            return false;
+        }
+        indexes_searched++;
+        return inIndex(store_id, object_id);
+    }
+
+public:
+    /**
+     * @brief Collects the IDs of all stores.
+     *
+     * @return true if at least one store exists; false otherwise.
+     */
+    bool load() {
+        if (!std::filesystem::exists(BASE_PATH)) {
+            return false;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(BASE_PATH)) {
+            std::string dirname = entry.path().filename().string();
+            if (entry.is_directory() && dirname.rfind("store_", 0) == 0) {
+                store_ids.push_back(std::stoi(dirname.substr(6)));
+            }
+        }
+        std::sort(store_ids.begin(), store_ids.end());
+        return !store_ids.empty();
+    }
+
+    /**
+     * @brief Finds the stores holding an object. A striped object is found in the
+     *        store holding its first chunk, which is the store to get it from.
+     *
+     * @param object_id ID of the object.
+     *
+     * @return IDs of the stores holding the object (several for a replica pair).
+     */
+    std::vector<int> find(const std::string& object_id) {
+        std::vector<int> found;
+        for (const std::string& id : {object_id, StoreStripe::chunkId(object_id, 0)}) {
+            for (int store_id : store_ids) {
+                if (holds(store_id, id)) {
+                    found.push_back(store_id);
+                }
+            }
+            if (!found.empty()) break;
+        }
+        return found;
+    }
+
+    size_t filtersRead() const { return filters_read; }
+    size_t indexesSearched() const { return indexes_searched; }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    std::vector<std::string> object_ids;
+    bool stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stats") {
+            stats = true;
+        } else {
+            object_ids.push_back(arg);
+        }
+    }
+    if (object_ids.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [object-id...] [--stats]" << std::endl;
+        return 1;
+    }
+
+    try {
+        StoreFind finder;
+        if (!finder.load()) {
+            std::cerr << "No stores found" << std::endl;
+            return 1;
+        }
+
+        // Prints "object-id store-id" per store holding the object
+        bool all_found = true;
+        for (const std::string& object_id : object_ids) {
+            std::vector<int> stores = finder.find(object_id);
+            if (stores.empty()) {
+                std::cerr << "Object not found: " << object_id << std::endl;
+                all_found = false;
+            }
+            for (int store_id : stores) {
+                std::cout << object_id << " " << store_id << std::endl;
+            }
+        }
+
+        if (stats) {
+            std::cerr << "Read " << finder.filtersRead() << " filters, searched "
+                      << finder.indexesSearched() << " indexes" << std::endl;
+        }
+        return all_found ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
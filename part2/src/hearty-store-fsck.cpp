@@ -0,0 +1,492 @@
+/**
+ * @file hearty-store-fsck.cpp
+ * @author Nathadon Samairat
+ * @brief Consistency check of stores, replica pairs and HA groups. The stores are
+ *        checked in parallel on the shared executor, each under its store lock:
+ *        the header against the block records (used_blocks), every record's sizes
+ *        against its block, object IDs, both index runs against the records, the
+ *        Bloom filter (it must not miss a stored ID), the replica pair and the HA
+ *        membership. Each HA group's manifest is checked against its members. With
+ *        --data, every object is also checked against its CRC-32, saved Merkle
+ *        trees against the blocks, and every stripe of each healthy HA group
+ *        against its parity, with the stripes split across the executor and XORed
+ *        with the SIMD kernel. Nothing is repaired.
+ * @version 0.1
+ * @date 2024-12-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-filter.hpp"
+#include "hearty-store-merkle.hpp"
+#include "hearty-store-topology.hpp"
+#include "hearty-store-parity-buffer.hpp"
+
+const size_t FSCK_PARITY_GRAIN = 16;    // Stripes checked per executor task
+
+namespace {
+    // True if the first `length` bytes of a buffer are zero
+    bool isZero(const char* data, size_t length) {
+        static const char zeros[4096] = {};
+        for (size_t done = 0; done < length; done += sizeof(zeros)) {
+            size_t chunk = std::min(sizeof(zeros), length - done);
+            if (std::memcmp(data + done, zeros, chunk) != 0) return false;
+        }
+        return true;
+    }
+}
+
+class StoreFsck {
+private:
+    int store_id;
+    bool check_data;
+    StoreMetadata store;
+    std::vector<BlockMetadata> blocks;
+    size_t used = 0;
+    std::vector<std::string> problems;
+
+    void report(const std::string& problem) {
+        problems.push_back(problem);
+    }
+
+    static std::string blockName(size_t block_num) {
+        return "block " + std::to_string(block_num);
+    }
+
+    void checkHeader() {
+        if (store.store_id != store_id) {
+            report("header holds store ID " + std::to_string(store.store_id));
+        }
+        if (store.total_blocks != NUM_BLOCKS || store.block_size != BLOCK_SIZE) {
+            report("header geometry is " + std::to_string(store.total_blocks) + " blocks of " +
+                   std::to_string(store.block_size) + " bytes");
+        }
+        if (store.used_blocks != used) {
+            report("used_blocks is " + std::to_string(store.used_blocks) + " but " +
+                   std::to_string(used) + " blocks are used");
+        }
+        if (!store.is_destroyed &&
+            (!std::filesystem::exists(utils::getDataPath(store_id)) ||
+             std::filesystem::file_size(utils::getDataPath(store_id)) < NUM_BLOCKS * BLOCK_SIZE)) {
+            report("data file is missing or short");
+        }
+    }
+
+    void checkBlocks() {
+        std::map<std::string, size_t> seen;
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            const BlockMetadata& block = blocks[i];
+            if (block.extent > BLOCK_SIZE) {
+                report(blockName(i) + ": extent " + std::to_string(block.extent) + " exceeds the block");
+            }
+            if (!block.is_used) continue;
+
+            size_t id_length = strnlen(block.object_id, OBJECT_ID_SIZE);
+            if (id_length == 0 || id_length == OBJECT_ID_SIZE) {
+                report(blockName(i) + ": object ID is empty or not terminated");
+                continue;
+            }
+            if (block.data_size > block.extent) {
+                report(blockName(i) + ": size " + std::to_string(block.data_size) +
+                       " exceeds its extent " + std::to_string(block.extent));
+            }
+            auto [found, inserted] = seen.emplace(block.object_id, i);
+            if (!inserted) {
+                report(blockName(i) + ": object " + block.object_id + " is also in " +
+                       blockName(found->second));
+            }
+            if (ObjectFilter::query(store_id, block.object_id) == FilterAnswer::ABSENT) {
+                report("Bloom filter misses object " + std::string(block.object_id));
+            }
+        }
+    }
+
+    // Orders two entries as ObjectIndex does
+    static int compare(const IndexEntry& a, const IndexEntry& b, IndexOrder order) {
+        if (order == IndexOrder::BY_TIME && a.timestamp != b.timestamp) {
+            return a.timestamp < b.timestamp ? -1 : 1;
+        }
+        return std::strncmp(a.object_id, b.object_id, OBJECT_ID_SIZE);
+    }
+
+    void checkIndex(IndexOrder order) {
+        std::string name = order == IndexOrder::BY_ID ? "ID index" : "time index";
+        ObjectIndex index(store_id, order);
+        if (!index.open()) {
+            report(name + " is missing or invalid");
+            return;
+        }
+        if (index.size() != used) {
+            report(name + " holds " + std::to_string(index.size()) + " entries for " +
+                   std::to_string(used) + " objects");
+        }
+
+        std::vector<bool> covered(NUM_BLOCKS, false);
+        IndexEntry previous{};
+        IndexEntry entry;
+        for (uint64_t pos = 0; index.read(pos, entry); pos++) {
+            std::string where = name + " entry " + std::to_string(pos);
+            if (pos > 0 && compare(previous, entry, order) >= 0) {
+                report(where + " is out of order");
+            }
+            previous = entry;
+
+            if (entry.block_num < 0 || static_cast<size_t>(entry.block_num) >= NUM_BLOCKS) {
+                report(where + " points outside the store");
+                continue;
+            }
+            const BlockMetadata& block = blocks[entry.block_num];
+            if (!block.is_used || std::strncmp(block.object_id, entry.object_id, OBJECT_ID_SIZE) != 0) {
+                report(where + " (" + std::string(entry.object_id, strnlen(entry.object_id, OBJECT_ID_SIZE)) +
+                       ") does not match " + blockName(entry.block_num));
+                continue;
+            }
+            if (block.timestamp != entry.timestamp || block.data_size != entry.data_size) {
+                report(where + " has a stale timestamp or size for " + block.object_id);
+            }
+            if (covered[entry.block_num]) {
+                report(where + " repeats " + blockName(entry.block_num));
+            }
+            covered[entry.block_num] = true;
+        }
+    }
+
+    void checkReplica() {
+        if (store.replica_of == -1) return;
+        StoreMetadata pair;
+        if (!utils::storeExists(store.replica_of) || !utils::loadStoreMetadata(store.replica_of, pair)) {
+            report("replica pair store " + std::to_string(store.replica_of) + " is missing");
+            return;
+        }
+        if (pair.replica_of != store_id || pair.is_replica == store.is_replica) {
+            report("replica pair with store " + std::to_string(store.replica_of) + " is not symmetric");
+        }
+    }
+
+    void checkMembership() {
+        if (store.ha_group_id == -1) return;
+        std::shared_ptr<const HATopology> group = topology::load(store.ha_group_id);
+        if (!group) {
+            report("HA group " + std::to_string(store.ha_group_id) + " has no valid manifest");
+        } else if (!group->contains(store_id)) {
+            report("not a member of HA group " + std::to_string(store.ha_group_id));
+        } else if (group->isDestroyed(store_id) != store.is_destroyed) {
+            report("HA group " + std::to_string(store.ha_group_id) + " records it as " +
+                   (group->isDestroyed(store_id) ? "destroyed" : "healthy"));
+        }
+    }
+
+    void checkData() {
+        if (store.is_destroyed) return;     // Its blocks are served through parity
+        RawFile data_file(utils::getDataPath(store_id), O_RDONLY);
+        if (!data_file.isOpen()) return;    // Reported by checkHeader
+        data_file.advise(0, 0, POSIX_FADV_SEQUENTIAL);
+
+        BlockBuffer buffer;
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            const BlockMetadata& block = blocks[i];
+            if (!block.is_used || block.data_size > BLOCK_SIZE) continue;
+            IOGrant grant(IOClass::BACKGROUND, block.data_size);
+            if (!data_file.readFull(buffer.data(), block.data_size, static_cast<off_t>(i) * BLOCK_SIZE) ||
+                utils::crc32(0, buffer.data(), block.data_size) != block.checksum) {
+                report(blockName(i) + ": object " + block.object_id + " fails its checksum");
+            }
+        }
+
+        // A saved tree must match the blocks (a missing one is built on demand)
+        RawFile merkle_file(utils::getMerklePath(store_id), O_RDONLY);
+        MerkleHeader header;
+        if (!merkle_file.isOpen()) return;
+        if (!merkle_file.readFull(reinterpret_cast<char*>(&header), sizeof(header), 0) ||
+            header.magic != MERKLE_MAGIC || header.version != MERKLE_VERSION) {
+            report("Merkle tree file is invalid");
+            return;
+        }
+        MerkleTree saved(store_id);
+        MerkleTree current(store_id);
+        if (!saved.load() || !current.rebuild() || saved.root() != current.root()) {
+            report("Merkle tree does not match the blocks");
+        }
+    }
+
+public:
+    StoreFsck(int id, bool data) : store_id(id), check_data(data), store{} {}
+
+    /**
+     * @brief Checks the store under its store lock.
+     *
+     * @return true if no problem is found; false otherwise.
+     */
+    bool run() {
+        FileLock store_lock(utils::getStorePath(store_id));
+        RawFile file(utils::getMetadataPath(store_id), O_RDONLY);
+        blocks.resize(NUM_BLOCKS);
+        std::vector<iovec> iov = utils::metadataIov(store, blocks);
+        if (!file.isOpen() || !file.readVec(iov, 0)) {
+            report("metadata is missing or short");
+            return false;
+        }
+        for (const BlockMetadata& block : blocks) {
+            used += block.is_used;
+        }
+
+        checkHeader();
+        checkBlocks();
+        checkIndex(IndexOrder::BY_ID);
+        checkIndex(IndexOrder::BY_TIME);
+        checkReplica();
+        checkMembership();
+        if (check_data) {
+            checkData();
+        }
+        return problems.empty();
+    }
+
+    int haGroupId() const { return store.ha_group_id; }
+    const std::vector<std::string>& problemList() const { return problems; }
+};
+
+class GroupFsck {
+private:
+    int group_id;
+    bool check_data;
+    std::vector<std::string> problems;
+
+    void report(const std::string& problem) {
+        problems.push_back(problem);
+    }
+
+    /**
+     * @brief XORs every stripe's member blocks into its parity (with the deltas
+     *        still buffered in journals) and reports the stripes that do not
+     *        cancel out. Each stripe is compared up to the largest extent of its
+     *        member blocks; past it every member block is zero, and so is parity.
+     */
+    void checkParity(const HATopology& group) {
+        // Hold off puts to the members (store locks in ID order, as puts to
+        // several stores take them) and parity writers for the whole pass
+        std::vector<int> lock_order = group.members();
+        std::sort(lock_order.begin(), lock_order.end());
+        std::vector<std::unique_ptr<FileLock>> store_locks;
+        for (int store_id : lock_order) {
+            store_locks.push_back(std::make_unique<FileLock>(utils::getStorePath(store_id)));
+        }
+        std::string parity_path = group.parityPath();
+        FileLock parity_lock(parity_path);
+        journal::replayOrphans(group_id);
+
+        // Extents as of now, under the locks: a put may have raised one before
+        std::vector<std::vector<BlockMetadata>> member_blocks(group.members().size());
+        for (size_t m = 0; m < group.members().size(); m++) {
+            StoreMetadata store;
+            member_blocks[m].resize(NUM_BLOCKS);
+            RawFile file(utils::getMetadataPath(group.members()[m]), O_RDONLY);
+            std::vector<iovec> iov = utils::metadataIov(store, member_blocks[m]);
+            if (!file.isOpen() || !file.readVec(iov, 0)) return;    // Reported as a member problem
+        }
+
+        std::mutex mutex;
+        std::vector<size_t> bad_stripes;
+        bool read = Executor::shared().parallelFor(NUM_BLOCKS, FSCK_PARITY_GRAIN,
+            [&](size_t begin, size_t end) {
+                RawFile parity_file(parity_path, O_RDONLY);
+                std::vector<RawFile> member_files;
+                for (int store_id : group.members()) {
+                    member_files.emplace_back(utils::getDataPath(store_id), O_RDONLY);
+                }
+                BlockBuffer stripe;
+                BlockBuffer member;
+                for (size_t i = begin; i < end; i++) {
+                    size_t extent = 0;
+                    for (const auto& blocks : member_blocks) {
+                        extent = std::max(extent, std::min(blocks[i].extent, BLOCK_SIZE));
+                    }
+                    if (extent == 0) continue;
+
+                    off_t offset = static_cast<off_t>(i) * BLOCK_SIZE;
+                    IOGrant grant(IOClass::BACKGROUND, extent * (member_files.size() + 1));
+                    if (!parity_file.readFull(stripe.data(), extent, offset)) return false;
+                    journal::overlayPending(group_id, offset, stripe.data(), extent);
+                    for (const RawFile& member_file : member_files) {
+                        if (!member_file.readFull(member.data(), extent, offset)) return false;
+                        utils::xorInto(stripe.data(), member.data(), extent);
+                    }
+                    if (!isZero(stripe.data(), extent)) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        bad_stripes.push_back(i);
+                    }
+                }
+                return true;
+            });
+
+        if (!read) {
+            report("failed to read the stripes");
+        }
+        std::sort(bad_stripes.begin(), bad_stripes.end());
+        for (size_t stripe : bad_stripes) {
+            report("stripe " + std::to_string(stripe) + " does not match its parity");
+        }
+    }
+
+public:
+    GroupFsck(int id, bool data) : group_id(id), check_data(data) {}
+
+    /**
+     * @brief Checks the group's manifest against its members and parity file.
+     *
+     * @return true if no problem is found; false otherwise.
+     */
+    bool run() {
+        std::shared_ptr<const HATopology> group = topology::load(group_id);
+        if (!group) {
+            report("manifest is missing or invalid");
+            return false;
+        }
+        const HAManifest& manifest = group->raw();
+        if (manifest.parity_layout != ParityLayout::DEDICATED ||
+            manifest.stripe_unit != BLOCK_SIZE || manifest.stripe_count != NUM_BLOCKS) {
+            report("manifest has an unknown parity layout");
+            return false;
+        }
+
+        std::set<int> seen;
+        bool members_ok = true;
+        for (int store_id : group->members()) {
+            StoreMetadata store;
+            if (!seen.insert(store_id).second) {
+                report("store " + std::to_string(store_id) + " is listed twice");
+                members_ok = false;
+            } else if (!utils::storeExists(store_id) || !utils::loadStoreMetadata(store_id, store)) {
+                report("member store " + std::to_string(store_id) + " is missing");
+                members_ok = false;
+            } else if (store.ha_group_id != group_id) {
+                report("member store " + std::to_string(store_id) + " is in HA group " +
+                       std::to_string(store.ha_group_id));
+                members_ok = false;
+            }
+        }
+        if (group->destroyedCount() > 1) {
+            report(std::to_string(group->destroyedCount()) + " members are destroyed");
+        }
+
+        std::error_code error;
+        if (std::filesystem::file_size(group->parityPath(), error) < NUM_BLOCKS * BLOCK_SIZE || error) {
+            report("parity file is missing or short");
+        } else if (check_data && members_ok && group->destroyedCount() == 0) {
+            checkParity(*group);
+        }
+        return problems.empty();
+    }
+
+    const std::vector<std::string>& problemList() const { return problems; }
+};
+
+/**
+ * @brief Collects the IDs of the directories under BASE_PATH named prefix<id>.
+ */
+static std::vector<int> listIds(const std::string& prefix) {
+    std::vector<int> ids;
+    for (const auto& entry : std::filesystem::directory_iterator(BASE_PATH)) {
+        std::string dirname = entry.path().filename().string();
+        if (entry.is_directory() && dirname.rfind(prefix, 0) == 0 &&
+            dirname.size() > prefix.size() &&
+            dirname.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+            ids.push_back(std::stoi(dirname.substr(prefix.size())));
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    std::vector<int> store_ids;
+    bool check_data = false;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--data") {
+                check_data = true;
+            } else {
+                store_ids.push_back(std::stoi(arg));
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Usage: " << argv[0] << " [store-id...] [--data]" << std::endl;
+        return 1;
+    }
+
+    try {
+        bool all_stores = store_ids.empty();
+        if (all_stores) {
+            store_ids = listIds(STORE_DIR.substr(1));
+        }
+        for (int store_id : store_ids) {
+            if (!utils::storeExists(store_id)) {
+                std::cerr << "Store " << store_id << " does not exist" << std::endl;
+                return 1;
+            }
+        }
+
+        std::vector<std::unique_ptr<StoreFsck>> stores;
+        for (int store_id : store_ids) {
+            stores.push_back(std::make_unique<StoreFsck>(store_id, check_data));
+        }
+        Executor::shared().parallelFor(stores.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                stores[i]->run();
+            }
+            return true;
+        });
+
+        // Every group when checking all stores; otherwise the groups of the stores
+        std::set<int> group_ids;
+        if (all_stores) {
+            std::vector<int> ids = listIds("ha_group_");
+            group_ids.insert(ids.begin(), ids.end());
+        }
+        for (const auto& store : stores) {
+            if (store->haGroupId() != -1) group_ids.insert(store->haGroupId());
+        }
+
+        size_t problems = 0;
+        for (size_t i = 0; i < stores.size(); i++) {
+            for (const std::string& problem : stores[i]->problemList()) {
+                std::cout << "store " << store_ids[i] << ": " << problem << std::endl;
+                problems++;
+            }
+        }
+        for (int group_id : group_ids) {
+            GroupFsck group(group_id, check_data);
+            group.run();
+            for (const std::string& problem : group.problemList()) {
+                std::cout << "HA group " << group_id << ": " << problem << std::endl;
+                problems++;
+            }
+        }
+
+        std::cout << "Checked " << stores.size() << " stores and " << group_ids.size()
+                  << " HA groups" << (check_data ? " (with data)" : "") << ": "
+                  << problems << " problems" << std::endl;
+        return problems == 0 ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
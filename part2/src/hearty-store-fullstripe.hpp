@@ -0,0 +1,234 @@
+/**
+ * @file hearty-store-fullstripe.hpp
+ * @author Nathadon Samairat
+ * @brief Full-stripe writes for HA groups. When a batch holds one new object for
+ *        every member of a group, all of them are written at the same block index
+ *        and the parity of that stripe is computed from the new data alone, so no
+ *        old data or old parity has to be read. Only the first `extent` bytes of
+ *        the stripe (the largest object) are written; the rest of the stripe and
+ *        its parity are left untouched and stay consistent.
+ * @version 0.1
+ * @date 2024-12-10
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-parity-buffer.hpp"
+#include "hearty-store-topology.hpp"
+
+struct StripeObject {
+    std::string object_id;
+    std::vector<char> data;
+};
+
+enum class StripeWriteResult {
+    WRITTEN,            // Every object is stored and the parity is up to date
+    NOT_APPLICABLE,     // Nothing was written; fall back to individual puts
+    FAILED              // Writing failed; no object is stored
+};
+
+class FullStripeWriter {
+private:
+    std::shared_ptr<const HATopology> group;
+    int ha_group_id;
+    std::vector<int> members;
+
+    /**
+     * @brief Recomputes the parity of a stripe range from the members' data. Used
+     *        when a full-stripe write failed part way.
+     */
+    bool recomputeParity(size_t offset, size_t extent) {
+        BlockBuffer parity;
+        BlockBuffer buffer;
+        for (size_t i = 0; i < members.size(); i++) {
+            std::shared_ptr<RawFile> data_file = io::openShared(utils::getDataPath(members[i]));
+            char* target = i == 0 ? parity.data() : buffer.data();
+            if (!data_file || !data_file->readFull(target, extent, offset)) return false;
+            if (i > 0) {
+                utils::xorInto(parity.data(), buffer.data(), extent);
+            }
+        }
+        return writeParity(offset, parity.data(), extent);
+    }
+
+    /**
+     * @brief Rolls back a full-stripe write that failed part way: frees the block in
+     *        the members that committed it and makes the parity match the data
+     *        left in the stripe. The member locks must be held.
+     */
+    void rollBack(int block_num, const std::vector<char>& committed, size_t extent) {
+        for (size_t i = 0; i < members.size(); i++) {
+            StorePut store_put(members[i]);
+            if (committed[i] && !store_put.discardAt(block_num)) {
+                std::cerr << "Failed to free block " << block_num << " of store "
+                          << members[i] << std::endl;
+            }
+        }
+        if (!recomputeParity(static_cast<size_t>(block_num) * BLOCK_SIZE, extent)) {
+            std::cerr << "Failed to recompute parity for block " << block_num << std::endl;
+        }
+    }
+
+    /**
+     * @brief Writes a parity range under the parity file lock, after replaying the
+     *        journals of crashed buffering writers so they cannot overwrite it later.
+     */
+    bool writeParity(size_t offset, const char* parity, size_t length) {
+        std::string parity_path = utils::getHAPath(ha_group_id) + PARITY_FILENAME;
+        FileLock lock(parity_path);
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        if (!lock.locked() || !parity_file) {
+            return false;
+        }
+        journal::replayOrphans(ha_group_id);
+
+        IOGrant grant(IOClass::FOREGROUND_WRITE, length);
+        return parity_file->writeAt(parity, length, offset) &&
+               parity_file->sync(io::commitDurability());
+    }
+
+    /**
+     * @brief Reloads the group's topology (a cheap check while it is unchanged), so
+     *        each stripe sees members destroyed since the writer was created.
+     *
+     * @return true if the group still has the same members, all of them healthy.
+     */
+    bool refreshTopology() {
+        std::shared_ptr<const HATopology> current = topology::load(ha_group_id);
+        if (!current || current->members() != members) {
+            return false;
+        }
+        group = std::move(current);
+        return group->destroyedCount() == 0;
+    }
+
+public:
+    explicit FullStripeWriter(std::shared_ptr<const HATopology> topology)
+        : group(std::move(topology)), ha_group_id(group->groupId()), members(group->members()) {}
+
+    /**
+     * @brief Number of objects that make up a full stripe.
+     */
+    size_t width() const { return members.size(); }
+
+    /**
+     * @brief Finds the first block index that is free in each of the first `count`
+     *        members. Only a hint unless the caller holds their store locks.
+     *
+     * @return The block index, or -1 if there is none.
+     */
+    int commonFreeBlock(size_t count) const {
+        std::vector<bool> common(NUM_BLOCKS, true);
+        for (size_t m = 0; m < std::min(count, members.size()); m++) {
+            StorePut store_put(members[m]);
+            std::vector<bool> free_blocks = store_put.freeBlockMap();
+            if (free_blocks.empty()) {
+                return -1;
+            }
+            for (size_t i = 0; i < NUM_BLOCKS; i++) {
+                common[i] = common[i] && free_blocks[i];
+            }
+        }
+        auto found = std::find(common.begin(), common.end(), true);
+        return found == common.end() ? -1 : static_cast<int>(found - common.begin());
+    }
+
+    /**
+     * @brief Writes one object to every member at a common free block index.
+     *        objects[i] goes to members[i]. The member writes run in parallel.
+     *
+     * @param objects Exactly width() objects of at most BLOCK_SIZE bytes each.
+     *
+     * @return NOT_APPLICABLE if a member is destroyed or no block index is free in
+     *         every member; otherwise whether the write succeeded. A failed write
+     *         is rolled back in every member, so it can be retried as a whole.
+     */
+    StripeWriteResult write(const std::vector<StripeObject>& objects) {
+        if (objects.size() != members.size() || !refreshTopology()) {
+            return StripeWriteResult::NOT_APPLICABLE;
+        }
+
+        // Buffered deltas of this process must not land on top of the new parity
+        if (!ParityBuffer::flushAll()) {
+            return StripeWriteResult::NOT_APPLICABLE;
+        }
+
+        // Lock every member, in ascending ID order so writers cannot deadlock
+        std::vector<int> lock_order = members;
+        std::sort(lock_order.begin(), lock_order.end());
+        std::vector<std::unique_ptr<FileLock>> locks;
+        for (int store_id : lock_order) {
+            locks.push_back(std::make_unique<FileLock>(utils::getStorePath(store_id)));
+        }
+        if (!refreshTopology()) {   // A member may have been destroyed meanwhile
+            return StripeWriteResult::NOT_APPLICABLE;
+        }
+
+        int block_num = commonFreeBlock(members.size());
+        if (block_num == -1) {
+            return StripeWriteResult::NOT_APPLICABLE;
+        }
+
+        // Parity of the stripe straight from the new data
+        size_t extent = 0;
+        for (const StripeObject& object : objects) {
+            if (object.data.size() > BLOCK_SIZE) {
+                return StripeWriteResult::NOT_APPLICABLE;
+            }
+            extent = std::max(extent, object.data.size());
+        }
+        BlockBuffer parity;
+        std::memset(parity.data(), 0, extent);
+        for (const StripeObject& object : objects) {
+            utils::xorInto(parity.data(), object.data.data(), object.data.size());
+        }
+
+        std::vector<char> committed(members.size(), false);
+        bool written = Executor::shared().parallelFor(members.size(), 1,
+                                                      [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                StorePut store_put(members[i]);
+                if (!store_put.writeAt(block_num, objects[i].object_id, objects[i].data, extent)) {
+                    return false;
+                }
+                committed[i] = true;
+            }
+            return true;
+        });
+
+        size_t offset = static_cast<size_t>(block_num) * BLOCK_SIZE;
+        if (!written) {
+            rollBack(block_num, committed, extent);
+            return StripeWriteResult::FAILED;
+        }
+        if (!writeParity(offset, parity.data(), extent)) {
+            std::cerr << "Failed to write parity for block " << block_num << std::endl;
+            rollBack(block_num, committed, extent);
+            return StripeWriteResult::FAILED;
+        }
+
+        locks.clear();
+        for (int store_id : members) {
+            StorePut store_put(store_id);
+            if (!store_put.syncReplica()) {
+                std::cerr << "Warning: Failed to sync replica of store " << store_id << std::endl;
+            }
+        }
+        return StripeWriteResult::WRITTEN;
+    }
+};
@@ -10,271 +10,132 @@
  * @copyright Copyright (c) 2024
  */
 #include <iostream>
-#include <fstream>
-#include <algorithm>
+#include <sstream>
+#include <future>
 #include "hearty-store-common.hpp"
+#include "hearty-store-get.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-stripe.hpp"
 
-class StoreGet {
-private:
-    int store_id;
-    StoreMetadata store_metadata;
-    std::vector<BlockMetadata> block_metadata;
-
-    /**
-     * @brief Load metadata for the store, including store and block metadata.
-     * 
-     * @return true     - Metadata loaded successfully.
-     * @return false    - Failed to load metadata.
-     */
-    bool loadMetadata() {
-        std::ifstream file(utils::getMetadataPath(store_id), std::ios::binary);
-        if (!file) {
-            std::cerr << "Failed to open metadata file" << std::endl;
-            return false;
-        }
-
-        file.read(reinterpret_cast<char*>(&store_metadata), sizeof(StoreMetadata));
-        
-        block_metadata.resize(NUM_BLOCKS);
-        for (auto& block : block_metadata) {
-            file.read(reinterpret_cast<char*>(&block), sizeof(BlockMetadata));
-        }
-
-        return true;
+/**
+ * @brief Parse a byte range given as "offset:length" (length may be omitted).
+ * 
+ * @param spec          - Range specification from the command line.
+ * @param offset        - Parsed start of the range.
+ * @param length        - Parsed length, or WHOLE_OBJECT if omitted.
+ * @return true         - The specification is well-formed.
+ * @return false        - The specification is malformed.
+ */
+bool parseRange(const std::string& spec, size_t& offset, size_t& length) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos || colon == 0) {
+        return false;
     }
-
-    /**
-     * @brief Locate the block containing the specified object ID.
-     * 
-     * @param object_id     - Target object ID to find in the store.
-     * @return int          - Index of the block if found; -1 if not found.
-     */
-    int findBlockByObjectId(const std::string& object_id) {
-        for (size_t i = 0; i < NUM_BLOCKS; i++) {
-            if (block_metadata[i].is_used && block_metadata[i].object_id == object_id) {
-                return i;
-            }
-        }
-        return -1;
+    try {
+        offset = std::stoull(spec.substr(0, colon));
+        length = colon + 1 == spec.size() ? WHOLE_OBJECT : std::stoull(spec.substr(colon + 1));
+    } catch (const std::exception&) {
+        return false;
     }
+    return spec.find('-') == std::string::npos;
+}
 
-    // readFromReplica
-    /**
-     * @brief Attempt to read an object's data from a replica store.
-     * 
-     * @param object_id     - ID of the object to retrieve from the replica.
-     * @param out           - Output stream to write the object's data.
-     * @return true         - Successfully read the object from a replica.
-     * @return false        - Failed to read the object or no replica available.
-     */
-    bool readFromReplica(const std::string& object_id, std::ostream& out) {
-        if (store_metadata.replica_of == -1 && !store_metadata.is_replica) {
-            return false;
-        }
-
-        // Get replica store ID
-        int replica_id = store_metadata.is_replica ? 
-                        store_metadata.replica_of : 
-                        store_metadata.store_id;
-
-        // Load replica's metadata
-        StoreMetadata replica_metadata;
-        std::ifstream replica_meta(utils::getMetadataPath(replica_id), std::ios::binary);
-        if (!replica_meta) {
-            return false;
-        }
-        replica_meta.read(reinterpret_cast<char*>(&replica_metadata), sizeof(StoreMetadata));
-
-        // Read block metadata to find object
-        std::vector<BlockMetadata> block_metadata(NUM_BLOCKS);
-        for (auto& block : block_metadata) {
-            replica_meta.read(reinterpret_cast<char*>(&block), sizeof(BlockMetadata));
-        }
-
-        // Find block containing object
-        int block_num = -1;
-        for (size_t i = 0; i < NUM_BLOCKS; i++) {
-            if (block_metadata[i].is_used && block_metadata[i].object_id == object_id) {
-                block_num = i;
-                break;
-            }
-        }
-
-        if (block_num == -1) {
-            return false;
-        }
-
-        // Read data from replica's block
-        std::ifstream replica_data(utils::getDataPath(replica_id), std::ios::binary);
-        if (!replica_data) {
-            return false;
+/**
+ * @brief Retrieve one object, striped or not. Striped objects are only visible in
+ *        the live store, not in snapshots.
+ * 
+ * @param store_id      - Store to read from.
+ * @param snapshot_id   - Snapshot to read from, or -1 for the live store.
+ * @param object_id     - ID of the object to retrieve.
+ * @param out           - Output stream to write the object's data.
+ * @param offset        - Start of the byte range within the object.
+ * @param length        - Length of the byte range.
+ * @return true         - The object was retrieved.
+ * @return false        - The object could not be retrieved.
+ */
+bool getObject(int store_id, int snapshot_id, const std::string& object_id,
+               std::ostream& out, size_t offset, size_t length) {
+    if (snapshot_id == -1) {
+        StoreStripe stripe(store_id);
+        if (stripe.load() && stripe.isStriped(object_id)) {
+            return stripe.get(object_id, out, offset, length);
         }
-
-        replica_data.seekg(block_num * BLOCK_SIZE);
-        std::vector<char> buffer(block_metadata[block_num].data_size);
-        replica_data.read(buffer.data(), block_metadata[block_num].data_size);
-
-        // Write to output stream
-        out.write(buffer.data(), block_metadata[block_num].data_size);
-
-        return true;
     }
 
-    /**
-     * @brief Reconstruct a block's data using parity and data from surviving stores.
-     * 
-     * @param block_num     - Block number to reconstruct.
-     * @param out           - Output stream to write the reconstructed data.
-     * @return true         - Successfully reconstructed the block.
-     * @return false        - Failed to reconstruct the block.
-     */
-    bool reconstructFromParity(int block_num, std::ostream& out) {
-        if (store_metadata.ha_group_id == -1) {
-            return false;
-        }
-
-        // Read HA group status
-        std::string ha_status_path = utils::getHAPath(store_metadata.ha_group_id);
-        std::ifstream status_file(ha_status_path, std::ios::binary);
-        if (!status_file) {
-            return false;
-        }
-
-        HAGroupStatus ha_status;
-        status_file.read(reinterpret_cast<char*>(&ha_status), sizeof(HAGroupStatus));
-
-        // Prepare buffers
-        std::vector<char> data_buffer(BLOCK_SIZE, 0);
-        std::vector<char> block_buffer(BLOCK_SIZE);
-
-        // Read parity block
-        std::string parity_path = ha_status_path + PARITY_FILENAME;
-        std::ifstream parity_file(parity_path, std::ios::binary);
-        if (!parity_file) {
-            return false;
-        }
-
-        parity_file.seekg(block_num * BLOCK_SIZE);
-        parity_file.read(data_buffer.data(), BLOCK_SIZE);
-
-        // XOR with blocks from surviving stores
-        for (int store_id : ha_status.store_ids) {
-            if (store_id == store_metadata.store_id) continue; // Skip current store
-
-            // Check if store is active
-            std::string store_meta_path = utils::getMetadataPath(store_id);
-            std::ifstream store_meta(store_meta_path, std::ios::binary);
-            if (!store_meta) continue;
-
-            StoreMetadata other_meta;
-            store_meta.read(reinterpret_cast<char*>(&other_meta), sizeof(StoreMetadata));
-            if (other_meta.is_destroyed) continue;
-
-            // Read block from this store
-            std::ifstream store_file(utils::getDataPath(store_id), std::ios::binary);
-            if (!store_file) continue;
-
-            store_file.seekg(block_num * BLOCK_SIZE);
-            store_file.read(block_buffer.data(), BLOCK_SIZE);
-
-            // XOR into data buffer
-            for (size_t i = 0; i < BLOCK_SIZE; i++) {
-                data_buffer[i] ^= block_buffer[i];
-            }
-        }
-
-        // Write reconstructed data
-        out.write(data_buffer.data(), BLOCK_SIZE);
+    StoreGet store_get(store_id, snapshot_id);
+    return store_get.get(object_id, out, offset, length);
+}
 
-        return true;
+/**
+ * @brief Retrieve several objects in parallel, one task per object on the shared
+ *        executor, and write them to the output in the order they were requested.
+ * 
+ * @param store_id      - Store to read from.
+ * @param snapshot_id   - Snapshot to read from, or -1 for the live store.
+ * @param object_ids    - IDs of the objects to retrieve.
+ * @param out           - Output stream to write the objects' data.
+ * @param offset        - Start of the byte range within each object.
+ * @param length        - Length of the byte range.
+ * @return true         - All objects were retrieved.
+ * @return false        - At least one object could not be retrieved.
+ */
+bool getMany(int store_id, int snapshot_id, const std::vector<std::string>& object_ids,
+             std::ostream& out, size_t offset, size_t length) {
+    std::vector<std::future<std::pair<bool, std::string>>> results;
+    for (const std::string& object_id : object_ids) {
+        results.push_back(Executor::shared().submit([=] {
+            std::ostringstream buffer;
+            bool ok = getObject(store_id, snapshot_id, object_id, buffer, offset, length);
+            return std::make_pair(ok, buffer.str());
+        }));
     }
 
-    /**
-     * @brief Read a block's data from the store and output it.
-     * 
-     * @param block_num     - Block number to read.
-     * @param out           - Output stream to write the block's data.
-     * @return true         - Successfully read the block.
-     * @return false        - Failed to read the block.
-     */
-    bool readBlock(int block_num, std::ostream& out) {
-        std::ifstream data_file(utils::getDataPath(store_id), std::ios::binary);
-        if (!data_file) {
-            std::cerr << "Failed to open data file" << std::endl;
-            return false;
-        }
-
-        // Seek to the correct block
-        data_file.seekg(block_num * BLOCK_SIZE);
-
-        // Read only the actual data size, not the entire block
-        std::vector<char> buffer(block_metadata[block_num].data_size);
-        data_file.read(buffer.data(), block_metadata[block_num].data_size);
-
-        if (!data_file) {
-            std::cerr << "Failed to read data" << std::endl;
-            return false;
+    bool all_ok = true;
+    for (auto& result : results) {
+        auto [ok, data] = Executor::shared().wait(result);
+        if (ok) {
+            out.write(data.data(), data.size());
         }
-
-        // Write to output stream
-        out.write(buffer.data(), block_metadata[block_num].data_size);
-        return true;
+        all_ok = all_ok && ok;
     }
+    return all_ok;
+}
 
-public:
-    StoreGet(int id) : store_id(id) {}
-    
-    /**
-     * @brief Retrieve an object by its ID from the store or reconstruct it if necessary.
-     * 
-     * @param object_id     - ID of the object to retrieve.
-     * @param out           - Output stream to write the object's data.
-     * @return true         - Successfully retrieved the object.
-     * @return false        - Failed to retrieve the object.
-     */
-    bool get(const std::string& object_id, std::ostream& out) {
-        if (!loadMetadata()) {
-            return false;
-        }
-
-        // Check if store is destroyed
-        if (store_metadata.is_destroyed) {
-            // Try to reconstruct from parity or read from replica
-            int block_num = findBlockByObjectId(object_id);
-            if (block_num != -1) {
-                if (reconstructFromParity(block_num, out)) {
-                    return true;
-                }
-                if (readFromReplica(object_id, out)) {
-                    return true;
-                }
-            }
-            std::cerr << "Store is destroyed and reconstruction failed" << std::endl;
-            return false;
-        }
-
-        // Find the block containing our object
-        int block_num = findBlockByObjectId(object_id);
-        if (block_num == -1) {
-            std::cerr << "Object not found: " << object_id << std::endl;
-            return false;
-        }
-
-        // Read and output the data
-        return readBlock(block_num, out);
+int main(int argc, char* argv[]) {
+    // Object IDs come first, followed by options
+    int first_option = 2;
+    while (first_option < argc && std::string(argv[first_option]).rfind("--", 0) != 0) {
+        first_option++;
     }
-};
 
-int main(int argc, char* argv[]) {
     // Check command usages 
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " [store-id] [object-id]" << std::endl;
+    if (first_option == 2 || (argc - first_option) % 2 != 0) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] [object-id...]" 
+                  << " [--range offset:length] [--snapshot snapshot-id]" << std::endl;
         return 1;
     }
 
     try {
         int store_id = std::stoi(argv[1]);
-        std::string object_id = argv[2];
+        std::vector<std::string> object_ids(argv + 2, argv + first_option);
+
+        size_t offset = 0;
+        size_t length = WHOLE_OBJECT;
+        int snapshot_id = -1;
+        for (int i = first_option; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (option == "--range") {
+                if (!parseRange(argv[i + 1], offset, length)) {
+                    std::cerr << "Invalid range format (expected offset:length)" << std::endl;
+                    return 1;
+                }
+            } else if (option == "--snapshot") {
+                snapshot_id = std::stoi(argv[i + 1]);
+            } else {
+                std::cerr << "Unknown option: " << option << std::endl;
+                return 1;
+            }
+        }
 
         // Check if store exists
         if (!std::filesystem::exists(utils::getStorePath(store_id))) {
@@ -282,16 +143,23 @@ int main(int argc, char* argv[]) {
             return 1;
         }
 
-        StoreGet store_get(store_id);
-        if (!store_get.get(object_id, std::cout)) {
+        if (object_ids.size() > 1) {
+            if (!getMany(store_id, snapshot_id, object_ids, std::cout, offset, length)) {
+                return 1;
+            }
+            std::cerr << "Successfully get " << object_ids.size() << " objects" << std::endl;
+            return 0;
+        }
+
+        if (!getObject(store_id, snapshot_id, object_ids[0], std::cout, offset, length)) {
             return 1;
         }
 
-        std::cerr << "Successfully get the object " << object_id << std::endl;
+        std::cerr << "Successfully get the object " << object_ids[0] << std::endl;
         return 0;
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,421 @@
+/**
+ * @file hearty-store-get.hpp
+ * @author Nathadon Samairat
+ * @brief StoreGet reads objects (or byte ranges of them) from a store, falling back
+ *        to parity reconstruction or the replica when the store is destroyed. Blocks
+ *        of a destroyed HA member that a rebuild has already moved to a hot spare
+ *        are read from the spare.
+ *        Shared by hearty-store-get and the tools that read objects from stores.
+ * @version 0.1
+ * @date 2024-11-27
+ * 
+ * @copyright Copyright (c) 2024
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <sstream>
+#include <memory>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-metadata.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-hedge.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-parity-buffer.hpp"
+#include "hearty-store-topology.hpp"
+
+// Length value meaning "read through the end of the object"
+const size_t WHOLE_OBJECT = std::numeric_limits<size_t>::max();
+
+class StoreGet {
+private:
+    int store_id;
+    int snapshot_id;
+    StoreMetadata store_metadata;
+    std::unique_ptr<MetadataReader> metadata;
+    BlockMetadata object_block;     // Metadata of the block holding the object
+
+    /**
+     * @brief Open the store's metadata, reading only its header. Block records are
+     *        read on demand a page at a time, so opening a store costs the same
+     *        whatever its size. When reading from a snapshot, the snapshot's copy of
+     *        the metadata is used; its blocks are shared with (and pinned in) the
+     *        live data file.
+     * 
+     * @return true     - Metadata opened successfully.
+     * @return false    - Failed to open metadata.
+     */
+    bool loadMetadata() {
+        if (snapshot_id == -1) {
+            metadata = std::make_unique<MetadataReader>(utils::getMetadataPath(store_id), store_id);
+        } else {
+            metadata = std::make_unique<MetadataReader>(
+                utils::getSnapshotPath(store_id, snapshot_id) + META_FILENAME, -1);
+        }
+        if (!metadata->open()) {
+            std::cerr << "Failed to read metadata file" << std::endl;
+            return false;
+        }
+        store_metadata = metadata->store();
+        return true;
+    }
+
+    /**
+     * @brief Locate the block containing the specified object ID, through the
+     *        store's ID index, and keep its metadata.
+     * 
+     * @param object_id     - Target object ID to find in the store.
+     * @return int          - Index of the block if found; -1 if not found.
+     */
+    int findBlockByObjectId(const std::string& object_id) {
+        return metadata->find(object_id, object_block);
+    }
+
+    /**
+     * @brief Clamp a requested byte range to the extent of an object.
+     * 
+     * @param block         - Metadata of the block holding the object.
+     * @param offset        - Start of the range within the object.
+     * @param length        - Requested length; shortened to the object's end.
+     * @return true         - The range starts inside (or at the end of) the object.
+     * @return false        - The range starts past the end of the object.
+     */
+    static bool clampRange(const BlockMetadata& block, size_t offset, size_t& length) {
+        if (offset > block.data_size) {
+            std::cerr << "Range offset " << offset << " is past the end of the object ("
+                      << block.data_size << " bytes)" << std::endl;
+            return false;
+        }
+        length = std::min(length, block.data_size - offset);
+        return true;
+    }
+
+    // readFromReplica
+    /**
+     * @brief Attempt to read an object's data from a replica store.
+     * 
+     * @param object_id     - ID of the object to retrieve from the replica.
+     * @param out           - Output stream to write the object's data.
+     * @param offset        - Start of the byte range within the object.
+     * @param length        - Length of the byte range.
+     * @return true         - Successfully read the object from a replica.
+     * @return false        - Failed to read the object or no replica available.
+     */
+    bool readFromReplica(const std::string& object_id, std::ostream& out,
+                         size_t offset, size_t length) {
+        if (store_metadata.replica_of == -1 && !store_metadata.is_replica) {
+            return false;
+        }
+
+        // Get the other store of the pair
+        int replica_id = store_metadata.replica_of;
+
+        // Find the block containing the object through the replica's ID index
+        MetadataReader replica_metadata(utils::getMetadataPath(replica_id), replica_id);
+        BlockMetadata replica_block;
+        if (!replica_metadata.open()) {
+            return false;
+        }
+        int block_num = replica_metadata.find(object_id, replica_block);
+        if (block_num == -1 || !clampRange(replica_block, offset, length)) {
+            return false;
+        }
+
+        // Read only the requested range from replica's block
+        std::shared_ptr<RawFile> replica_data = io::openShared(utils::getDataPath(replica_id));
+        if (!replica_data) {
+            return false;
+        }
+
+        IOGrant grant(IOClass::FOREGROUND_READ, length);
+        BlockBuffer buffer;
+        if (!replica_data->readFull(buffer.data(), length, block_num * BLOCK_SIZE + offset)) {
+            return false;
+        }
+
+        // Write to output stream
+        out.write(buffer.data(), length);
+
+        return true;
+    }
+
+    /**
+     * @brief Reconstruct a block's data using parity and data from surviving stores.
+     * 
+     * Only the requested byte range of the parity block and of each surviving
+     * block is read, so a small range costs a small read per member.
+     * 
+     * @param block_num     - Block number to reconstruct.
+     * @param out           - Output stream to write the reconstructed data.
+     * @param offset        - Start of the byte range within the object.
+     * @param length        - Length of the byte range.
+     * @param cancelled     - If given, the reconstruction gives up once it is set.
+     * @return true         - Successfully reconstructed the block.
+     * @return false        - Failed (or gave up) to reconstruct the block.
+     */
+    bool reconstructFromParity(int block_num, std::ostream& out,
+                               size_t offset, size_t length,
+                               const std::atomic<bool>* cancelled = nullptr) {
+        if (store_metadata.ha_group_id == -1) {
+            return false;
+        }
+
+        // Members and their health, from the group's cached topology
+        std::shared_ptr<const HATopology> group = topology::load(store_metadata.ha_group_id);
+        if (!group) {
+            return false;
+        }
+
+        if (!clampRange(object_block, offset, length)) {
+            return false;
+        }
+        size_t range_start = block_num * BLOCK_SIZE + offset;
+
+        // Pooled buffers; the parity read fills the data buffer
+        BlockBuffer data_buffer;
+        BlockBuffer block_buffer;
+
+        // Read parity range
+        std::string parity_path = group->parityPath();
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        if (!parity_file) {
+            return false;
+        }
+
+        {
+            // Parity as of now: replay journals of crashed writers and overlay
+            // the deltas that live writers still hold in their buffers
+            FileLock parity_lock(parity_path);
+            journal::replayOrphans(store_metadata.ha_group_id);
+
+            IOGrant grant(IOClass::FOREGROUND_READ, length);
+            if (!parity_file->readFull(data_buffer.data(), length, range_start)) {
+                return false;
+            }
+            journal::overlayPending(store_metadata.ha_group_id, range_start, data_buffer.data(), length);
+        }
+
+        // XOR with blocks from surviving stores
+        for (int store_id : group->members()) {
+            if (store_id == store_metadata.store_id) continue; // Skip current store
+            if (cancelled != nullptr && *cancelled) return false;
+
+            // A destroyed member counts only once its block is rebuilt on a spare;
+            // without it the block cannot be reconstructed
+            std::string data_path = utils::memberDataPath(group->groupId(), store_id,
+                                                          group->isDestroyed(store_id), block_num);
+            if (data_path.empty()) return false;
+
+            // Beyond its written extent the member's block is zero and adds nothing
+            BlockMetadata other_block;
+            if (!utils::loadBlockMetadata(store_id, block_num, other_block)) continue;
+            size_t extent = std::min(other_block.extent, BLOCK_SIZE);
+            if (extent <= offset) continue;
+            size_t span = std::min(length, extent - offset);
+
+            // Read the same range from this store
+            std::shared_ptr<RawFile> store_file = io::openShared(data_path);
+            if (!store_file) continue;
+
+            IOGrant grant(IOClass::FOREGROUND_READ, span);
+            if (!store_file->readFull(block_buffer.data(), span, range_start)) {
+                return false;
+            }
+
+            // XOR into data buffer
+            utils::xorInto(data_buffer.data(), block_buffer.data(), span);
+        }
+
+        // Write reconstructed data
+        out.write(data_buffer.data(), length);
+
+        return true;
+    }
+
+    /**
+     * @brief Read a block's data from a store and output it. Static, so it can run
+     *        as a hedged primary read that outlives the StoreGet.
+     * 
+     * @param data_path     - Data file holding the block.
+     * @param block_num     - Block number to read.
+     * @param block         - Metadata of the block.
+     * @param out           - Output stream to write the block's data.
+     * @param offset        - Start of the byte range within the object.
+     * @param length        - Length of the byte range.
+     * @return true         - Successfully read the block.
+     * @return false        - Failed to read the block.
+     */
+    static bool readBlock(const std::string& data_path, int block_num, const BlockMetadata& block,
+                          std::ostream& out, size_t offset, size_t length) {
+        if (!clampRange(block, offset, length)) {
+            return false;
+        }
+
+        std::shared_ptr<RawFile> data_file = io::openShared(data_path);
+        if (!data_file) {
+            std::cerr << "Failed to open data file" << std::endl;
+            return false;
+        }
+
+        // Read only the covering bytes, not the entire block
+        BlockBuffer buffer;
+        bool read_ok;
+        {
+            IOGrant grant(IOClass::FOREGROUND_READ, length);
+            read_ok = data_file->readFull(buffer.data(), length, block_num * BLOCK_SIZE + offset);
+        }
+
+        if (!read_ok) {
+            std::cerr << "Failed to read data" << std::endl;
+            return false;
+        }
+
+        // Verify the checksum when the whole object was read
+        if (offset == 0 && length == block.data_size &&
+            utils::crc32(0, buffer.data(), length) != block.checksum) {
+            std::cerr << "Checksum mismatch for block " << block_num << std::endl;
+            return false;
+        }
+
+        // Write to output stream
+        out.write(buffer.data(), length);
+        return true;
+    }
+
+    /**
+     * @brief Reconstruct a block from parity into memory and, when the whole object
+     *        was asked for, check it against the block's checksum before writing it
+     *        out (the members are read without their locks, as readBlock's CRC
+     *        check guards the healthy path).
+     * 
+     * @return true         - The block was reconstructed (and its checksum matches).
+     * @return false        - Reconstruction failed or produced corrupt data.
+     */
+    bool reconstructVerified(int block_num, std::ostream& out, size_t offset, size_t length) {
+        std::ostringstream buffer;
+        if (!reconstructFromParity(block_num, buffer, offset, length)) {
+            return false;
+        }
+        std::string data = buffer.str();
+        if (offset == 0 && length >= object_block.data_size &&
+            utils::crc32(0, data.data(), data.size()) != object_block.checksum) {
+            std::cerr << "Checksum mismatch for block " << block_num
+                      << " reconstructed from parity" << std::endl;
+            return false;
+        }
+        out.write(data.data(), data.size());
+        return true;
+    }
+
+    /**
+     * @brief Read a block of the live store, hedged: if the read is slower than the
+     *        hedge percentile, the replica or (for a whole object) a parity
+     *        reconstruction races it. Neither takes the other stores' locks, so a
+     *        whole object from the backup is only used if its checksum matches;
+     *        otherwise the primary's result is awaited.
+     * 
+     * @param object_id     - ID of the object in the block.
+     * @param block_num     - Block number to read.
+     * @param out           - Output stream to write the block's data.
+     * @param offset        - Start of the byte range within the object.
+     * @param length        - Length of the byte range.
+     * @return true         - One of the reads succeeded.
+     * @return false        - Every read failed.
+     */
+    bool hedgedRead(const std::string& object_id, int block_num, std::ostream& out,
+                    size_t offset, size_t length) {
+        std::string data_path = utils::getDataPath(store_id);
+        BlockMetadata block = object_block;
+        auto primary = [data_path, block_num, block, offset, length](const std::atomic<bool>&) {
+            std::ostringstream buffer;
+            bool ok = readBlock(data_path, block_num, block, buffer, offset, length);
+            return ReadResult{ok, buffer.str()};
+        };
+        bool whole = offset == 0 && length >= block.data_size;
+        auto backup = [&](const std::atomic<bool>& cancelled) {
+            std::ostringstream buffer;
+            bool ok = readFromReplica(object_id, buffer, offset, length) ||
+                      (whole && !cancelled &&
+                       reconstructFromParity(block_num, buffer, offset, length, &cancelled));
+            std::string data = buffer.str();
+            if (ok && whole && utils::crc32(0, data.data(), data.size()) != block.checksum) {
+                std::cerr << "Checksum mismatch in backup read of block " << block_num << std::endl;
+                ok = false;
+            } else if (!ok && !cancelled) {
+                std::cerr << "Backup read of block " << block_num << " failed" << std::endl;
+            }
+            return ReadResult{ok, data};
+        };
+
+        ReadResult result = HedgePolicy::shared().read(primary, backup);
+        if (result.first) {
+            out.write(result.second.data(), result.second.size());
+        }
+        return result.first;
+    }
+
+public:
+    StoreGet(int id, int snapshot = -1) : store_id(id), snapshot_id(snapshot) {}
+    
+    /**
+     * @brief Retrieve an object by its ID from the store or reconstruct it if necessary.
+     * 
+     * @param object_id     - ID of the object to retrieve.
+     * @param out           - Output stream to write the object's data.
+     * @param offset        - Start of the byte range to retrieve (default: 0).
+     * @param length        - Length of the byte range (default: whole object).
+     * @return true         - Successfully retrieved the object.
+     * @return false        - Failed to retrieve the object.
+     */
+    bool get(const std::string& object_id, std::ostream& out,
+             size_t offset = 0, size_t length = WHOLE_OBJECT) {
+        if (!loadMetadata()) {
+            return false;
+        }
+
+        // Check if store is destroyed
+        if (store_metadata.is_destroyed) {
+            // Read the rebuilt block from the hot spare, else reconstruct from
+            // parity or read from replica
+            int block_num = findBlockByObjectId(object_id);
+            if (block_num != -1) {
+                std::string spare_path = utils::memberDataPath(store_metadata, block_num);
+                if (!spare_path.empty() &&
+                    readBlock(spare_path, block_num, object_block, out, offset, length)) {
+                    return true;
+                }
+                if (reconstructVerified(block_num, out, offset, length)) {
+                    return true;
+                }
+                if (readFromReplica(object_id, out, offset, length)) {
+                    return true;
+                }
+            }
+            std::cerr << "Store is destroyed and reconstruction failed" << std::endl;
+            return false;
+        }
+
+        // Find the block containing our object
+        int block_num = findBlockByObjectId(object_id);
+        if (block_num == -1) {
+            std::cerr << "Object not found: " << object_id << std::endl;
+            return false;
+        }
+
+        // Read and output the data, hedged when there is another copy to race: a
+        // replica, or the group parity for a whole object (whose checksum is known)
+        bool whole = offset == 0 && length >= object_block.data_size;
+        bool redundant = store_metadata.replica_of != -1 ||
+                         (store_metadata.ha_group_id != -1 && whole);
+        if (snapshot_id == -1 && redundant && HedgePolicy::shared().enabled()) {
+            return hedgedRead(object_id, block_num, out, offset, length);
+        }
+        return readBlock(utils::getDataPath(store_id), block_num, object_block,
+                         out, offset, length);
+    }
+};
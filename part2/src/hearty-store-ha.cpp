@@ -14,9 +14,16 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <algorithm>
+#include <filesystem>
 #include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-topology.hpp"
 
-std::vector<std::vector<int>> ha_group_counts(NUM_BLOCKS, std::vector<int>(NUM_BLOCKS, 0));
+const size_t PARITY_STRIPE_GRAIN = 16;  // Blocks (stripes) computed per task
 
 class StoreHA {
 private:
@@ -44,7 +51,9 @@ private:
      * @return true if metadata is successfully saved; false otherwise.
      */
     bool saveStoreMetadata(int store_id, const StoreMetadata& metadata) {
-        std::ofstream file(utils::getMetadataPath(store_id), std::ios::binary | std::ios::trunc);
+        // Overwrite only the store header so block metadata is preserved
+        std::fstream file(utils::getMetadataPath(store_id), 
+                          std::ios::binary | std::ios::in | std::ios::out);
         if (!file) return false;
         file.write(reinterpret_cast<const char*>(&metadata), sizeof(StoreMetadata));
         return true;
@@ -53,26 +62,104 @@ private:
     /**
      * @brief Creates a parity file for an HA group.
      * 
+     * The file is created all zero (sparse), which is already the parity of every
+     * stripe that no member has written to.
+     * 
      * @param parity_path Path to the parity file.
      * 
      * @return true if the parity file is successfully created; false otherwise.
      */
     bool createParityFile(const std::string& parity_path) {
-        std::ofstream parity(parity_path, std::ios::binary);
-        if (!parity) return false;
+        {
+            std::ofstream parity(parity_path, std::ios::binary | std::ios::trunc);
+            if (!parity) return false;
+        }
+        std::filesystem::resize_file(parity_path, NUM_BLOCKS * BLOCK_SIZE);
+        return true;
+    }
 
-        // Initialize parity file with zeros
-        std::vector<char> zeros(BLOCK_SIZE, 0);
-        for (size_t i = 0; i < NUM_BLOCKS; i++) {
-            if (!parity.write(zeros.data(), BLOCK_SIZE)) {
+    /**
+     * @brief Computes, for every stripe, the largest high-water extent of the
+     *        members' blocks. Beyond it every member's block is zero, and so is
+     *        the parity.
+     * 
+     * @param store_ids List of store IDs in the group.
+     * @param extents Receives one extent per stripe.
+     * 
+     * @return true if the metadata of every store is read; false otherwise.
+     */
+    bool loadStripeExtents(const std::vector<int>& store_ids, std::vector<size_t>& extents) {
+        extents.assign(NUM_BLOCKS, 0);
+        std::vector<BlockMetadata> blocks(NUM_BLOCKS);
+        for (int store_id : store_ids) {
+            RawFile file(utils::getMetadataPath(store_id), O_RDONLY);
+            if (!file.isOpen() ||
+                !file.readFull(reinterpret_cast<char*>(blocks.data()),
+                               NUM_BLOCKS * sizeof(BlockMetadata), sizeof(StoreMetadata))) {
                 return false;
             }
+            for (size_t i = 0; i < NUM_BLOCKS; i++) {
+                extents[i] = std::max(extents[i], std::min(blocks[i].extent, BLOCK_SIZE));
+            }
         }
         return true;
     }
 
+    /**
+     * @brief Computes the parity of a range of stripes (block indexes).
+     *        Only the first `extents[block]` bytes of each stripe are read and
+     *        written; stripes no member has written to are skipped.
+     * 
+     * @param store_ids List of store IDs to include in the parity computation.
+     * @param parity_path Path to the parity file.
+     * @param extents Written extent of every stripe.
+     * @param begin First block of the range.
+     * @param end One past the last block of the range.
+     * 
+     * @return true if the parity of the range is successfully written; false otherwise.
+     */
+    bool updateParityRange(const std::vector<int>& store_ids, const std::string& parity_path,
+                           const std::vector<size_t>& extents, size_t begin, size_t end) {
+        // Descriptors are opened once per process and shared by all ranges
+        std::vector<std::shared_ptr<RawFile>> store_files;
+        for (int store_id : store_ids) {
+            store_files.push_back(io::openShared(utils::getDataPath(store_id)));
+            if (!store_files.back()) return false;
+        }
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        if (!parity_file) return false;
+
+        // Pooled buffers for reading blocks and computing parity
+        BlockBuffer parity_buffer;
+        BlockBuffer block_buffer;
+
+        for (size_t block = begin; block < end; block++) {
+            size_t extent = extents[block];
+            if (extent == 0) continue;  // All zero, as is the new parity file
+
+            // The first store's block seeds the parity; the others are XORed in
+            for (size_t i = 0; i < store_files.size(); i++) {
+                char* target = i == 0 ? parity_buffer.data() : block_buffer.data();
+                IOGrant grant(IOClass::BACKGROUND, extent);
+                if (!store_files[i]->readFull(target, extent, block * BLOCK_SIZE)) {
+                    return false;
+                }
+                if (i > 0) {
+                    utils::xorInto(parity_buffer.data(), block_buffer.data(), extent);
+                }
+            }
+
+            // Write parity block
+            IOGrant grant(IOClass::BACKGROUND, extent);
+            if (!parity_file->writeAt(parity_buffer.data(), extent, block * BLOCK_SIZE)) return false;
+        }
+
+        return true;
+    }
+
     /**
      * @brief Updates the parity file for the given stores in an HA group.
+     *        Stripes are computed in parallel on the shared executor.
      * 
      * @param store_ids List of store IDs to include in the parity computation.
      * 
@@ -82,40 +169,17 @@ private:
         std::string parity_path = BASE_PATH + "/ha_group_" + 
                                  std::to_string(store_ids[0]) + PARITY_FILENAME;
 
-        // Buffers for reading blocks and computing parity
-        std::vector<char> parity_buffer(BLOCK_SIZE, 0);
-        std::vector<char> block_buffer(BLOCK_SIZE);
-
-        // Process each block
-        for (size_t block = 0; block < NUM_BLOCKS; block++) {
-            // Reset parity buffer
-            std::fill(parity_buffer.begin(), parity_buffer.end(), 0);
-
-            // XOR all blocks from all stores
-            for (int store_id : store_ids) {
-                std::ifstream store_file(utils::getDataPath(store_id), std::ios::binary);
-                if (!store_file) return false;
-
-                // Seek to current block
-                store_file.seekg(block * BLOCK_SIZE);
-                store_file.read(block_buffer.data(), BLOCK_SIZE);
-
-                // XOR into parity buffer
-                for (size_t i = 0; i < BLOCK_SIZE; i++) {
-                    parity_buffer[i] ^= block_buffer[i];
-                }
-            }
-
-            // Write parity block
-            std::fstream parity_file(parity_path, 
-                                   std::ios::binary | std::ios::in | std::ios::out);
-            if (!parity_file) return false;
-
-            parity_file.seekp(block * BLOCK_SIZE);
-            parity_file.write(parity_buffer.data(), BLOCK_SIZE);
+        std::vector<size_t> extents;
+        if (!loadStripeExtents(store_ids, extents)) {
+            return false;
         }
 
-        return true;
+        bool computed = Executor::shared().parallelFor(NUM_BLOCKS, PARITY_STRIPE_GRAIN,
+                                                       [&](size_t begin, size_t end) {
+            return updateParityRange(store_ids, parity_path, extents, begin, end);
+        });
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        return computed && parity_file && parity_file->sync(io::commitDurability());
     }
 
     /**
@@ -133,6 +197,10 @@ private:
             std::cerr << "Duplicate store IDs are not allowed" << std::endl;
             return false;
         }
+        if (store_ids.size() > HA_MAX_MEMBERS) {
+            std::cerr << "An HA group holds at most " << HA_MAX_MEMBERS << " stores" << std::endl;
+            return false;
+        }
 
         for (int store_id : store_ids) {
             if (!utils::storeExists(store_id)) {
@@ -201,6 +269,13 @@ public:
             return false;
         }
 
+        // Write the group manifest before any member points at the group
+        HAManifest manifest = topology::makeManifest(store_ids[0], store_ids);
+        if (!topology::save(manifest)) {
+            std::cerr << "Failed to write HA group manifest" << std::endl;
+            return false;
+        }
+
         // Update metadata for all stores
         for (int store_id : store_ids) {
             StoreMetadata metadata;
@@ -214,25 +289,6 @@ public:
                             << store_id << std::endl;
             }
         }
-        
-        // Update global ha status
-        HAGroupStatus status;
-        status.group_id = store_ids[0];
-        status.store_count = store_ids.size();
-        status.destroyed_count = 0;
-        std::string ha_filepath = ha_path + "/status.data";
-        std::ofstream outFile(ha_filepath, std::ios::binary);
-        if (!outFile) {
-            std::cerr << "Error opening file for writing!" << std::endl;
-            return false;
-        }
-        outFile.write(reinterpret_cast<const char*>(&status.group_id), sizeof(status.group_id));
-        outFile.write(reinterpret_cast<const char*>(&status.store_count), sizeof(status.store_count));
-        outFile.write(reinterpret_cast<const char*>(&status.destroyed_count), sizeof(status.destroyed_count));
-        for (int store_id : store_ids) {
-            outFile.write(reinterpret_cast<const char*>(&store_id), sizeof(store_id));
-        }
-        outFile.close();
 
         return true;
     }
@@ -0,0 +1,156 @@
+/**
+ * @file hearty-store-hedge.hpp
+ * @author Nathadon Samairat
+ * @brief Hedged reads. The primary read of an object runs on a small dedicated pool;
+ *        if it has not finished after the configured percentile of recent primary
+ *        read latencies, a backup read (replica or parity reconstruction) is issued
+ *        on the calling thread and whichever finishes first wins. A primary that
+ *        fails before the delay is reported as it is, not hedged. The loser is told
+ *        to stop through a shared cancellation flag: a queued primary never starts
+ *        and a reconstruction stops between member reads. A primary stuck in the
+ *        kernel finishes on its pool thread and its result is dropped.
+ *
+ *        Configuration (environment):
+ *          HEARTY_HEDGE_PERCENTILE  primary latency percentile that triggers the
+ *                                   backup read (default 95, 0 = never hedge)
+ *          HEARTY_HEDGE_MIN_MS      lower bound of the hedge delay, also used until
+ *                                   enough latencies are known (default 10)
+ * @version 0.1
+ * @date 2024-12-13
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hearty-store-executor.hpp"
+
+const size_t HEDGE_WINDOW = 256;            // Primary latencies kept for the percentile
+const size_t HEDGE_MIN_SAMPLES = 16;        // Use the minimum delay until this many
+const size_t HEDGE_THREADS = 4;             // Threads running primary reads
+const double DEFAULT_HEDGE_PERCENTILE = 95;
+const double DEFAULT_HEDGE_MIN_MS = 10;
+
+// Result of one read attempt: success and the bytes read
+using ReadResult = std::pair<bool, std::string>;
+
+class HedgePolicy {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex;
+    std::vector<double> latencies;  // Ring of recent primary read latencies (ms)
+    size_t next_sample = 0;
+    double percentile;
+    double min_delay_ms;
+
+    static double envDouble(const char* name, double fallback) {
+        const char* value = std::getenv(name);
+        return value ? std::strtod(value, nullptr) : fallback;
+    }
+
+    /**
+     * @brief Pool running primary reads. It is separate from the shared executor so
+     *        a stalled primary never delays other work, and never destroyed so the
+     *        process does not wait for a stalled primary on exit.
+     */
+    static Executor& primaryPool() {
+        static Executor* pool = new Executor(HEDGE_THREADS, DEFAULT_QUEUE_DEPTH);
+        return *pool;
+    }
+
+    void record(double latency_ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (latencies.size() < HEDGE_WINDOW) {
+            latencies.push_back(latency_ms);
+        } else {
+            latencies[next_sample] = latency_ms;
+        }
+        next_sample = (next_sample + 1) % HEDGE_WINDOW;
+    }
+
+    std::chrono::microseconds delay() {
+        std::lock_guard<std::mutex> lock(mutex);
+        double delay_ms = min_delay_ms;
+        if (latencies.size() >= HEDGE_MIN_SAMPLES) {
+            std::vector<double> sorted = latencies;
+            size_t rank = std::min(sorted.size() - 1,
+                                   static_cast<size_t>(sorted.size() * percentile / 100.0));
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            delay_ms = std::max(delay_ms, sorted[rank]);
+        }
+        return std::chrono::microseconds(static_cast<long long>(delay_ms * 1000));
+    }
+
+public:
+    HedgePolicy(double hedge_percentile, double min_delay)
+        : percentile(std::min(hedge_percentile, 100.0)), min_delay_ms(min_delay) {}
+
+    /**
+     * @brief Returns the process-wide policy, configured from the environment.
+     */
+    static HedgePolicy& shared() {
+        static HedgePolicy policy(envDouble("HEARTY_HEDGE_PERCENTILE", DEFAULT_HEDGE_PERCENTILE),
+                                  envDouble("HEARTY_HEDGE_MIN_MS", DEFAULT_HEDGE_MIN_MS));
+        return policy;
+    }
+
+    bool enabled() const { return percentile > 0; }
+
+    /**
+     * @brief Runs a read with a backup.
+     *
+     * @param primary Reads from the primary copy. Runs on the primary pool, so it must
+     *                not refer to the caller's state; it may skip its work when the
+     *                flag it is given is set.
+     * @param backup Reads from a redundant copy on the calling thread; it should stop
+     *               early (and fail) once the flag it is given is set.
+     *
+     * @return The result of whichever read succeeded first. A primary that fails
+     *         before the hedge delay is returned as is, without a backup read;
+     *         otherwise a failure only if both reads failed.
+     */
+    template <typename Primary, typename Backup>
+    ReadResult read(Primary primary, Backup backup) {
+        auto cancelled = std::make_shared<std::atomic<bool>>(false);
+        std::future<ReadResult> primary_result = primaryPool().submit([primary, cancelled] {
+            if (*cancelled) {
+                return ReadResult{false, ""};
+            }
+            Clock::time_point start = Clock::now();
+            ReadResult result = primary(*cancelled);
+            HedgePolicy::shared().record(
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            if (result.first) {
+                *cancelled = true;  // Stop the backup if it is running
+            }
+            return result;
+        });
+
+        if (primary_result.wait_for(delay()) == std::future_status::ready) {
+            return primary_result.get();    // Done, or failed outright: nothing to hedge
+        }
+
+        // Primary is slow: race a backup read against it
+        ReadResult backup_result = backup(*cancelled);
+        bool primary_done = primary_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (backup_result.first && !primary_done) {
+            *cancelled = true;  // A primary still queued will not start
+            return backup_result;
+        }
+
+        // The primary won (it cancelled the backup) or the backup failed
+        ReadResult result = primary_result.get();
+        return result.first ? result : backup_result;
+    }
+};
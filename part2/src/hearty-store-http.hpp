@@ -0,0 +1,249 @@
+/**
+ * @file hearty-store-http.hpp
+ * @author Nathadon Samairat
+ * @brief Minimal HTTP/1.1 message layer for hearty-store-s3: parses request heads
+ *        from a connection's input buffer and serializes response heads. A
+ *        response body is either held in memory or a range of a file, which the
+ *        server sends with sendfile. Bodies must carry a Content-Length (chunked
+ *        uploads are refused); connections are kept alive unless either side asks
+ *        to close.
+ * @version 0.1
+ * @date 2024-12-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "hearty-store-io.hpp"
+
+const size_t HTTP_MAX_HEAD_SIZE = 16 * 1024;    // Request line and headers
+
+struct HttpRequest {
+    std::string method;
+    std::string target;                         // As sent (path and query)
+    std::string path;                           // Percent-decoded path
+    std::map<std::string, std::string> query;   // Percent-decoded parameters
+    std::map<std::string, std::string> headers; // Lower-case names
+    std::string body;
+    bool keep_alive = true;
+
+    std::string header(const std::string& name) const {
+        auto found = headers.find(name);
+        return found == headers.end() ? "" : found->second;
+    }
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::shared_ptr<RawFile> file;      // Body sent from this file instead of `body`
+    off_t file_offset = 0;
+    size_t file_length = 0;
+    std::shared_ptr<void> file_hold;    // Kept until the file range is sent
+    bool head_only = false;             // HEAD: Content-Length describes a body not sent
+    size_t content_length = 0;          // Length announced for a HEAD response
+
+    void setHeader(const std::string& name, const std::string& value) {
+        headers.emplace_back(name, value);
+    }
+};
+
+enum class HttpParse {
+    INCOMPLETE,     // The head has not fully arrived
+    COMPLETE,       // The head is parsed; the body may still be arriving
+    INVALID         // Malformed (or oversized) request
+};
+
+namespace http {
+    inline std::string reasonPhrase(int status) {
+        switch (status) {
+            case 100: return "Continue";
+            case 200: return "OK";
+            case 204: return "No Content";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 409: return "Conflict";
+            case 411: return "Length Required";
+            case 431: return "Request Header Fields Too Large";
+            case 500: return "Internal Server Error";
+            case 501: return "Not Implemented";
+            case 503: return "Service Unavailable";
+            default: return "Unknown";
+        }
+    }
+
+    inline std::string toLower(std::string text) {
+        for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return text;
+    }
+
+    inline std::string trim(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t");
+        if (first == std::string::npos) return "";
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    }
+
+    /**
+     * @brief Decodes %XX escapes (and '+' as a space in query strings).
+     *
+     * @return true if every escape is well-formed; false otherwise.
+     */
+    inline bool percentDecode(const std::string& text, bool plus_is_space, std::string& decoded) {
+        decoded.clear();
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '%') {
+                if (i + 2 >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[i + 1])) ||
+                    !std::isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+                    return false;
+                }
+                decoded += static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else if (text[i] == '+' && plus_is_space) {
+                decoded += ' ';
+            } else {
+                decoded += text[i];
+            }
+        }
+        return true;
+    }
+
+    inline bool parseQuery(const std::string& text, std::map<std::string, std::string>& query) {
+        size_t begin = 0;
+        while (begin < text.size()) {
+            size_t end = text.find('&', begin);
+            if (end == std::string::npos) end = text.size();
+            std::string pair = text.substr(begin, end - begin);
+            size_t equals = pair.find('=');
+            std::string name, value;
+            if (!percentDecode(pair.substr(0, equals), true, name) ||
+                !percentDecode(equals == std::string::npos ? "" : pair.substr(equals + 1), true, value)) {
+                return false;
+            }
+            if (!name.empty()) query[name] = value;
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Parses the request line and headers at the start of a buffer.
+     *
+     * @param buffer Bytes received on the connection.
+     * @param request Receives the method, target, headers and keep-alive flag.
+     * @param head_length Receives the length of the head, including the blank line.
+     *
+     * @return Whether the head is complete, still arriving or malformed.
+     */
+    inline HttpParse parseHead(const std::string& buffer, HttpRequest& request, size_t& head_length) {
+        size_t end = buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return buffer.size() > HTTP_MAX_HEAD_SIZE ? HttpParse::INVALID : HttpParse::INCOMPLETE;
+        }
+        if (end > HTTP_MAX_HEAD_SIZE) {
+            return HttpParse::INVALID;
+        }
+        head_length = end + 4;
+
+        size_t line_end = buffer.find("\r\n");
+        std::string line = buffer.substr(0, line_end);
+        size_t first_space = line.find(' ');
+        size_t second_space = line.find(' ', first_space + 1);
+        if (first_space == std::string::npos || second_space == std::string::npos) {
+            return HttpParse::INVALID;
+        }
+        request = HttpRequest();
+        request.method = line.substr(0, first_space);
+        request.target = line.substr(first_space + 1, second_space - first_space - 1);
+        std::string version = line.substr(second_space + 1);
+        if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+            return HttpParse::INVALID;
+        }
+
+        size_t question = request.target.find('?');
+        if (request.target.empty() || request.target[0] != '/' ||
+            !percentDecode(request.target.substr(0, question), false, request.path) ||
+            (question != std::string::npos && !parseQuery(request.target.substr(question + 1), request.query))) {
+            return HttpParse::INVALID;
+        }
+
+        size_t pos = line_end + 2;
+        while (pos < end) {
+            size_t next = buffer.find("\r\n", pos);
+            std::string header = buffer.substr(pos, next - pos);
+            size_t colon = header.find(':');
+            if (colon == std::string::npos || colon == 0) {
+                return HttpParse::INVALID;
+            }
+            request.headers[toLower(header.substr(0, colon))] = trim(header.substr(colon + 1));
+            pos = next + 2;
+        }
+
+        std::string connection = toLower(request.header("connection"));
+        request.keep_alive = version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+        return HttpParse::COMPLETE;
+    }
+
+    // Date in the format of HTTP headers (RFC 7231), e.g. Last-Modified
+    inline std::string formatDate(time_t time) {
+        struct tm utc;
+        gmtime_r(&time, &utc);
+        char text[64];
+        std::strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+        return text;
+    }
+
+    // Date in the ISO 8601 format of S3 XML documents
+    inline std::string formatIsoDate(time_t time) {
+        struct tm utc;
+        gmtime_r(&time, &utc);
+        char text[64];
+        std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S.000Z", &utc);
+        return text;
+    }
+
+    inline std::string xmlEscape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            switch (c) {
+                case '&': escaped += "&amp;"; break;
+                case '<': escaped += "&lt;"; break;
+                case '>': escaped += "&gt;"; break;
+                case '"': escaped += "&quot;"; break;
+                case '\'': escaped += "&apos;"; break;
+                default: escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    /**
+     * @brief Serializes the status line and headers of a response, adding
+     *        Content-Length and Connection.
+     */
+    inline std::string serializeHead(const HttpResponse& response, bool keep_alive) {
+        size_t length = response.head_only ? response.content_length :
+                        response.file ? response.file_length : response.body.size();
+        std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " +
+                           reasonPhrase(response.status) + "\r\n";
+        for (const auto& [name, value] : response.headers) {
+            head += name + ": " + value + "\r\n";
+        }
+        if (response.status != 204) {
+            head += "Content-Length: " + std::to_string(length) + "\r\n";
+        }
+        head += keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        head += "\r\n";
+        return head;
+    }
+}
@@ -0,0 +1,153 @@
+/**
+ * @file hearty-store-import.cpp
+ * @author Nathadon Samairat
+ * @brief Reads a tar archive from stdin (as written by hearty-store-export) and
+ *        stores every regular file in it as an object, under the file's name (its
+ *        last path component) as object ID and with its modification time. Objects
+ *        are committed in batches (StorePut::putBatch): one metadata load, block
+ *        allocation and commit per batch instead of per object.
+ * @version 0.1
+ * @date 2024-12-17
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-archive.hpp"
+
+const size_t IMPORT_BATCH_OBJECTS = 64;                 // Objects committed together
+const size_t IMPORT_BATCH_BYTES = 64 * 1024 * 1024;     // Bytes held per batch
+
+class StoreImport {
+private:
+    int store_id;
+    std::vector<BatchObject> batch;
+    size_t batch_bytes = 0;
+    size_t imported = 0;
+    size_t skipped = 0;
+
+    /**
+     * @brief Reads (or skips) exactly `length` bytes of the archive.
+     */
+    static bool readExact(std::istream& in, char* buffer, size_t length) {
+        in.read(buffer, length);
+        return static_cast<size_t>(in.gcount()) == length;
+    }
+
+    static bool skip(std::istream& in, size_t length) {
+        in.ignore(length);
+        return static_cast<size_t>(in.gcount()) == length;
+    }
+
+    /**
+     * @brief Commits the pending batch to the store.
+     */
+    void flush() {
+        if (batch.empty()) return;
+        StorePut store_put(store_id);
+        std::vector<bool> stored = store_put.putBatch(batch);
+        for (bool ok : stored) {
+            ok ? imported++ : skipped++;
+        }
+        batch.clear();
+        batch_bytes = 0;
+    }
+
+public:
+    StoreImport(int id) : store_id(id) {}
+
+    /**
+     * @brief Imports every regular file of an archive.
+     *
+     * @param in Stream holding the archive.
+     *
+     * @return true if the archive is read to its end; false if it is corrupt or truncated.
+     */
+    bool importFrom(std::istream& in) {
+        TarHeader header;
+        ArchiveEntry entry;
+        bool truncated = false;
+        while (readExact(in, reinterpret_cast<char*>(&header), sizeof(TarHeader))) {
+            if (archive::isZeroRecord(header)) {
+                flush();
+                return true;    // End of archive
+            }
+            if (!archive::parseHeader(header, entry)) {
+                std::cerr << "Corrupt archive header" << std::endl;
+                flush();
+                return false;
+            }
+
+            size_t padded = entry.size + archive::padding(entry.size);
+            std::string object_id = entry.name.substr(entry.name.find_last_of('/') + 1);
+            if (!entry.is_file || object_id.empty()) {
+                truncated = !skip(in, padded);
+                if (truncated) break;
+                continue;
+            }
+            if (entry.size > BLOCK_SIZE) {
+                std::cerr << "Skipping " << entry.name << ": too large (max 1MB)" << std::endl;
+                skipped++;
+                truncated = !skip(in, padded);
+                if (truncated) break;
+                continue;
+            }
+
+            BatchObject object{object_id, entry.mtime, std::string(entry.size, '\0')};
+            if (!readExact(in, object.data.data(), entry.size) ||
+                !skip(in, archive::padding(entry.size))) {
+                truncated = true;
+                break;
+            }
+            batch_bytes += entry.size;
+            batch.push_back(std::move(object));
+            if (batch.size() == IMPORT_BATCH_OBJECTS || batch_bytes >= IMPORT_BATCH_BYTES) {
+                flush();
+            }
+        }
+
+        // Archives without end records (or cut short) still import what was read
+        flush();
+        if (truncated || in.gcount() != 0) {
+            std::cerr << "Archive is truncated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    size_t importedCount() const { return imported; }
+    size_t skippedCount() const { return skipped; }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] < archive.tar" << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreImport importer(store_id);
+        bool complete = importer.importFrom(std::cin);
+        std::cout << "Imported " << importer.importedCount() << " objects into store " << store_id;
+        if (importer.skippedCount() > 0) {
+            std::cout << " (" << importer.skippedCount() << " skipped)";
+        }
+        std::cout << std::endl;
+        return complete && importer.skippedCount() == 0 ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
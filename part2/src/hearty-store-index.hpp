@@ -0,0 +1,254 @@
+/**
+ * @file hearty-store-index.hpp
+ * @author Nathadon Samairat
+ * @brief Sorted on-disk object index of a store. Each store keeps two sorted runs
+ *        of the same entries, one ordered by object ID and one by timestamp, so
+ *        listing can seek to a prefix or a point in time and read only the page of
+ *        entries it returns instead of loading every BlockMetadata record.
+ * @version 0.1
+ * @date 2024-12-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+
+const std::string ID_INDEX_FILENAME = "/index-id.bin";      // Entries sorted by object ID
+const std::string TIME_INDEX_FILENAME = "/index-time.bin";  // Entries sorted by timestamp
+const uint32_t INDEX_MAGIC = 0x48534958;                    // "HSIX"
+const uint32_t INDEX_VERSION = 1;
+
+struct IndexHeader {
+    uint32_t magic;         // INDEX_MAGIC
+    uint32_t version;       // INDEX_VERSION
+    uint64_t count;         // Number of entries that follow the header
+};
+
+struct IndexEntry {
+    char object_id[OBJECT_ID_SIZE]; // Object ID (NUL terminated)
+    time_t timestamp;               // Last modification time of the object
+    int32_t block_num;              // Block holding the object
+    uint64_t data_size;             // Size of the object
+};
+
+enum class IndexOrder {
+    BY_ID,      // Ordered by object ID
+    BY_TIME     // Ordered by (timestamp, object ID)
+};
+
+namespace utils {
+    inline std::string getIndexPath(int store_id, IndexOrder order) {
+        return getStorePath(store_id) +
+               (order == IndexOrder::BY_ID ? ID_INDEX_FILENAME : TIME_INDEX_FILENAME);
+    }
+
+    // Builds an index entry from a block's metadata
+    inline IndexEntry makeIndexEntry(const BlockMetadata& block, int block_num) {
+        IndexEntry entry{};
+        std::memcpy(entry.object_id, block.object_id, OBJECT_ID_SIZE);
+        entry.timestamp = block.timestamp;
+        entry.block_num = block_num;
+        entry.data_size = block.data_size;
+        return entry;
+    }
+}
+
+class ObjectIndex {
+private:
+    std::string path;
+    IndexOrder order;
+    std::fstream file;
+    IndexHeader header;
+
+    /**
+     * @brief Compares two entries in the order of this index.
+     *
+     * @return true if a sorts strictly before b; false otherwise.
+     */
+    bool less(const IndexEntry& a, const IndexEntry& b) const {
+        int by_id = std::strncmp(a.object_id, b.object_id, OBJECT_ID_SIZE);
+        if (order == IndexOrder::BY_TIME && a.timestamp != b.timestamp) {
+            return a.timestamp < b.timestamp;
+        }
+        return by_id < 0;
+    }
+
+    /**
+     * @brief Writes the header back to the start of the file.
+     *
+     * @return true if the header is successfully written; false otherwise.
+     */
+    bool writeHeader() {
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Reads entries [pos, pos + count) into a buffer.
+     */
+    bool readRange(uint64_t pos, uint64_t count, std::vector<IndexEntry>& entries) {
+        entries.resize(count);
+        if (count == 0) return true;
+        file.seekg(sizeof(IndexHeader) + pos * sizeof(IndexEntry));
+        file.read(reinterpret_cast<char*>(entries.data()), count * sizeof(IndexEntry));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Writes entries starting at position pos.
+     */
+    bool writeRange(uint64_t pos, const std::vector<IndexEntry>& entries) {
+        if (entries.empty()) return true;
+        file.seekp(sizeof(IndexHeader) + pos * sizeof(IndexEntry));
+        file.write(reinterpret_cast<const char*>(entries.data()),
+                   entries.size() * sizeof(IndexEntry));
+        return static_cast<bool>(file);
+    }
+
+public:
+    ObjectIndex(int store_id, IndexOrder order)
+        : path(utils::getIndexPath(store_id, order)), order(order), header{} {}
+
+    /**
+     * @brief Creates an empty index file for a store, replacing any existing one.
+     *
+     * @param store_id ID of the store.
+     * @param order Sort order of the index.
+     *
+     * @return true if the index file is successfully created; false otherwise.
+     */
+    static bool create(int store_id, IndexOrder order) {
+        std::ofstream out(utils::getIndexPath(store_id, order),
+                          std::ios::binary | std::ios::trunc);
+        IndexHeader empty{INDEX_MAGIC, INDEX_VERSION, 0};
+        out.write(reinterpret_cast<const char*>(&empty), sizeof(IndexHeader));
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * @brief Opens the index file and reads its header (no entries are loaded).
+     *
+     * @return true if the index is successfully opened; false otherwise.
+     */
+    bool open() {
+        file.open(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file) return false;
+        file.read(reinterpret_cast<char*>(&header), sizeof(IndexHeader));
+        return file && header.magic == INDEX_MAGIC && header.version == INDEX_VERSION;
+    }
+
+    uint64_t size() const { return header.count; }
+
+    /**
+     * @brief Reads the entry at a given position of the sorted run.
+     *
+     * @return true if the entry is successfully read; false otherwise.
+     */
+    bool read(uint64_t pos, IndexEntry& entry) {
+        if (pos >= header.count) return false;
+        file.seekg(sizeof(IndexHeader) + pos * sizeof(IndexEntry));
+        file.read(reinterpret_cast<char*>(&entry), sizeof(IndexEntry));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Binary searches for the first entry that does not sort before key.
+     *
+     * Only O(log n) entries are read from disk.
+     *
+     * @param key Entry holding the key fields of this index's order.
+     *
+     * @return Position of the first entry >= key (size() if there is none).
+     */
+    uint64_t lowerBound(const IndexEntry& key) {
+        uint64_t lo = 0;
+        uint64_t hi = header.count;
+        IndexEntry probe;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (!read(mid, probe)) return header.count;
+            if (less(probe, key)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    /**
+     * @brief Inserts an entry, keeping the run sorted.
+     *
+     * @return true if the entry is successfully inserted; false otherwise.
+     */
+    bool insert(const IndexEntry& entry) {
+        uint64_t pos = lowerBound(entry);
+
+        // Shift the tail of the run by one entry
+        std::vector<IndexEntry> tail;
+        if (!readRange(pos, header.count - pos, tail)) return false;
+        tail.insert(tail.begin(), entry);
+        if (!writeRange(pos, tail)) return false;
+
+        header.count++;
+        if (!writeHeader()) return false;
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Inserts many entries in one pass: they are sorted and merged with the
+     *        run, which is rewritten once instead of once per entry.
+     *
+     * @return true if the entries are successfully inserted; false otherwise.
+     */
+    bool insertAll(std::vector<IndexEntry> entries) {
+        std::sort(entries.begin(), entries.end(),
+                  [this](const IndexEntry& a, const IndexEntry& b) { return less(a, b); });
+        std::vector<IndexEntry> run;
+        if (!readRange(0, header.count, run)) return false;
+
+        std::vector<IndexEntry> merged(run.size() + entries.size());
+        std::merge(run.begin(), run.end(), entries.begin(), entries.end(), merged.begin(),
+                   [this](const IndexEntry& a, const IndexEntry& b) { return less(a, b); });
+        if (!writeRange(0, merged)) return false;
+
+        header.count = merged.size();
+        if (!writeHeader()) return false;
+        file.flush();
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Removes the entry with the same key (object ID, and timestamp for
+     *        the time-ordered index) if it is present.
+     *
+     * @return true if the entry was found and removed; false otherwise.
+     */
+    bool remove(const IndexEntry& entry) {
+        uint64_t pos = lowerBound(entry);
+        IndexEntry found;
+        if (!read(pos, found) ||
+            std::strncmp(found.object_id, entry.object_id, OBJECT_ID_SIZE) != 0) {
+            return false;
+        }
+
+        // Shift the tail of the run back by one entry
+        std::vector<IndexEntry> tail;
+        if (!readRange(pos + 1, header.count - pos - 1, tail)) return false;
+        if (!writeRange(pos, tail)) return false;
+
+        header.count--;
+        if (!writeHeader()) return false;
+        file.flush();
+        std::filesystem::resize_file(path, sizeof(IndexHeader) + header.count * sizeof(IndexEntry));
+        return true;
+    }
+};
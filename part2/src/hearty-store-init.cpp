@@ -16,6 +16,8 @@
 #include <string>
 #include <cstring>
 #include "hearty-store-common.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-filter.hpp"
 
 class StoreInitializer {
 private:
@@ -24,27 +26,27 @@ private:
     std::vector<BlockMetadata> block_metadata;
 
     /**
-     * @brief Creates and initializes the store's data file.
+     * @brief Creates the store's data file. The file is sparse: unwritten blocks
+     *        read as zeros without being written, as for the parity file.
      * 
      * @param path Path to the data file to be created.
      * 
      * @return true if the data file is successfully created and initialized; false otherwise.
      */
     bool createDataFile(const std::string& path) {
-        std::ofstream file(path, std::ios::binary);
-        if (!file) {
-            std::cerr << "Failed to create data file" << std::endl;
-            return false;
-        }
-
-        // Initialize with zeros
-        std::vector<char> zeros(BLOCK_SIZE, 0);
-        for (size_t i = 0; i < NUM_BLOCKS; i++) {
-            if (!file.write(zeros.data(), BLOCK_SIZE)) {
-                std::cerr << "Failed to initialize block " << i << std::endl;
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cerr << "Failed to create data file" << std::endl;
                 return false;
             }
         }
+        std::error_code error;
+        std::filesystem::resize_file(path, NUM_BLOCKS * BLOCK_SIZE, error);
+        if (error) {
+            std::cerr << "Failed to size data file: " << error.message() << std::endl;
+            return false;
+        }
         return true;
     }
 
@@ -93,7 +95,7 @@ private:
         store_metadata.is_destroyed = false;
 
         // Initialize block metadata
-        block_metadata.resize(NUM_BLOCKS);
+        block_metadata.assign(NUM_BLOCKS, BlockMetadata{});
         for (auto& block : block_metadata) {
             block.is_used = false;
             block.data_size = 0;
@@ -150,6 +152,15 @@ public:
             return false;
         }
 
+        // Create the empty object indexes and ID filter
+        if (!ObjectIndex::create(store_id, IndexOrder::BY_ID) ||
+            !ObjectIndex::create(store_id, IndexOrder::BY_TIME) ||
+            !ObjectFilter(store_id).save()) {
+            std::cerr << "Failed to create object index" << std::endl;
+            std::filesystem::remove_all(store_path);
+            return false;
+        }
+
         return true;
     }
 };
@@ -0,0 +1,289 @@
+/**
+ * @file hearty-store-io.hpp
+ * @author Nathadon Samairat
+ * @brief Thin file layer over raw descriptors for the data paths. RawFile owns a
+ *        descriptor and does positional I/O (pread/pwrite/preadv/pwritev), so no
+ *        seek state is shared and no stream buffer copies the data. Data and parity
+ *        files are opened once per process and their descriptors shared by all
+ *        threads (io::openShared); they are never renamed or replaced. A store
+ *        can still be destroyed (or replaced by a rebuilt hot spare) and created
+ *        again under its ID by another process, so openShared checks that the path
+ *        names the cached file before reusing it. Metadata files are replaced by
+ *        rename and are therefore opened per use.
+ *
+ *        Configuration (environment):
+ *          HEARTY_SYNC     none, data (fdatasync) or full (fsync) before committing
+ *                          metadata (default none)
+ * @version 0.1
+ * @date 2024-12-11
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+enum class Durability {
+    NONE,   // Leave write-back to the kernel
+    DATA,   // fdatasync: file contents (and size) are on disk
+    FULL    // fsync: contents and all inode metadata are on disk
+};
+
+class RawFile {
+private:
+    int fd = -1;
+
+public:
+    RawFile() = default;
+
+    RawFile(const std::string& path, int flags, mode_t mode = 0644)
+        : fd(::open(path.c_str(), flags | O_CLOEXEC, mode)) {}
+
+    ~RawFile() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    RawFile(RawFile&& other) noexcept : fd(other.fd) { other.fd = -1; }
+
+    RawFile& operator=(RawFile&& other) noexcept {
+        if (this != &other) {
+            if (fd >= 0) ::close(fd);
+            fd = other.fd;
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    RawFile(const RawFile&) = delete;
+    RawFile& operator=(const RawFile&) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    /**
+     * @brief Reads up to `length` bytes at `offset`, retrying short reads.
+     *
+     * @return The number of bytes read (less than `length` only at end of file),
+     *         or -1 on error.
+     */
+    ssize_t readAt(char* buffer, size_t length, off_t offset) const {
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = ::pread(fd, buffer + done, length - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return -1;
+            if (n == 0) break;
+            done += n;
+        }
+        return static_cast<ssize_t>(done);
+    }
+
+    /**
+     * @brief Reads exactly `length` bytes at `offset`.
+     */
+    bool readFull(char* buffer, size_t length, off_t offset) const {
+        return readAt(buffer, length, offset) == static_cast<ssize_t>(length);
+    }
+
+    /**
+     * @brief Writes all `length` bytes at `offset`, retrying short writes.
+     */
+    bool writeAt(const char* buffer, size_t length, off_t offset) const {
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = ::pwrite(fd, buffer + done, length - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Scatter read: fills the buffers in order from `offset` with one call
+     *        in the common case. The iovecs are consumed.
+     *
+     * @return true if every buffer was filled; false on error or end of file.
+     */
+    bool readVec(std::vector<iovec>& iov, off_t offset) const {
+        size_t first = 0;
+        while (first < iov.size()) {
+            ssize_t n = ::preadv(fd, iov.data() + first, static_cast<int>(iov.size() - first), offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            offset += n;
+            // Skip the buffers that are full and advance into a partial one
+            while (first < iov.size() && static_cast<size_t>(n) >= iov[first].iov_len) {
+                n -= iov[first].iov_len;
+                first++;
+            }
+            if (first < iov.size()) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+                iov[first].iov_len -= n;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Gather write: writes the buffers in order at `offset`. The iovecs are consumed.
+     */
+    bool writeVec(std::vector<iovec>& iov, off_t offset) const {
+        size_t first = 0;
+        while (first < iov.size() && iov[first].iov_len == 0) first++;   // Nothing to write
+        while (first < iov.size()) {
+            ssize_t n = ::pwritev(fd, iov.data() + first, static_cast<int>(iov.size() - first), offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            offset += n;
+            while (first < iov.size() && static_cast<size_t>(n) >= iov[first].iov_len) {
+                n -= iov[first].iov_len;
+                first++;
+            }
+            if (first < iov.size()) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + n;
+                iov[first].iov_len -= n;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Tells the kernel how a range will be read (posix_fadvise), e.g.
+     *        POSIX_FADV_SEQUENTIAL for a front-to-back scan. Only a hint.
+     */
+    bool advise(off_t offset, off_t length, int advice) const {
+        return ::posix_fadvise(fd, offset, length, advice) == 0;
+    }
+
+    /**
+     * @brief Copies up to `length` bytes at `offset` to a socket inside the kernel
+     *        (sendfile), advancing `offset`. On a non-blocking socket it returns
+     *        after what the socket buffer takes.
+     *
+     * @return The number of bytes sent, or -1 on error (EAGAIN when the socket is full).
+     */
+    ssize_t sendTo(int socket_fd, off_t& offset, size_t length) const {
+        ssize_t n;
+        do {
+            n = ::sendfile(socket_fd, fd, &offset, length);
+        } while (n < 0 && errno == EINTR);
+        return n;
+    }
+
+    bool status(struct stat& st) const {
+        return ::fstat(fd, &st) == 0;
+    }
+
+    /**
+     * @brief Flushes written data to disk at the given level.
+     */
+    bool sync(Durability level) const {
+        return syncDescriptor(fd, level);
+    }
+
+    /**
+     * @brief Syncs any descriptor at the given level (e.g. an append-only journal).
+     */
+    static bool syncDescriptor(int descriptor, Durability level) {
+        switch (level) {
+            case Durability::DATA: return ::fdatasync(descriptor) == 0;
+            case Durability::FULL: return ::fsync(descriptor) == 0;
+            default: return true;
+        }
+    }
+};
+
+namespace io {
+    // Durability requested for commits, from HEARTY_SYNC (read once)
+    inline Durability commitDurability() {
+        static const Durability level = [] {
+            const char* value = std::getenv("HEARTY_SYNC");
+            std::string mode = value ? value : "";
+            if (mode == "data") return Durability::DATA;
+            if (mode == "full") return Durability::FULL;
+            return Durability::NONE;
+        }();
+        return level;
+    }
+
+    /**
+     * @brief Returns the process-wide descriptor of a data or parity file, opening
+     *        it read-write on first use (read-only if it cannot be written) and
+     *        again if the path now names another file.
+     *
+     * @return The shared file, or nullptr if it cannot be opened.
+     */
+    struct SharedFiles {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<RawFile>> files;
+    };
+
+    inline SharedFiles& sharedFiles() {
+        static SharedFiles shared;
+        return shared;
+    }
+
+    inline std::shared_ptr<RawFile> openShared(const std::string& path) {
+        SharedFiles& shared = sharedFiles();
+        std::unordered_map<std::string, std::shared_ptr<RawFile>>& files = shared.files;
+
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        auto found = files.find(path);
+        if (found != files.end()) {
+            // Reused only while the path still names it: a store destroyed and
+            // initialized again by another process has a new data file
+            struct stat open_st;
+            struct stat path_st;
+            if (found->second->status(open_st) && ::stat(path.c_str(), &path_st) == 0 &&
+                open_st.st_ino == path_st.st_ino && open_st.st_dev == path_st.st_dev) {
+                return found->second;
+            }
+            files.erase(found);
+        }
+
+        auto file = std::make_shared<RawFile>(path, O_RDWR);
+        if (!file->isOpen()) {
+            file = std::make_shared<RawFile>(path, O_RDONLY);
+        }
+        if (!file->isOpen()) {
+            return nullptr;
+        }
+        files.emplace(path, file);
+        return file;
+    }
+
+    /**
+     * @brief Writes a whole file aside and renames it into place, syncing it first
+     *        at the commit durability level.
+     *
+     * @param path Final path of the file.
+     * @param iov Contents of the file, in order (consumed).
+     *
+     * @return true if the file is replaced; false otherwise (the old file is kept).
+     */
+    inline bool replaceFile(const std::string& path, std::vector<iovec>& iov) {
+        std::string temp_path = path + ".tmp";
+        {
+            RawFile file(temp_path, O_WRONLY | O_CREAT | O_TRUNC);
+            if (!file.isOpen() || !file.writeVec(iov, 0) || !file.sync(commitDurability())) {
+                ::unlink(temp_path.c_str());
+                return false;
+            }
+        }
+        return ::rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+}
@@ -0,0 +1,392 @@
+/**
+ * @file hearty-store-iosched.hpp
+ * @author Nathadon Samairat
+ * @brief I/O scheduler with priority classes. Every block-sized I/O asks for a grant
+ *        before it is issued. Grants are dispatched by class (foreground reads, then
+ *        foreground writes, then background work such as parity initialization and
+ *        replica copies), earliest deadline first within a class, and limited by a
+ *        token bucket per class and by a maximum number of I/Os in flight. A
+ *        background request whose deadline has passed is dispatched ahead of
+ *        foreground work (once its bucket has tokens) so it cannot starve. When a foreground read latency target
+ *        is set, the background rate is halved whenever the recent p99 read latency
+ *        exceeds it and slowly raised again while it does not.
+ *        The background bucket and the read latency samples live in a small shared
+ *        mapping (/dev/shm/hearty-iosched) updated with atomics, so the gets of one
+ *        process throttle the rebuild or parity initialization running in another.
+ *
+ *        Configuration (environment):
+ *          HEARTY_IO_DEPTH              maximum I/Os in flight (default 8)
+ *          HEARTY_IO_BG_RATE            background MB/s (default 0 = unlimited)
+ *          HEARTY_IO_FG_WRITE_RATE      foreground write MB/s (default 0 = unlimited)
+ *          HEARTY_IO_READ_TARGET_MS     p99 foreground read latency target (default 0 = off)
+ * @version 0.1
+ * @date 2024-12-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class IOClass {
+    FOREGROUND_READ = 0,    // Client gets
+    FOREGROUND_WRITE = 1,   // Client puts
+    BACKGROUND = 2          // Parity initialization, replica copies, rebuilds
+};
+
+const size_t NUM_IO_CLASSES = 3;
+const size_t DEFAULT_IO_DEPTH = 8;
+const size_t LATENCY_WINDOW = 128;      // Foreground read samples kept for the p99
+const double MIN_BACKGROUND_RATE = 1.0 * 1024 * 1024;   // Never throttle below 1 MB/s
+const char* const IO_SHARED_PATH = "/dev/shm/hearty-iosched";
+const int64_t SAMPLE_MAX_AGE_NS = 10'000'000'000;    // Older read samples are ignored
+const int64_t RATE_LEASE_NS = 10'000'000'000;        // A rate nobody renews expires
+const int64_t ADAPT_INTERVAL_NS = 100'000'000;       // Adapt the background rate at most every 100ms
+
+// Scheduler state shared by every process on the host. A zero-filled mapping is a
+// valid initial state: unlimited background rate and no samples.
+struct SharedIOState {
+    std::atomic<int64_t> background_rate;           // Bytes per second (0 = unlimited)
+    std::atomic<int64_t> background_tokens;         // Available bytes
+    std::atomic<int64_t> last_refill;               // steady_clock ns of the last refill
+    std::atomic<int64_t> rate_renewed;              // steady_clock ns the rate was last set
+    std::atomic<int64_t> last_adapted;              // steady_clock ns of the last adaptation
+    std::atomic<uint64_t> next_sample;
+    std::atomic<int64_t> read_latency_us[LATENCY_WINDOW];
+    std::atomic<int64_t> read_time[LATENCY_WINDOW];  // steady_clock ns of each sample
+};
+static_assert(std::atomic<int64_t>::is_always_lock_free, "shared scheduler state needs lock-free atomics");
+
+class IOScheduler {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct TokenBucket {
+        double rate;            // Bytes per second (0 = unlimited)
+        double tokens;          // Available bytes
+        Clock::time_point last_refill;
+
+        void refill(Clock::time_point now) {
+            if (rate <= 0) return;
+            double elapsed = std::chrono::duration<double>(now - last_refill).count();
+            tokens = std::min(rate, tokens + elapsed * rate);   // Burst of one second
+            last_refill = now;
+        }
+    };
+
+    struct Request {
+        IOClass io_class;
+        size_t bytes;
+        Clock::time_point deadline;
+    };
+
+    std::mutex mutex;
+    std::condition_variable dispatched;
+    std::list<Request> queue;
+    TokenBucket buckets[NUM_IO_CLASSES];    // Background uses the shared bucket instead
+    Clock::duration class_deadline[NUM_IO_CLASSES];
+    size_t max_in_flight;
+    size_t in_flight = 0;
+    double background_max_rate;             // Configured background rate (0 = unlimited)
+    double read_target_ms;
+    SharedIOState* host_state;
+    std::unique_ptr<SharedIOState> private_state;   // Used if the mapping is unavailable
+
+    static int64_t nanos(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Maps the host-wide scheduler state, creating it zero-filled if needed.
+     *
+     * @return The mapped state, or nullptr if it could not be mapped.
+     */
+    static SharedIOState* mapShared() {
+        int fd = open(IO_SHARED_PATH, O_RDWR | O_CREAT, 0666);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            (st.st_size < static_cast<off_t>(sizeof(SharedIOState)) &&
+             ftruncate(fd, sizeof(SharedIOState)) != 0)) {
+            close(fd);
+            return nullptr;
+        }
+        void* state = mmap(nullptr, sizeof(SharedIOState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        return state == MAP_FAILED ? nullptr : static_cast<SharedIOState*>(state);
+    }
+
+    /**
+     * @brief Returns the background rate in force: the shared rate while some process
+     *        keeps renewing it, else this process's configured rate.
+     */
+    double backgroundRate(int64_t now) const {
+        int64_t rate = host_state->background_rate.load();
+        if (rate > 0 && now - host_state->rate_renewed.load() <= RATE_LEASE_NS) {
+            return static_cast<double>(rate);
+        }
+        return background_max_rate;
+    }
+
+    /**
+     * @brief Publishes a background rate for all processes.
+     */
+    void setBackgroundRate(double rate, int64_t now) {
+        host_state->background_rate.store(static_cast<int64_t>(rate));
+        host_state->rate_renewed.store(now);
+        int64_t tokens = host_state->background_tokens.load();
+        while (tokens > rate && !host_state->background_tokens.compare_exchange_weak(tokens, static_cast<int64_t>(rate))) {
+        }
+    }
+
+    /**
+     * @brief Refills the shared background bucket (burst of one second) and reports
+     *        whether a background request may go now.
+     */
+    bool refillBackground(int64_t now) {
+        double rate = backgroundRate(now);
+        if (rate <= 0) {
+            return true;
+        }
+        int64_t last = host_state->last_refill.exchange(now);
+        int64_t elapsed = std::min<int64_t>(std::max<int64_t>(now - last, 0), 1'000'000'000);
+        int64_t added = static_cast<int64_t>(elapsed * rate / 1e9);
+        int64_t tokens = host_state->background_tokens.load();
+        int64_t refilled;
+        do {
+            refilled = std::min(static_cast<int64_t>(rate), tokens + added);
+        } while (!host_state->background_tokens.compare_exchange_weak(tokens, refilled));
+        return refilled > 0;
+    }
+
+    /**
+     * @brief Picks the request to dispatch next: an overdue background request that
+     *        its bucket has tokens for, otherwise the lowest class, earliest deadline
+     *        first. An overdue request still waiting for tokens does not hold up
+     *        foreground work.
+     */
+    std::list<Request>::iterator pickNext(Clock::time_point now) {
+        bool background_ready = refillBackground(nanos(now));
+
+        auto best = queue.end();
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->io_class == IOClass::BACKGROUND && it->deadline <= now && background_ready) {
+                return it;
+            }
+            if (best == queue.end() || it->io_class < best->io_class ||
+                (it->io_class == best->io_class && it->deadline < best->deadline)) {
+                best = it;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Adjusts the shared background rate from the foreground read latencies
+     *        recorded by all processes in the last few seconds. Runs at most once per
+     *        ADAPT_INTERVAL_NS across the host; without recent reads the rate recovers.
+     */
+    void adaptBackgroundRate(int64_t now) {
+        if (read_target_ms <= 0) {
+            return;
+        }
+        int64_t last = host_state->last_adapted.load();
+        if (now - last < ADAPT_INTERVAL_NS || !host_state->last_adapted.compare_exchange_strong(last, now)) {
+            return;
+        }
+
+        std::vector<double> recent;
+        for (size_t i = 0; i < LATENCY_WINDOW; i++) {
+            if (now - host_state->read_time[i].load() <= SAMPLE_MAX_AGE_NS) {
+                recent.push_back(host_state->read_latency_us[i].load() / 1000.0);
+            }
+        }
+
+        double ceiling = background_max_rate > 0 ? background_max_rate : 1024.0 * 1024 * 1024;
+        double rate = backgroundRate(now);
+        double current = rate > 0 ? rate : ceiling;
+        if (recent.size() >= LATENCY_WINDOW / 4) {
+            size_t p99 = (recent.size() * 99) / 100;
+            std::nth_element(recent.begin(), recent.begin() + p99, recent.end());
+            if (recent[p99] > read_target_ms) {
+                setBackgroundRate(std::max(MIN_BACKGROUND_RATE, current / 2), now);
+                return;
+            }
+        }
+        setBackgroundRate(std::min(ceiling, current * 1.1), now);
+    }
+
+    /**
+     * @brief Keeps this process's configured background rate in force while it
+     *        issues background I/O, unless an adaptation has lowered it.
+     */
+    void renewBackgroundRate(int64_t now) {
+        if (background_max_rate <= 0 || read_target_ms > 0) {
+            return;
+        }
+        double rate = backgroundRate(now);
+        setBackgroundRate(std::min(rate > 0 ? rate : background_max_rate, background_max_rate), now);
+    }
+
+    static double envDouble(const char* name, double fallback) {
+        const char* value = std::getenv(name);
+        if (value == nullptr) return fallback;
+        try {
+            return std::stod(value);
+        } catch (const std::exception&) {
+            return fallback;
+        }
+    }
+
+public:
+    /**
+     * @brief Creates a scheduler.
+     *
+     * @param depth Maximum number of I/Os in flight.
+     * @param background_rate Background bytes per second (0 = unlimited).
+     * @param write_rate Foreground write bytes per second (0 = unlimited).
+     * @param target_ms p99 foreground read latency target in milliseconds (0 = off).
+     */
+    IOScheduler(size_t depth, double background_rate, double write_rate, double target_ms)
+        : max_in_flight(std::max<size_t>(1, depth)), background_max_rate(background_rate),
+          read_target_ms(target_ms), host_state(mapShared()) {
+        if (host_state == nullptr) {
+            private_state = std::make_unique<SharedIOState>();
+            host_state = private_state.get();
+        }
+        Clock::time_point now = Clock::now();
+        double rates[NUM_IO_CLASSES] = {0, write_rate, 0};
+        for (size_t i = 0; i < NUM_IO_CLASSES; i++) {
+            buckets[i] = TokenBucket{rates[i], rates[i], now};
+        }
+        class_deadline[0] = std::chrono::milliseconds(10);
+        class_deadline[1] = std::chrono::milliseconds(50);
+        class_deadline[2] = std::chrono::milliseconds(1000);
+    }
+
+    /**
+     * @brief Returns the process-wide scheduler, configured from the environment.
+     */
+    static IOScheduler& shared() {
+        static IOScheduler scheduler(
+            static_cast<size_t>(envDouble("HEARTY_IO_DEPTH", DEFAULT_IO_DEPTH)),
+            envDouble("HEARTY_IO_BG_RATE", 0) * 1024 * 1024,
+            envDouble("HEARTY_IO_FG_WRITE_RATE", 0) * 1024 * 1024,
+            envDouble("HEARTY_IO_READ_TARGET_MS", 0));
+        return scheduler;
+    }
+
+    /**
+     * @brief Blocks until an I/O of the given class and size may be issued.
+     */
+    void acquire(IOClass io_class, size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t index = static_cast<size_t>(io_class);
+        auto self = queue.insert(queue.end(),
+                                 Request{io_class, bytes, Clock::now() + class_deadline[index]});
+
+        bool background = io_class == IOClass::BACKGROUND;
+        double rate = 0;
+        while (true) {
+            Clock::time_point now = Clock::now();
+            double tokens = 0;
+            if (background) {
+                renewBackgroundRate(nanos(now));
+                adaptBackgroundRate(nanos(now));
+                refillBackground(nanos(now));
+                rate = backgroundRate(nanos(now));
+                tokens = static_cast<double>(host_state->background_tokens.load());
+            } else {
+                buckets[index].refill(now);
+                rate = buckets[index].rate;
+                tokens = buckets[index].tokens;
+            }
+
+            bool my_turn = in_flight < max_in_flight && pickNext(now) == self;
+            bool has_tokens = rate <= 0 || tokens > 0;
+            if (my_turn && has_tokens) {
+                break;
+            }
+
+            if (my_turn) {
+                // Wait for the bucket to refill enough for this request to go
+                double seconds = (std::min<double>(bytes, rate) - tokens) / rate;
+                dispatched.wait_for(lock, std::chrono::duration<double>(
+                    std::min(std::max(seconds, 0.001), 0.1)));
+            } else {
+                dispatched.wait_for(lock, std::chrono::milliseconds(10));
+            }
+        }
+
+        if (rate > 0) {
+            if (background) {
+                host_state->background_tokens.fetch_sub(static_cast<int64_t>(bytes));
+            } else {
+                buckets[index].tokens -= bytes;
+            }
+        }
+        queue.erase(self);
+        in_flight++;
+        dispatched.notify_all();
+    }
+
+    /**
+     * @brief Marks an I/O as complete.
+     *
+     * @param io_class Class the I/O was acquired for.
+     * @param latency_ms Time from acquire() to completion in milliseconds.
+     */
+    void release(IOClass io_class, double latency_ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight--;
+        if (io_class == IOClass::FOREGROUND_READ) {
+            // Recorded whatever this process's target, for processes doing background I/O
+            int64_t now = nanos(Clock::now());
+            size_t sample = host_state->next_sample.fetch_add(1) % LATENCY_WINDOW;
+            host_state->read_latency_us[sample].store(static_cast<int64_t>(latency_ms * 1000));
+            host_state->read_time[sample].store(now);
+            adaptBackgroundRate(now);
+        }
+        dispatched.notify_all();
+    }
+};
+
+/**
+ * @brief Scoped grant from the shared I/O scheduler; the I/O is considered complete
+ *        when the grant goes out of scope.
+ */
+class IOGrant {
+private:
+    IOClass io_class;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    IOGrant(IOClass cls, size_t bytes) : io_class(cls), start(std::chrono::steady_clock::now()) {
+        IOScheduler::shared().acquire(io_class, bytes);
+    }
+
+    ~IOGrant() {
+        double elapsed = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        IOScheduler::shared().release(io_class, elapsed);
+    }
+
+    IOGrant(const IOGrant&) = delete;
+    IOGrant& operator=(const IOGrant&) = delete;
+};
@@ -13,10 +13,15 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <set>
 #include "hearty-store-common.hpp"
+#include "hearty-store-rebuild.hpp"
 
 class StoreList {
 private:
+    std::set<int> spares;
+
+
     /**
      * @brief Helper function to retrieve and format the status of a store.
      * 
@@ -28,6 +33,15 @@ private:
         std::string status;
         if (metadata.is_destroyed) {
             status = "destroyed";
+            RebuildState rebuild;
+            if (metadata.ha_group_id != -1 && utils::loadRebuildState(metadata.ha_group_id, rebuild) &&
+                rebuild.store_id == metadata.store_id) {
+                status += " (rebuilding onto " + std::to_string(rebuild.spare_id) + ": " +
+                          std::to_string(rebuild.next_block) + "/" + std::to_string(NUM_BLOCKS) + " blocks)";
+            }
+        }
+        if (spares.count(metadata.store_id)) {
+            status += (status.empty() ? "" : ", ") + std::string("hot spare");
         }
         if (metadata.is_replica) {
             status += (status.empty() ? "" : ", ") + 
@@ -64,6 +78,9 @@ public:
      * @brief Lists all available stores and their metadata.
      */
     void list() {
+        std::vector<int> spare_ids = HotSpares::list();
+        spares = std::set<int>(spare_ids.begin(), spare_ids.end());
+
         if (!std::filesystem::exists(BASE_PATH)) {
             std::cout << "No stores found" << std::endl;
             return;
@@ -0,0 +1,158 @@
+/**
+ * @file hearty-store-ls.cpp
+ * @author Nathadon Samairat
+ * @brief Lists the objects of a store from its sorted on-disk index. Results can be
+ *        filtered by ID prefix and modification time, and are paginated so only the
+ *        returned page of index entries is read.
+ * @version 0.1
+ * @date 2024-12-02
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <limits>
+#include "hearty-store-common.hpp"
+#include "hearty-store-index.hpp"
+
+class StoreLs {
+private:
+    int store_id;
+
+    /**
+     * @brief Checks whether an object ID starts with the given prefix.
+     */
+    bool hasPrefix(const IndexEntry& entry, const std::string& prefix) {
+        return std::strncmp(entry.object_id, prefix.c_str(), prefix.size()) == 0;
+    }
+
+public:
+    StoreLs(int id) : store_id(id) {}
+
+    /**
+     * @brief Prints one page of objects matching the filters.
+     *
+     * With only a time filter the time-ordered index is walked from the first entry
+     * at or after `since`; otherwise the ID-ordered index is walked from `prefix`.
+     * If more matching objects remain, the arguments for the next page are printed
+     * to stderr.
+     *
+     * @param prefix Only list objects whose ID starts with this prefix.
+     * @param since Only list objects modified at or after this time.
+     * @param limit Maximum number of objects to print.
+     * @param after Resume after this object ID (from a previous page).
+     * @param out Output stream for the listing.
+     *
+     * @return true if the listing succeeds; false otherwise.
+     */
+    bool list(const std::string& prefix, time_t since, size_t limit,
+              const std::string& after, std::ostream& out) {
+        IndexOrder order = (prefix.empty() && since > 0) ? IndexOrder::BY_TIME
+                                                         : IndexOrder::BY_ID;
+        ObjectIndex index(store_id, order);
+        if (!index.open()) {
+            std::cerr << "Failed to open object index" << std::endl;
+            return false;
+        }
+
+        // Position at the first candidate entry
+        IndexEntry key{};
+        std::strncpy(key.object_id, (after > prefix ? after : prefix).c_str(), OBJECT_ID_SIZE - 1);
+        key.timestamp = since;
+        uint64_t pos = index.lowerBound(key);
+
+        StoreMetadata metadata;
+        bool hide_chunks = utils::loadStoreMetadata(store_id, metadata) && metadata.ha_group_id != -1;
+
+        size_t printed = 0;
+        IndexEntry entry;
+        for (; index.read(pos, entry); pos++) {
+            if (order == IndexOrder::BY_ID && !hasPrefix(entry, prefix)) {
+                break;  // Past the prefix range
+            }
+            if (!after.empty() && after == entry.object_id &&
+                (order == IndexOrder::BY_ID || entry.timestamp == since)) {
+                continue;  // Cursor entry was printed on the previous page
+            }
+            if (entry.timestamp < since) {
+                continue;
+            }
+            if (hide_chunks && utils::isStripeChunkId(entry.object_id)) {
+                continue;  // Chunk of a striped object, not an object of its own
+            }
+
+            if (printed == limit) {
+                // More results remain, report how to fetch the next page
+                // with the same filters
+                std::cerr << "More objects available, continue with:";
+                if (!prefix.empty()) {
+                    std::cerr << " --prefix " << prefix;
+                }
+                if (order == IndexOrder::BY_TIME) {
+                    std::cerr << " --since " << key.timestamp;
+                } else if (since > 0) {
+                    std::cerr << " --since " << since;
+                }
+                std::cerr << " --limit " << limit << " --after " << key.object_id << std::endl;
+                break;
+            }
+
+            out << entry.object_id << " " << entry.data_size << " "
+                << entry.timestamp << std::endl;
+            key = entry;
+            printed++;
+        }
+
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc < 2 || argc % 2 != 0) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [store-id] [--prefix P] [--since T] [--limit N] [--after ID]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+
+        std::string prefix;
+        std::string after;
+        time_t since = 0;
+        size_t limit = std::numeric_limits<size_t>::max();
+        for (int i = 2; i < argc; i += 2) {
+            std::string option = argv[i];
+            if (option == "--prefix") {
+                prefix = argv[i + 1];
+            } else if (option == "--since") {
+                since = std::stoll(argv[i + 1]);
+            } else if (option == "--limit") {
+                limit = std::stoull(argv[i + 1]);
+            } else if (option == "--after") {
+                after = argv[i + 1];
+            } else {
+                std::cerr << "Unknown option: " << option << std::endl;
+                return 1;
+            }
+        }
+
+        // Check if store exists
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreLs lister(store_id);
+        if (!lister.list(prefix, since, limit, after, std::cout)) {
+            return 1;
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,189 @@
+/**
+ * @file hearty-store-merkle.hpp
+ * @author Nathadon Samairat
+ * @brief Merkle tree over the blocks of a store, kept in merkle.bin next to the
+ *        metadata. Leaf i hashes block i's metadata record and its written data
+ *        (the first `extent` bytes; the rest is zero); every inner node hashes its
+ *        two children. StorePut refreshes the leaf of every block it changes, so two
+ *        stores hold the same blocks exactly when their roots match, and the
+ *        differing blocks are found by descending only into differing subtrees.
+ * @version 0.1
+ * @date 2024-12-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+
+const uint32_t MERKLE_MAGIC = 0x48534d54;    // "HSMT"
+const uint32_t MERKLE_VERSION = 1;
+
+struct MerkleHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+class MerkleTree {
+private:
+    int store_id;
+    // Heap layout: node 1 is the root, node n has children 2n and 2n + 1 and
+    // leaf i is node NUM_BLOCKS + i (NUM_BLOCKS is a power of two); node 0 is unused
+    std::vector<uint64_t> nodes;
+
+    void recomputeParents(size_t node) {
+        for (node /= 2; node >= 1; node /= 2) {
+            nodes[node] = utils::hash64(0, &nodes[2 * node], 2 * sizeof(uint64_t));
+        }
+    }
+
+public:
+    MerkleTree(int id) : store_id(id), nodes(2 * NUM_BLOCKS, 0) {}
+
+    /**
+     * @brief Hashes one block: its metadata record (field by field, so struct
+     *        padding is ignored) and its written data.
+     *
+     * @param block Metadata of the block.
+     * @param data The first `block.extent` bytes of the block.
+     */
+    static uint64_t leafHash(const BlockMetadata& block, const char* data) {
+        uint64_t h = utils::hash64(0, &block.is_used, sizeof(block.is_used));
+        h = utils::hash64(h, block.object_id, OBJECT_ID_SIZE);
+        h = utils::hash64(h, &block.data_size, sizeof(block.data_size));
+        h = utils::hash64(h, &block.timestamp, sizeof(block.timestamp));
+        h = utils::hash64(h, &block.checksum, sizeof(block.checksum));
+        h = utils::hash64(h, &block.extent, sizeof(block.extent));
+        return utils::hash64(h, data, std::min(block.extent, BLOCK_SIZE));
+    }
+
+    /**
+     * @brief Sets a leaf from the block's current metadata and data on disk and
+     *        updates the path to the root (10 hashes).
+     *
+     * @param block_num Index of the block.
+     * @param block Current metadata of the block.
+     *
+     * @return true if the block's data is read; false otherwise.
+     */
+    bool refresh(int block_num, const BlockMetadata& block) {
+        size_t extent = std::min(block.extent, BLOCK_SIZE);
+        BlockBuffer data;
+        if (extent > 0) {
+            std::shared_ptr<RawFile> data_file = io::openShared(utils::getDataPath(store_id));
+            if (!data_file ||
+                !data_file->readFull(data.data(), extent, static_cast<size_t>(block_num) * BLOCK_SIZE)) {
+                return false;
+            }
+        }
+        size_t leaf = NUM_BLOCKS + block_num;
+        nodes[leaf] = leafHash(block, data.data());
+        recomputeParents(leaf);
+        return true;
+    }
+
+    /**
+     * @brief Recomputes the whole tree from the store's metadata and data.
+     *
+     * @return true if every block is read; false otherwise.
+     */
+    bool rebuild() {
+        StoreMetadata store_metadata;
+        std::vector<BlockMetadata> block_metadata(NUM_BLOCKS);
+        RawFile file(utils::getMetadataPath(store_id), O_RDONLY);
+        std::vector<iovec> iov = utils::metadataIov(store_metadata, block_metadata);
+        if (!file.isOpen() || !file.readVec(iov, 0)) {
+            return false;
+        }
+
+        std::shared_ptr<RawFile> data_file = io::openShared(utils::getDataPath(store_id));
+        BlockBuffer data;
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            size_t extent = std::min(block_metadata[i].extent, BLOCK_SIZE);
+            if (extent > 0 && (!data_file || !data_file->readFull(data.data(), extent, i * BLOCK_SIZE))) {
+                return false;
+            }
+            nodes[NUM_BLOCKS + i] = leafHash(block_metadata[i], data.data());
+        }
+        for (size_t node = NUM_BLOCKS - 1; node >= 1; node--) {
+            nodes[node] = utils::hash64(0, &nodes[2 * node], 2 * sizeof(uint64_t));
+        }
+        return true;
+    }
+
+    /**
+     * @brief Loads the store's tree, building (and saving) it from the blocks if
+     *        merkle.bin is missing or invalid.
+     *
+     * @return true if the tree is loaded; false otherwise.
+     */
+    bool load() {
+        RawFile file(utils::getMerklePath(store_id), O_RDONLY);
+        MerkleHeader header;
+        std::vector<iovec> iov = {{&header, sizeof(header)},
+                                  {nodes.data(), nodes.size() * sizeof(uint64_t)}};
+        if (file.isOpen() && file.readVec(iov, 0) &&
+            header.magic == MERKLE_MAGIC && header.version == MERKLE_VERSION) {
+            return true;
+        }
+        return rebuild() && save();
+    }
+
+    /**
+     * @brief Saves the tree to the store's merkle.bin.
+     */
+    bool save() const {
+        return saveTo(store_id);
+    }
+
+    /**
+     * @brief Saves the tree as another store's tree, once that store has been made
+     *        a block-for-block copy of this one.
+     */
+    bool saveTo(int target_id) const {
+        MerkleHeader header{MERKLE_MAGIC, MERKLE_VERSION};
+        std::vector<iovec> iov = {{&header, sizeof(header)},
+                                  {const_cast<uint64_t*>(nodes.data()), nodes.size() * sizeof(uint64_t)}};
+        return io::replaceFile(utils::getMerklePath(target_id), iov);
+    }
+
+    uint64_t root() const { return nodes[1]; }
+
+    /**
+     * @brief Finds the blocks on which two trees differ, descending only into
+     *        subtrees whose hashes differ.
+     *
+     * @param a First tree.
+     * @param b Second tree.
+     * @param compared If given, receives the number of node pairs compared.
+     *
+     * @return Indexes of the differing blocks in ascending order.
+     */
+    static std::vector<int> diff(const MerkleTree& a, const MerkleTree& b, size_t* compared = nullptr) {
+        std::vector<int> blocks;
+        std::vector<size_t> pending = {1};
+        size_t count = 0;
+        while (!pending.empty()) {
+            size_t node = pending.back();
+            pending.pop_back();
+            count++;
+            if (a.nodes[node] == b.nodes[node]) continue;
+            if (node >= NUM_BLOCKS) {
+                blocks.push_back(static_cast<int>(node - NUM_BLOCKS));
+            } else {
+                pending.push_back(2 * node + 1);    // Left child popped first
+                pending.push_back(2 * node);
+            }
+        }
+        if (compared != nullptr) {
+            *compared = count;
+        }
+        return blocks;
+    }
+};
@@ -0,0 +1,167 @@
+/**
+ * @file hearty-store-metadata.hpp
+ * @author Nathadon Samairat
+ * @brief Lazy, paged reader of a store's metadata.bin for the read paths. The file
+ *        is a fixed-size header followed by fixed-size block records, so record i
+ *        lives at a computed offset and is read with the 4KB page that holds it.
+ *        Opening reads only the header; looking up an object binary-searches the
+ *        store's ID index (index-id.bin) for its block and reads that one page, so
+ *        the cost of a get does not grow with the number of blocks. Only metadata
+ *        without an ID index (snapshots) is scanned, one batch of pages at a time.
+ * @version 0.1
+ * @date 2024-12-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-index.hpp"
+
+const size_t METADATA_PAGE_SIZE = 4096;
+const size_t METADATA_PAGE_RECORDS = METADATA_PAGE_SIZE / sizeof(BlockMetadata);
+const size_t METADATA_SCAN_PAGES = 16;     // Pages read per call while scanning
+
+class MetadataReader {
+private:
+    std::string path;
+    int index_store_id;     // Store whose ID index matches this file, or -1
+    RawFile file;
+    StoreMetadata header;
+    std::unordered_map<size_t, std::vector<BlockMetadata>> pages;
+
+    /**
+     * @brief Reads `count` records starting at `first`, clipped to the store.
+     */
+    bool readRecords(size_t first, size_t count, std::vector<BlockMetadata>& records) {
+        count = std::min(count, header.total_blocks - first);
+        records.resize(count);
+        return file.readFull(reinterpret_cast<char*>(records.data()), count * sizeof(BlockMetadata),
+                             sizeof(StoreMetadata) + first * sizeof(BlockMetadata));
+    }
+
+    /**
+     * @brief Searches the ID index for an object's block.
+     *
+     * @return The block number, or -1 if the index does not list the object.
+     */
+    int lookupIndex(const std::string& object_id) {
+        ObjectIndex index(index_store_id, IndexOrder::BY_ID);
+        if (!index.open()) return -1;
+
+        IndexEntry probe{};
+        std::strncpy(probe.object_id, object_id.c_str(), OBJECT_ID_SIZE - 1);
+        IndexEntry entry;
+        if (!index.read(index.lowerBound(probe), entry) || object_id != entry.object_id) {
+            return -1;
+        }
+        return entry.block_num;
+    }
+
+    /**
+     * @brief Checks that the ID index was written no earlier than the metadata, so
+     *        it lists every committed object. Puts commit the metadata before they
+     *        list the object, so an index whose update failed (or has not happened
+     *        yet) is older.
+     */
+    bool indexCurrent() const {
+        struct stat index_st;
+        struct stat metadata_st;
+        if (::stat(utils::getIndexPath(index_store_id, IndexOrder::BY_ID).c_str(), &index_st) != 0 ||
+            ::stat(path.c_str(), &metadata_st) != 0) {
+            return false;
+        }
+        return index_st.st_mtim.tv_sec > metadata_st.st_mtim.tv_sec ||
+               (index_st.st_mtim.tv_sec == metadata_st.st_mtim.tv_sec &&
+                index_st.st_mtim.tv_nsec >= metadata_st.st_mtim.tv_nsec);
+    }
+
+public:
+    /**
+     * @param metadata_path Path of the metadata file.
+     * @param store_id Store whose ID index describes the file (the live metadata),
+     *                 or -1 if there is none (a snapshot's copy).
+     */
+    MetadataReader(const std::string& metadata_path, int store_id)
+        : path(metadata_path), index_store_id(store_id), header{} {}
+
+    /**
+     * @brief Opens the file and reads its header; no block record is read.
+     *
+     * @return true if the header is read; false otherwise.
+     */
+    bool open() {
+        file = RawFile(path, O_RDONLY);
+        return file.isOpen() &&
+               file.readFull(reinterpret_cast<char*>(&header), sizeof(StoreMetadata), 0) &&
+               header.total_blocks <= NUM_BLOCKS;
+    }
+
+    const StoreMetadata& store() const { return header; }
+
+    /**
+     * @brief Reads one block record, loading (and keeping) the page holding it.
+     *
+     * @return true if the record is read; false otherwise.
+     */
+    bool block(size_t block_num, BlockMetadata& record) {
+        if (block_num >= header.total_blocks) return false;
+
+        size_t page = block_num / METADATA_PAGE_RECORDS;
+        auto found = pages.find(page);
+        if (found == pages.end()) {
+            std::vector<BlockMetadata> records;
+            if (!readRecords(page * METADATA_PAGE_RECORDS, METADATA_PAGE_RECORDS, records)) {
+                return false;
+            }
+            found = pages.emplace(page, std::move(records)).first;
+        }
+        record = found->second[block_num % METADATA_PAGE_RECORDS];
+        return true;
+    }
+
+    /**
+     * @brief Finds the block holding an object. With an ID index only the index
+     *        and one page are read; a miss is trusted only while the index is at
+     *        least as new as the metadata, otherwise the object may have been
+     *        committed without being listed. Without an index, or with a stale
+     *        one, the records are scanned in batches.
+     *
+     * @param object_id ID of the object.
+     * @param record Receives the block's record.
+     *
+     * @return The block number, or -1 if the object is not in the store.
+     */
+    int find(const std::string& object_id, BlockMetadata& record) {
+        if (index_store_id != -1) {
+            int block_num = lookupIndex(object_id);
+            if (block_num >= 0 && block(block_num, record) &&
+                record.is_used && object_id == record.object_id) {
+                return block_num;
+            }
+            if (block_num == -1 && indexCurrent()) {
+                return -1;
+            }
+            // The index is missing or stale for this object: fall back to a scan
+        }
+
+        std::vector<BlockMetadata> records;
+        size_t batch = METADATA_PAGE_RECORDS * METADATA_SCAN_PAGES;
+        for (size_t first = 0; first < header.total_blocks; first += batch) {
+            if (!readRecords(first, batch, records)) return -1;
+            for (size_t i = 0; i < records.size(); i++) {
+                if (records[i].is_used && object_id == records[i].object_id) {
+                    record = records[i];
+                    return static_cast<int>(first + i);
+                }
+            }
+        }
+        return -1;
+    }
+};
@@ -0,0 +1,410 @@
+/**
+ * @file hearty-store-parity-buffer.hpp
+ * @author Nathadon Samairat
+ * @brief Stripe write-back buffer for HA parity. Instead of a read-modify-write of
+ *        parity.bin per put, the XOR deltas of consecutive puts are accumulated per
+ *        stripe (block index) in memory and every dirty parity block is written
+ *        once, when the buffer holds too many stripes or its oldest delta is older
+ *        than the flush deadline.
+ *
+ *        Buffered deltas are protected by a per-process journal,
+ *        /tmp/ha_group_<id>/journal/<pid>.bin. Every delta is appended before its
+ *        put commits. A flush first appends the new contents of the dirty parity
+ *        ranges followed by a commit record, then writes them to parity.bin and
+ *        truncates the journal. Replaying the journal of a dead process therefore
+ *        either re-writes the committed images (idempotent) or applies the deltas
+ *        that were never flushed. Degraded reads overlay the deltas still held in
+ *        the journals of live processes, so they never see stale parity. The
+ *        journal is synced at the HEARTY_SYNC level, like every other commit.
+ *
+ *        Deltas are merged per stripe, whichever member of the group they come
+ *        from: the chunks of one object, and puts into different members at the
+ *        same block index (batch-put --spread aims the puts of a partial stripe at
+ *        one index). Puts into a single store take different blocks, so their
+ *        deltas are not merged, but all dirty stripes are written in one flush.
+ *
+ *        Buffering is off unless a tool enables it (hearty-store-batch-put does).
+ *        Limits come from HEARTY_PARITY_BUFFER_STRIPES (default 32) and
+ *        HEARTY_PARITY_FLUSH_MS (default 200).
+ * @version 0.1
+ * @date 2024-12-11
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <signal.h>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-iosched.hpp"
+
+const uint32_t JOURNAL_MAGIC = 0x48534a52;     // "HSJR"
+const size_t DEFAULT_BUFFER_STRIPES = 32;
+const size_t DEFAULT_FLUSH_MS = 200;
+
+enum JournalRecordType : uint32_t {
+    JOURNAL_DELTA = 1,      // XOR delta not yet applied to parity.bin
+    JOURNAL_IMAGE = 2,      // New contents of a parity range being flushed
+    JOURNAL_COMMIT = 3      // All images of a flush are in the journal
+};
+
+struct JournalRecord {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t offset;        // Byte offset within parity.bin
+    uint64_t length;        // Bytes of payload that follow
+    uint32_t crc;           // CRC32 of the payload
+};
+
+namespace journal {
+    inline std::string getJournalDir(int ha_group_id) {
+        return utils::getHAPath(ha_group_id) + PARITY_JOURNAL_DIR;
+    }
+
+    /**
+     * @brief Reads the complete records of a journal; a torn tail is ignored.
+     */
+    inline void readRecords(const std::string& path,
+                            std::vector<std::pair<JournalRecord, std::vector<char>>>& records) {
+        std::ifstream file(path, std::ios::binary);
+        JournalRecord record;
+        while (file.read(reinterpret_cast<char*>(&record), sizeof(JournalRecord))) {
+            if (record.magic != JOURNAL_MAGIC || record.length > BLOCK_SIZE) break;
+            std::vector<char> payload(record.length);
+            if (!file.read(payload.data(), payload.size()) ||
+                utils::crc32(0, payload.data(), payload.size()) != record.crc) {
+                break;
+            }
+            records.emplace_back(record, std::move(payload));
+        }
+    }
+
+    /**
+     * @brief Checks whether the process that owns a journal is still running.
+     */
+    inline bool ownerAlive(const std::filesystem::path& path) {
+        try {
+            pid_t pid = static_cast<pid_t>(std::stol(path.stem().string()));
+            return pid == getpid() || kill(pid, 0) == 0;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    /**
+     * @brief Replays the journals of processes that died with buffered parity
+     *        deltas, then deletes them. The caller must hold the parity file lock.
+     */
+    inline void replayOrphans(int ha_group_id) {
+        std::string dir = getJournalDir(ha_group_id);
+        if (!std::filesystem::exists(dir)) return;
+
+        std::string parity_path = utils::getHAPath(ha_group_id) + PARITY_FILENAME;
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (ownerAlive(entry.path())) continue;
+
+            std::vector<std::pair<JournalRecord, std::vector<char>>> records;
+            readRecords(entry.path().string(), records);
+            bool committed = !records.empty() && records.back().first.type == JOURNAL_COMMIT;
+
+            std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+            bool replayed = parity_file != nullptr;
+            for (auto& [record, payload] : records) {
+                if (!replayed) break;
+                if (committed && record.type == JOURNAL_IMAGE) {
+                    replayed = parity_file->writeAt(payload.data(), payload.size(), record.offset);
+                } else if (!committed && record.type == JOURNAL_DELTA) {
+                    std::vector<char> parity(payload.size());
+                    replayed = parity_file->readFull(parity.data(), parity.size(), record.offset);
+                    utils::xorInto(parity.data(), payload.data(), payload.size());
+                    replayed = replayed &&
+                               parity_file->writeAt(parity.data(), parity.size(), record.offset);
+                }
+            }
+            if (replayed && parity_file->sync(io::commitDurability())) {
+                std::filesystem::remove(entry.path());
+            }
+        }
+    }
+
+    /**
+     * @brief XORs the deltas still buffered by live processes into a parity range
+     *        read from parity.bin. The caller must hold the parity file lock.
+     *
+     * @param ha_group_id Group of the parity file.
+     * @param offset Byte offset of the range within parity.bin.
+     * @param parity The range as read from parity.bin; updated in place.
+     * @param length Length of the range.
+     */
+    inline void overlayPending(int ha_group_id, size_t offset, char* parity, size_t length) {
+        std::string dir = getJournalDir(ha_group_id);
+        if (!std::filesystem::exists(dir)) return;
+
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            std::vector<std::pair<JournalRecord, std::vector<char>>> records;
+            readRecords(entry.path().string(), records);
+            for (auto& [record, payload] : records) {
+                if (record.type != JOURNAL_DELTA) continue;
+                size_t begin = std::max<size_t>(offset, record.offset);
+                size_t end = std::min<size_t>(offset + length, record.offset + record.length);
+                if (begin < end) {
+                    utils::xorInto(parity + (begin - offset),
+                                   payload.data() + (begin - record.offset), end - begin);
+                }
+            }
+        }
+    }
+}
+
+class ParityBuffer {
+private:
+    struct DirtyStripe {
+        std::vector<char> delta;    // XOR delta from the start of the stripe
+        size_t low;                 // First dirty byte within the stripe
+        std::chrono::steady_clock::time_point since;
+    };
+
+    int ha_group_id;
+    std::string parity_path;
+    std::string journal_path;
+    int journal_fd = -1;
+    std::mutex mutex;
+    std::map<size_t, DirtyStripe> stripes;
+    size_t max_stripes;
+    std::chrono::milliseconds flush_after;
+    size_t deltas_added = 0;        // Deltas journaled
+    size_t ranges_written = 0;      // Parity ranges written to parity.bin
+
+    static bool& enabled() {
+        static bool on = false;
+        return on;
+    }
+
+    static std::map<int, std::unique_ptr<ParityBuffer>>& registry() {
+        static std::map<int, std::unique_ptr<ParityBuffer>> buffers;
+        return buffers;
+    }
+
+    static std::mutex& registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static size_t envSize(const char* name, size_t fallback) {
+        const char* value = std::getenv(name);
+        if (value == nullptr) return fallback;
+        try {
+            long parsed = std::stol(value);
+            return parsed > 0 ? static_cast<size_t>(parsed) : fallback;
+        } catch (const std::exception&) {
+            return fallback;
+        }
+    }
+
+    bool appendRecord(uint32_t type, size_t offset, const char* payload, size_t length) {
+        JournalRecord record{JOURNAL_MAGIC, type, offset, length,
+                             utils::crc32(0, payload, length)};
+        return write(journal_fd, &record, sizeof(record)) == static_cast<ssize_t>(sizeof(record)) &&
+               write(journal_fd, payload, length) == static_cast<ssize_t>(length);
+    }
+
+    /**
+     * @brief Writes every dirty parity range once and empties the buffer.
+     *        The caller must hold `mutex`.
+     */
+    bool flushLocked() {
+        if (stripes.empty()) return true;
+
+        FileLock lock(parity_path);
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        if (!lock.locked() || !parity_file) {
+            return false;
+        }
+
+        // New parity contents, journaled before parity.bin is touched
+        std::vector<std::pair<size_t, std::vector<char>>> images;
+        for (auto& [block, stripe] : stripes) {
+            size_t offset = block * BLOCK_SIZE + stripe.low;
+            std::vector<char> image(stripe.delta.size() - stripe.low);
+            if (!parity_file->readFull(image.data(), image.size(), offset)) {
+                return false;
+            }
+            utils::xorInto(image.data(), stripe.delta.data() + stripe.low, image.size());
+            if (!appendRecord(JOURNAL_IMAGE, offset, image.data(), image.size())) {
+                return false;
+            }
+            images.emplace_back(offset, std::move(image));
+        }
+        if (!appendRecord(JOURNAL_COMMIT, 0, nullptr, 0) ||
+            !RawFile::syncDescriptor(journal_fd, io::commitDurability())) {
+            return false;
+        }
+
+        for (auto& [offset, image] : images) {
+            IOGrant grant(IOClass::FOREGROUND_WRITE, image.size());
+            if (!parity_file->writeAt(image.data(), image.size(), offset)) {
+                return false;
+            }
+        }
+        if (!parity_file->sync(io::commitDurability())) {
+            return false;
+        }
+
+        ranges_written += images.size();
+        stripes.clear();
+        return ftruncate(journal_fd, 0) == 0 && lseek(journal_fd, 0, SEEK_SET) == 0;
+    }
+
+public:
+    ParityBuffer(int group_id)
+        : ha_group_id(group_id),
+          parity_path(utils::getHAPath(group_id) + PARITY_FILENAME),
+          max_stripes(envSize("HEARTY_PARITY_BUFFER_STRIPES", DEFAULT_BUFFER_STRIPES)),
+          flush_after(envSize("HEARTY_PARITY_FLUSH_MS", DEFAULT_FLUSH_MS)) {
+        std::filesystem::create_directories(journal::getJournalDir(group_id));
+        journal_path = journal::getJournalDir(group_id) + "/" + std::to_string(getpid()) + ".bin";
+        {
+            FileLock lock(parity_path);
+            journal::replayOrphans(group_id);
+        }
+        journal_fd = open(journal_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    ~ParityBuffer() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (flushLocked() && journal_fd >= 0) {
+            std::filesystem::remove(journal_path);
+        }
+        if (journal_fd >= 0) {
+            close(journal_fd);
+        }
+    }
+
+    ParityBuffer(const ParityBuffer&) = delete;
+    ParityBuffer& operator=(const ParityBuffer&) = delete;
+
+    /**
+     * @brief Turns on parity buffering for this process.
+     */
+    static void enable() {
+        enabled() = true;
+    }
+
+    /**
+     * @brief Returns the buffer of an HA group, or nullptr when buffering is off.
+     */
+    static ParityBuffer* forGroup(int ha_group_id) {
+        if (!enabled()) return nullptr;
+        std::lock_guard<std::mutex> guard(registryMutex());
+        auto& buffer = registry()[ha_group_id];
+        if (!buffer) {
+            buffer = std::make_unique<ParityBuffer>(ha_group_id);
+        }
+        return buffer.get();
+    }
+
+    /**
+     * @brief Flushes the buffers of every group.
+     *
+     * @return true if every buffer is flushed; false otherwise.
+     */
+    static bool flushAll() {
+        std::lock_guard<std::mutex> guard(registryMutex());
+        bool ok = true;
+        for (auto& [group_id, buffer] : registry()) {
+            ok = buffer->flush() && ok;
+        }
+        return ok;
+    }
+
+    /**
+     * @brief Prints how many parity deltas the buffers of this process merged into
+     *        how many parity writes, if any were buffered.
+     */
+    static void report(std::ostream& out) {
+        std::lock_guard<std::mutex> guard(registryMutex());
+        size_t deltas = 0;
+        size_t writes = 0;
+        for (auto& [group_id, buffer] : registry()) {
+            std::lock_guard<std::mutex> buffer_guard(buffer->mutex);
+            deltas += buffer->deltas_added;
+            writes += buffer->ranges_written;
+        }
+        if (deltas > 0) {
+            out << "Coalesced " << deltas << " parity updates into " << writes << " parity writes" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Journals a parity delta and merges it into its stripe. Flushes when the
+     *        buffer is full or its oldest stripe has passed the deadline.
+     *
+     * @param offset Byte offset of the delta within parity.bin.
+     * @param delta XOR of old and new data; must not cross a block boundary.
+     *
+     * @return true if the delta is journaled (and any due flush succeeded).
+     */
+    bool add(size_t offset, const std::vector<char>& delta) {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (journal_fd < 0) {
+            return false;
+        }
+        {
+            // Degraded readers read the journals under the parity lock
+            FileLock lock(parity_path);
+            if (!appendRecord(JOURNAL_DELTA, offset, delta.data(), delta.size())) {
+                return false;
+            }
+        }
+        deltas_added++;
+
+        size_t block = offset / BLOCK_SIZE;
+        size_t start = offset % BLOCK_SIZE;
+        auto [it, inserted] = stripes.try_emplace(block);
+        DirtyStripe& stripe = it->second;
+        if (inserted) {
+            stripe.low = start;
+            stripe.since = std::chrono::steady_clock::now();
+        }
+        if (stripe.delta.size() < start + delta.size()) {
+            stripe.delta.resize(start + delta.size(), 0);
+        }
+        stripe.low = std::min(stripe.low, start);
+        utils::xorInto(stripe.delta.data() + start, delta.data(), delta.size());
+
+        bool full = stripes.size() > max_stripes;
+        bool due = false;
+        for (const auto& [index, dirty] : stripes) {
+            due = due || std::chrono::steady_clock::now() - dirty.since >= flush_after;
+        }
+        return (full || due) ? flushLocked() : true;
+    }
+
+    /**
+     * @brief Makes the journaled deltas durable at the HEARTY_SYNC level; called
+     *        before a put commits.
+     */
+    bool sync() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return journal_fd >= 0 && RawFile::syncDescriptor(journal_fd, io::commitDurability());
+    }
+
+    /**
+     * @brief Writes every dirty parity range now.
+     */
+    bool flush() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return flushLocked();
+    }
+};
@@ -0,0 +1,155 @@
+/**
+ * @file hearty-store-pool.cpp
+ * @author Nathadon Samairat
+ * @brief Manages storage pools: one key namespace sharded over many stores by
+ *        rendezvous hashing. Puts and gets of several keys run in parallel across
+ *        the member stores.
+ * @version 0.1
+ * @date 2024-12-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <future>
+#include "hearty-store-common.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-pool.hpp"
+
+/**
+ * @brief Stores key/file pairs in parallel.
+ *
+ * @return true if every object is stored; false otherwise.
+ */
+bool putMany(StorePool& pool, const std::vector<std::string>& args) {
+    std::vector<std::future<bool>> results;
+    for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        std::string key = args[i];
+        std::string file_path = args[i + 1];
+        results.push_back(Executor::shared().submit([&pool, key, file_path] {
+            return pool.put(key, file_path);
+        }));
+    }
+
+    bool all_ok = true;
+    for (size_t i = 0; i < results.size(); i++) {
+        bool ok = Executor::shared().wait(results[i]);
+        if (ok) {
+            std::cout << args[2 * i] << " " << pool.ownerOf(args[2 * i]) << std::endl;
+        }
+        all_ok = all_ok && ok;
+    }
+    return all_ok;
+}
+
+/**
+ * @brief Reads keys in parallel and writes their data in argument order.
+ *
+ * @return true if every object is read; false otherwise.
+ */
+bool getMany(StorePool& pool, const std::vector<std::string>& keys, std::ostream& out) {
+    std::vector<std::future<std::pair<bool, std::string>>> results;
+    for (const std::string& key : keys) {
+        results.push_back(Executor::shared().submit([&pool, key] {
+            std::ostringstream buffer;
+            bool ok = pool.get(key, buffer);
+            return std::make_pair(ok, buffer.str());
+        }));
+    }
+
+    bool all_ok = true;
+    for (auto& result : results) {
+        auto [ok, data] = Executor::shared().wait(result);
+        if (ok) {
+            out.write(data.data(), data.size());
+        }
+        all_ok = all_ok && ok;
+    }
+    return all_ok;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [pool-id] create [store-id...]" << std::endl
+              << "       " << program << " [pool-id] add [store-id]" << std::endl
+              << "       " << program << " [pool-id] put [key file-path]..." << std::endl
+              << "       " << program << " [pool-id] get [key...]" << std::endl
+              << "       " << program << " [pool-id] rm [key]" << std::endl
+              << "       " << program << " [pool-id] members" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        int pool_id = std::stoi(argv[1]);
+        std::string command = argv[2];
+        std::vector<std::string> args(argv + 3, argv + argc);
+        StorePool pool(pool_id);
+
+        if (command == "create" && !args.empty()) {
+            std::vector<int> store_ids;
+            for (const std::string& arg : args) {
+                store_ids.push_back(std::stoi(arg));
+            }
+            if (!pool.create(store_ids)) {
+                return 1;
+            }
+            std::cout << "Successfully created pool " << pool_id << std::endl;
+            return 0;
+        }
+
+        bool known = (command == "add" && args.size() == 1) ||
+                     (command == "put" && !args.empty() && args.size() % 2 == 0) ||
+                     (command == "get" && !args.empty()) ||
+                     (command == "rm" && args.size() == 1) ||
+                     (command == "members" && args.empty());
+        if (!known) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        if (!pool.load()) {
+            return 1;
+        }
+
+        if (command == "add") {
+            int moved = pool.add(std::stoi(args[0]));
+            if (moved < 0) {
+                std::cerr << "Failed to add store " << args[0]
+                          << " (run the same add again to finish moving its keys)" << std::endl;
+                return 1;
+            }
+            std::cout << "Added store " << args[0] << " to pool " << pool_id
+                      << " (" << moved << " objects moved)" << std::endl;
+        } else if (command == "put") {
+            if (!putMany(pool, args)) {
+                return 1;
+            }
+        } else if (command == "get") {
+            if (!getMany(pool, args, std::cout)) {
+                return 1;
+            }
+        } else if (command == "rm") {
+            if (!pool.remove(args[0])) {
+                return 1;
+            }
+            std::cout << "Removed " << args[0] << std::endl;
+        } else {
+            for (int store_id : pool.getMembers()) {
+                std::cout << store_id << std::endl;
+            }
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
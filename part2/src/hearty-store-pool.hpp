@@ -0,0 +1,370 @@
+/**
+ * @file hearty-store-pool.hpp
+ * @author Nathadon Samairat
+ * @brief StorePool spreads one namespace of caller-chosen keys over many stores.
+ *        Each key is owned by the member with the highest rendezvous (highest
+ *        random weight) hash for it, so adding a store only moves the keys the new
+ *        store wins, about 1/N of them. Members are recorded in
+ *        /tmp/pool_<id>/members.bin and the keys put through the pool in
+ *        /tmp/pool_<id>/keys.bin, both updated under a lock on the pool directory.
+ *        Only those keys are ever moved, so objects put into a member store
+ *        directly stay where they are.
+ * @version 0.1
+ * @date 2024-12-08
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-get.hpp"
+
+class StorePool {
+private:
+    int pool_id;
+    std::vector<int> members;
+
+    /**
+     * @brief Mixes a 64-bit value (splitmix64 finalizer).
+     */
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    /**
+     * @brief Rendezvous weight of a key on a member store.
+     */
+    static uint64_t weight(const std::string& key, int store_id) {
+        uint64_t hash = 0xcbf29ce484222325ULL;     // FNV-1a
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        return mix(hash ^ mix(static_cast<uint64_t>(store_id)));
+    }
+
+    /**
+     * @brief Writes the member list to the pool's members file.
+     */
+    bool saveMembers() {
+        std::string path = utils::getPoolPath(pool_id) + POOL_MEMBERS_FILENAME;
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            int count = static_cast<int>(members.size());
+            file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            file.write(reinterpret_cast<const char*>(members.data()), count * sizeof(int));
+            if (!file) return false;
+        }
+        std::filesystem::rename(temp_path, path);
+        return true;
+    }
+
+    /**
+     * @brief Loads the keys put through the pool, in ascending order.
+     */
+    std::vector<std::string> loadKeys() {
+        std::vector<std::string> keys;
+        std::ifstream file(utils::getPoolPath(pool_id) + POOL_KEYS_FILENAME, std::ios::binary);
+        char key[OBJECT_ID_SIZE];
+        while (file.read(key, OBJECT_ID_SIZE)) {
+            keys.emplace_back(key, strnlen(key, OBJECT_ID_SIZE));
+        }
+        return keys;
+    }
+
+    /**
+     * @brief Adds a key to, or drops it from, the pool's key list. Takes the pool lock.
+     *
+     * @param key Key to update.
+     * @param present true to add the key, false to drop it.
+     *
+     * @return true if the key list is saved; false otherwise.
+     */
+    bool recordKey(const std::string& key, bool present) {
+        FileLock pool_lock(utils::getPoolPath(pool_id));
+        std::vector<std::string> keys = loadKeys();
+        auto it = std::lower_bound(keys.begin(), keys.end(), key);
+        bool found = it != keys.end() && *it == key;
+        if (found == present) {
+            return true;
+        }
+        if (present) {
+            keys.insert(it, key);
+        } else {
+            keys.erase(it);
+        }
+
+        std::vector<char> records(keys.size() * OBJECT_ID_SIZE, '\0');
+        for (size_t i = 0; i < keys.size(); i++) {
+            std::strncpy(&records[i * OBJECT_ID_SIZE], keys[i].c_str(), OBJECT_ID_SIZE - 1);
+        }
+        std::vector<iovec> iov = {{records.data(), records.size()}};
+        if (!io::replaceFile(utils::getPoolPath(pool_id) + POOL_KEYS_FILENAME, iov)) {
+            std::cerr << "Failed to update the keys of pool " << pool_id << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Finds the member holding a key: its owner, or another member if a
+     *        move is in progress or was interrupted.
+     *
+     * @param block_num Receives the block holding the object.
+     *
+     * @return The member store, or -1 if no member has the key.
+     */
+    int holderOf(const std::string& key, int& block_num) const {
+        int owner = ownerOf(key);
+        if ((block_num = findBlock(owner, key)) != -1) {
+            return owner;
+        }
+        for (int store_id : members) {
+            if (store_id != owner && (block_num = findBlock(store_id, key)) != -1) {
+                return store_id;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Finds the block holding an object through the store's ID index.
+     *
+     * @return The block number, or -1 if the store has no such object.
+     */
+    static int findBlock(int store_id, const std::string& key) {
+        ObjectIndex index(store_id, IndexOrder::BY_ID);
+        if (!index.open()) return -1;
+
+        IndexEntry probe{};
+        std::strncpy(probe.object_id, key.c_str(), OBJECT_ID_SIZE - 1);
+        IndexEntry entry;
+        if (!index.read(index.lowerBound(probe), entry) || key != entry.object_id) {
+            return -1;
+        }
+        return entry.block_num;
+    }
+
+    /**
+     * @brief Moves the pool's keys held by one member that are now owned by another
+     *        member. A key the owner already holds (copied by an interrupted move) is
+     *        only dropped from the source, so a move can always be rerun.
+     *
+     * @param source_id Member to move objects away from.
+     * @param keys Keys put through the pool.
+     *
+     * @return The number of objects moved, or -1 on failure.
+     */
+    int moveMisplaced(int source_id, const std::vector<std::string>& keys) {
+        StorePut source_put(source_id);
+        int moved = 0;
+        for (const std::string& key : keys) {
+            int target_id = ownerOf(key);
+            int block_num = findBlock(source_id, key);
+            if (target_id == source_id || block_num == -1) {
+                continue;
+            }
+
+            if (findBlock(target_id, key) == -1) {
+                std::stringstream data;
+                StoreGet source_get(source_id);
+                if (!source_get.get(key, data)) {
+                    return -1;
+                }
+                StorePut target_put(target_id);
+                if (target_put.put(data, key).empty()) {
+                    return -1;
+                }
+            }
+            if (!source_put.removeAt(block_num)) {
+                return -1;
+            }
+            moved++;
+        }
+
+        if (moved > 0 && !source_put.syncReplica()) {
+            std::cerr << "Warning: Failed to sync replica of store " << source_id << std::endl;
+        }
+        return moved;
+    }
+
+public:
+    StorePool(int id) : pool_id(id) {}
+
+    /**
+     * @brief Creates a pool over the given stores.
+     *
+     * @return true if the pool is created; false if it exists or a store is missing.
+     */
+    bool create(const std::vector<int>& store_ids) {
+        if (std::filesystem::exists(utils::getPoolPath(pool_id))) {
+            std::cerr << "Pool " << pool_id << " already exists" << std::endl;
+            return false;
+        }
+        for (int store_id : store_ids) {
+            if (!utils::storeExists(store_id)) {
+                std::cerr << "Store " << store_id << " does not exist" << std::endl;
+                return false;
+            }
+        }
+
+        std::filesystem::create_directories(utils::getPoolPath(pool_id));
+        members = store_ids;
+        std::sort(members.begin(), members.end());
+        members.erase(std::unique(members.begin(), members.end()), members.end());
+        return saveMembers();
+    }
+
+    /**
+     * @brief Loads the pool's member list.
+     *
+     * @return true if the pool exists and has at least one member; false otherwise.
+     */
+    bool load() {
+        std::ifstream file(utils::getPoolPath(pool_id) + POOL_MEMBERS_FILENAME, std::ios::binary);
+        if (!file) {
+            std::cerr << "Pool " << pool_id << " does not exist" << std::endl;
+            return false;
+        }
+
+        int count = 0;
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        members.resize(std::max(0, count));
+        file.read(reinterpret_cast<char*>(members.data()), members.size() * sizeof(int));
+        return file && !members.empty();
+    }
+
+    const std::vector<int>& getMembers() const { return members; }
+
+    /**
+     * @brief Returns the member store that owns a key.
+     */
+    int ownerOf(const std::string& key) const {
+        int owner = members[0];
+        uint64_t best = weight(key, owner);
+        for (int store_id : members) {
+            uint64_t w = weight(key, store_id);
+            if (w > best || (w == best && store_id < owner)) {
+                best = w;
+                owner = store_id;
+            }
+        }
+        return owner;
+    }
+
+    /**
+     * @brief Stores a file under a key on the member that owns the key.
+     *
+     * @return true if the object is stored; false otherwise.
+     */
+    bool put(const std::string& key, const std::string& file_path) {
+        // Record the key first, so a key is never stored without being listed
+        if (!recordKey(key, true)) {
+            return false;
+        }
+        StorePut store_put(ownerOf(key));
+        return !store_put.put(file_path, key).empty();
+    }
+
+    /**
+     * @brief Reads the object stored under a key. If the owner does not have it
+     *        (a move is in progress or was interrupted), the other members are tried.
+     */
+    bool get(const std::string& key, std::ostream& out) {
+        int block_num;
+        int holder = holderOf(key, block_num);
+        StoreGet store_get(holder == -1 ? ownerOf(key) : holder);
+        return store_get.get(key, out);
+    }
+
+    /**
+     * @brief Removes the object stored under a key, from whichever member holds it
+     *        (the same fallback as get()).
+     *
+     * @return true if the object is removed; false if it does not exist.
+     */
+    bool remove(const std::string& key) {
+        int block_num;
+        int holder = holderOf(key, block_num);
+        if (holder == -1) {
+            std::cerr << "Object not found: " << key << std::endl;
+            return false;
+        }
+
+        StorePut store_put(holder);
+        if (!store_put.removeAt(block_num) || !store_put.syncReplica()) {
+            return false;
+        }
+        return recordKey(key, false);
+    }
+
+    /**
+     * @brief Adds a store to the pool and moves the keys it now owns onto it.
+     *        Existing members are drained in parallel under the pool lock. The
+     *        member is recorded before anything moves and every move can be rerun,
+     *        so a failed or interrupted add is finished by adding the store again;
+     *        meanwhile get() and remove() find keys on their previous member.
+     *
+     * @param store_id Store to add.
+     *
+     * @return The number of objects moved, or -1 on failure.
+     */
+    int add(int store_id) {
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return -1;
+        }
+
+        FileLock pool_lock(utils::getPoolPath(pool_id));
+        if (!load()) {
+            return -1;
+        }
+        std::vector<std::string> keys = loadKeys();
+
+        std::vector<int> previous;
+        for (int member : members) {
+            if (member != store_id) previous.push_back(member);
+        }
+        if (previous.size() == members.size()) {
+            members.push_back(store_id);
+            std::sort(members.begin(), members.end());
+            if (!saveMembers()) {
+                return -1;
+            }
+        }
+
+        std::vector<int> moved(previous.size(), 0);
+        bool ok = Executor::shared().parallelFor(previous.size(), 1,
+                                                 [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                moved[i] = moveMisplaced(previous[i], keys);
+                if (moved[i] < 0) return false;
+            }
+            return true;
+        });
+        if (!ok) {
+            return -1;
+        }
+
+        int total = 0;
+        for (int count : moved) total += count;
+        return total;
+    }
+};
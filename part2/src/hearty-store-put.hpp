@@ -0,0 +1,1048 @@
+/**
+ * @file hearty-store-put.hpp
+ * @author Nathadon Samairat
+ * @brief StorePut writes objects into a store's blocks and keeps the parity,
+ *        object indexes and replica of the store up to date. Shared by
+ *        hearty-store-put and the tools that write objects into stores.
+ * @version 0.1
+ * @date 2024-11-27
+ * 
+ * @copyright Copyright (c) 2024
+ * 
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <unordered_set>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-merkle.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-filter.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-parity-buffer.hpp"
+
+const size_t REPLICA_COPY_GRAIN = 4;    // Blocks copied per replica sync task
+
+// An object stored by StorePut::putBatch under its own ID and timestamp
+struct BatchObject {
+    std::string object_id;
+    time_t timestamp;
+    std::string data;
+};
+
+class StorePut {
+private:
+    int store_id;
+    StoreMetadata store_metadata;
+    std::vector<BlockMetadata> block_metadata;
+
+    /**
+     * @brief Loads metadata from a binary file for the store and its blocks.
+     * 
+     * @return true if metadata is successfully loaded.
+     * @return false if metadata file could not be opened or read.
+     */
+    bool loadMetadata() {
+        RawFile file(utils::getMetadataPath(store_id), O_RDONLY);
+        if (!file.isOpen()) {
+            std::cerr << "Failed to open metadata file" << std::endl;
+            return false;
+        }
+
+        // Read store and block metadata in one scatter read
+        block_metadata.resize(NUM_BLOCKS);
+        std::vector<iovec> iov = utils::metadataIov(store_metadata, block_metadata);
+        if (!file.readVec(iov, 0)) {
+            std::cerr << "Failed to read metadata file" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Saves the current metadata for the store and its blocks to a binary file.
+     *        The file is written aside and renamed into place, so concurrent readers
+     *        see either the old or the new metadata, never a partial file. It is
+     *        synced first when HEARTY_SYNC asks for durable commits.
+     * 
+     * @return true if metadata is successfully saved.
+     * @return false if metadata file could not be opened or written.
+     */
+    bool saveMetadata() {
+        std::vector<iovec> iov = utils::metadataIov(store_metadata, block_metadata);
+        if (!io::replaceFile(utils::getMetadataPath(store_id), iov)) {
+            std::cerr << "Failed to write metadata file" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks whether two block records describe the same object (or are both free).
+     */
+    static bool sameObject(const BlockMetadata& a, const BlockMetadata& b) {
+        if (!a.is_used || !b.is_used) {
+            return a.is_used == b.is_used;
+        }
+        return std::strncmp(a.object_id, b.object_id, OBJECT_ID_SIZE) == 0 &&
+               a.data_size == b.data_size &&
+               a.timestamp == b.timestamp &&
+               a.checksum == b.checksum;
+    }
+
+    /**
+     * @brief Finds the index of a free block in the store.
+     * 
+     * Blocks still referenced by a snapshot are skipped, so new data is always
+     * redirected away from blocks that a snapshot shares with the live store.
+     * 
+     * @param preferred   Block to take if it is free, or -1.
+     * @return int The index of a free block, or -1 if no free blocks are available.
+     */
+    int findFreeBlock(int preferred = -1) {
+        std::vector<uint16_t> pins = utils::loadPinMap(store_id);
+        if (preferred >= 0 && preferred < static_cast<int>(NUM_BLOCKS) &&
+            !block_metadata[preferred].is_used && pins[preferred] == 0) {
+            return preferred;
+        }
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            if (!block_metadata[i].is_used && pins[i] == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Applies an XOR delta to the HA group's parity file at the given offset.
+     * 
+     * The parity file is locked while the delta is applied so that puts into
+     * other members of the group cannot interleave their read-modify-write, and
+     * the journals of crashed buffering writers are replayed first. When parity
+     * buffering is enabled the delta is journaled and buffered instead.
+     * 
+     * @param parity_file   Open parity file of the HA group.
+     * @param parity_path   Path of the parity file (used for locking).
+     * @param offset        Byte offset of the delta within the parity file.
+     * @param delta         XOR of old and new data for the range.
+     * @return true if the parity range is successfully updated.
+     * @return false if the parity file could not be read or written.
+     */
+    bool applyParityDelta(const RawFile& parity_file, const std::string& parity_path,
+                          size_t offset, const std::vector<char>& delta) {
+        if (ParityBuffer* buffer = ParityBuffer::forGroup(store_metadata.ha_group_id)) {
+            return buffer->add(offset, delta);
+        }
+
+        FileLock lock(parity_path);
+        if (!lock.locked()) {
+            return false;
+        }
+        // An orphaned journal replayed later would overwrite this delta with its images
+        journal::replayOrphans(store_metadata.ha_group_id);
+
+        std::vector<char> parity(delta.size());
+        if (!parity_file.readFull(parity.data(), parity.size(), offset)) {
+            return false;
+        }
+        utils::xorInto(parity.data(), delta.data(), parity.size());
+        return parity_file.writeAt(parity.data(), parity.size(), offset);
+    }
+
+    /**
+     * @brief Streams an input's contents into a specific block in the store.
+     * 
+     * The input is consumed in STREAM_CHUNK_SIZE chunks, so it does not need to be
+     * seekable or held in memory. For each chunk the checksum is extended and, if the
+     * store is part of an HA group, the parity delta (old ^ new) is applied. Old data
+     * is only read below the block's high-water extent; beyond it the block is known
+     * to be zero and the delta is the new data itself. A destroyed HA member writes
+     * blocks that its rebuild has already moved to a hot spare into the spare. The
+     * block's extent is raised as chunks land (even if the write later fails); the
+     * rest of its metadata is only updated in memory once the whole stream has been
+     * written.
+     * 
+     * @param input The stream to read the object from.
+     * @param block_num The index of the block to write to.
+     * @param object_id The unique identifier for the object being stored.
+     * @param length Exact number of bytes to consume, or BLOCK_SIZE + 1 to read to end of stream.
+     * @return true if the stream is successfully written to the block.
+     * @return false if the stream exceeds a block or the data block could not be written.
+     */
+    bool writeToBlock(std::istream& input, int block_num, const std::string& object_id,
+                      size_t length = BLOCK_SIZE + 1) {
+        // The store lock keeps the rebuild watermark from passing this block meanwhile
+        std::string data_path = utils::memberDataPath(store_metadata, block_num);
+        std::shared_ptr<RawFile> data_file = io::openShared(
+            data_path.empty() ? utils::getDataPath(store_id) : data_path);
+        if (!data_file) {
+            std::cerr << "Failed to open data file" << std::endl;
+            return false;
+        }
+
+        // Open parity file if part of HA group
+        std::string parity_path;
+        std::shared_ptr<RawFile> parity_file;
+        if (store_metadata.ha_group_id != -1) {
+            parity_path = utils::getHAPath(store_metadata.ha_group_id) + PARITY_FILENAME;
+            parity_file = io::openShared(parity_path);
+            if (!parity_file) {
+                std::cerr << "Failed to open parity file" << std::endl;
+                return false;
+            }
+        }
+
+        std::vector<char> chunk(STREAM_CHUNK_SIZE);
+        std::vector<char> old_chunk(STREAM_CHUNK_SIZE);
+        size_t bytes_written = 0;
+        uint32_t checksum = 0;
+
+        while (input && bytes_written < length) {
+            input.read(chunk.data(), std::min(STREAM_CHUNK_SIZE, length - bytes_written));
+            size_t bytes_read = input.gcount();
+            if (bytes_read == 0) break;
+
+            if (bytes_written + bytes_read > BLOCK_SIZE) {
+                // Data and parity written so far stay consistent with each other;
+                // the block is simply never marked as used.
+                std::cerr << "File too large (max 1MB)" << std::endl;
+                return false;
+            }
+
+            size_t offset = block_num * BLOCK_SIZE + bytes_written;
+            IOGrant grant(IOClass::FOREGROUND_WRITE, bytes_read);
+
+            // Read what the chunk replaces so the parity delta can be computed;
+            // bytes past the block's extent are zero and need no read
+            if (parity_file) {
+                size_t extent = block_metadata[block_num].extent;
+                size_t old_bytes = extent > bytes_written ? std::min(bytes_read, extent - bytes_written) : 0;
+                old_chunk.assign(bytes_read, 0);
+                if (old_bytes > 0 && !data_file->readFull(old_chunk.data(), old_bytes, offset)) {
+                    std::cerr << "Failed to read data at block " << block_num << std::endl;
+                    return false;
+                }
+                utils::xorInto(old_chunk.data(), chunk.data(), bytes_read);
+            }
+
+            if (!data_file->writeAt(chunk.data(), bytes_read, offset)) {
+                std::cerr << "Failed to write data at block " << block_num << std::endl;
+                return false;
+            }
+            block_metadata[block_num].extent = std::max(block_metadata[block_num].extent,
+                                                        bytes_written + bytes_read);
+
+            if (parity_file && 
+                !applyParityDelta(*parity_file, parity_path, offset, old_chunk)) {
+                std::cerr << "Failed to update parity" << std::endl;
+                return false;
+            }
+
+            checksum = utils::crc32(checksum, chunk.data(), bytes_read);
+            bytes_written += bytes_read;
+        }
+
+        if (input.bad() || (length <= BLOCK_SIZE && bytes_written != length)) {
+            std::cerr << "Failed to read input" << std::endl;
+            return false;
+        }
+
+        // Buffered parity deltas must be durable before the object is committed
+        ParityBuffer* buffer = parity_file ? ParityBuffer::forGroup(store_metadata.ha_group_id)
+                                           : nullptr;
+        if (buffer != nullptr && !buffer->sync()) {
+            std::cerr << "Failed to journal parity update" << std::endl;
+            return false;
+        }
+
+        // So is the data (and directly written parity) when durable commits are asked for
+        Durability durability = io::commitDurability();
+        if (!data_file->sync(durability) ||
+            (parity_file && buffer == nullptr && !parity_file->sync(durability))) {
+            std::cerr << "Failed to sync data at block " << block_num << std::endl;
+            return false;
+        }
+
+        // Update metadata
+        block_metadata[block_num].is_used = true;
+        utils::setObjectId(block_metadata[block_num], object_id);
+        block_metadata[block_num].data_size = bytes_written;
+        block_metadata[block_num].timestamp = std::time(nullptr);
+        block_metadata[block_num].checksum = checksum;
+        store_metadata.used_blocks++;
+
+        return true;
+    }
+
+    /**
+     * @brief Adds a newly written block to both sorted object indexes and its
+     *        object ID to the store's ID filter.
+     * 
+     * @param block_num The index of the block that was written.
+     * @return true if the indexes and the filter are successfully updated.
+     * @return false if an index or the filter could not be opened or written.
+     */
+    bool updateIndex(int block_num) {
+        IndexEntry entry = utils::makeIndexEntry(block_metadata[block_num], block_num);
+        for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+            ObjectIndex index(store_id, order);
+            if (!index.open() || !index.insert(entry)) {
+                return false;
+            }
+        }
+        return ObjectFilter(store_id).insert(entry.object_id);
+    }
+
+    /**
+     * @brief Refreshes a block's leaf in the store's Merkle tree after the block
+     *        or its metadata changed. The caller holds the store lock.
+     * 
+     * @param block_num The index of the changed block.
+     * @return true if the tree is updated.
+     * @return false if the tree could not be loaded, computed or saved.
+     */
+    bool updateTree(int block_num) {
+        MerkleTree tree(store_id);
+        if (!tree.load() || !tree.refresh(block_num, block_metadata[block_num]) || !tree.save()) {
+            std::cerr << "Warning: Failed to update Merkle tree of store " << store_id << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Copies the given blocks to another store. Each block is copied up to
+     *        the larger of the two extents, so the target keeps no stale bytes past
+     *        the source's extent. Metadata is not touched. Nothing is copied if
+     *        any of the blocks is pinned by a snapshot of the target.
+     * 
+     * @param target_id ID of the store to copy to.
+     * @param blocks Indexes of the blocks to copy.
+     * @return true if every block is copied.
+     * @return false if a block is pinned on the target, or a data file or the
+     *         target metadata could not be read or written.
+     */
+    bool copyBlocksTo(int target_id, const std::vector<int>& blocks) {
+        std::vector<uint16_t> pins = utils::loadPinMap(target_id);
+        for (int block : blocks) {
+            if (pins[block] != 0) {
+                std::cerr << "Block " << block << " of store " << target_id
+                          << " is pinned by a snapshot" << std::endl;
+                return false;
+            }
+        }
+
+        std::shared_ptr<RawFile> target_file = io::openShared(utils::getDataPath(target_id));
+        std::shared_ptr<RawFile> source_file = io::openShared(utils::getDataPath(store_id));
+        if (!target_file || !source_file) {
+            std::cerr << "Failed to open replica data files" << std::endl;
+            return false;
+        }
+
+        StoreMetadata target_metadata;
+        std::vector<BlockMetadata> target_blocks(NUM_BLOCKS);
+        RawFile target_meta(utils::getMetadataPath(target_id), O_RDONLY);
+        std::vector<iovec> iov = utils::metadataIov(target_metadata, target_blocks);
+        if (!target_meta.isOpen() || !target_meta.readVec(iov, 0)) {
+            std::cerr << "Failed to read metadata of store " << target_id << std::endl;
+            return false;
+        }
+
+        // Copy blocks in parallel; positional I/O needs no per-task handles
+        bool copied = Executor::shared().parallelFor(blocks.size(), REPLICA_COPY_GRAIN,
+                                                     [&](size_t begin, size_t end) {
+            BlockBuffer buffer;
+            for (size_t i = begin; i < end; i++) {
+                int block = blocks[i];
+                size_t length = std::min(BLOCK_SIZE, std::max(block_metadata[block].extent,
+                                                              target_blocks[block].extent));
+                size_t offset = static_cast<size_t>(block) * BLOCK_SIZE;
+
+                IOGrant grant(IOClass::BACKGROUND, length);
+                if (!source_file->readFull(buffer.data(), length, offset) ||
+                    !target_file->writeAt(buffer.data(), length, offset)) {
+                    std::cerr << "Failed to write to replica at block " << block << std::endl;
+                    return false;
+                }
+            }
+            return true;
+        });
+        return copied && target_file->sync(io::commitDurability());
+    }
+
+    /**
+     * @brief Completes a copy made with copyBlocksTo(): writes this store's block
+     *        metadata under the target's header, copies the object indexes and the
+     *        Merkle tree, and rebuilds the target's ID filter from its new index.
+     * 
+     * @param target_id ID of the store copied to.
+     * @param target_metadata Store header to write for the target.
+     * @param tree This store's Merkle tree.
+     * @return true if the target is committed.
+     * @return false if a file could not be written.
+     */
+    bool commitCopyTo(int target_id, StoreMetadata target_metadata, const MerkleTree& tree) {
+        std::vector<iovec> iov = utils::metadataIov(target_metadata, block_metadata);
+        if (!io::replaceFile(utils::getMetadataPath(target_id), iov)) {
+            std::cerr << "Failed to write metadata of store " << target_id << std::endl;
+            return false;
+        }
+
+        for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+            std::filesystem::copy_file(utils::getIndexPath(store_id, order),
+                                       utils::getIndexPath(target_id, order),
+                                       std::filesystem::copy_options::overwrite_existing);
+        }
+        ObjectFilter filter(target_id);
+        return filter.rebuild() && filter.save() && tree.saveTo(target_id);
+    }
+
+    /**
+     * @brief Synchronizes the current store with its replica. Only the blocks on
+     *        which the two stores' Merkle trees differ are copied.
+     * 
+     * @return true if the replica is successfully synchronized or the store is not part of a replica pair.
+     * @return false if synchronization fails.
+     */
+    bool syncWithReplica() {
+        if (!store_metadata.is_replica && store_metadata.replica_of == -1) {
+            return true;  // Not part of a replica pair
+        }
+
+        int related_id = store_metadata.replica_of; 
+        MerkleTree source_tree(store_id);
+        MerkleTree target_tree(related_id);
+        if (!source_tree.load() || !target_tree.load()) {
+            std::cerr << "Failed to load Merkle trees of the replica pair" << std::endl;
+            return false;
+        }
+        if (!copyBlocksTo(related_id, MerkleTree::diff(source_tree, target_tree))) {
+            return false;
+        }
+
+        // Sync metadata from the committed in-memory copy
+        StoreMetadata target_metadata = store_metadata;
+        // Preserve the replica relationship while updating other fields
+        if (store_metadata.is_replica) {
+            // If we're the replica, the target is the original
+            target_metadata.store_id = related_id;
+            target_metadata.is_replica = false;
+            target_metadata.replica_of = store_metadata.store_id;
+        } else {
+            // If we're the original, the target is the replica
+            target_metadata.store_id = related_id;
+            target_metadata.is_replica = true;
+            target_metadata.replica_of = store_metadata.store_id;
+        }
+
+        if (!commitCopyTo(related_id, target_metadata, source_tree)) {
+            std::cerr << "Failed to sync replica" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Removes a block's object from the object indexes (if it holds one).
+     * 
+     * @param block_num The index of the block.
+     */
+    void dropFromIndex(int block_num) {
+        if (!block_metadata[block_num].is_used) {
+            return;
+        }
+        IndexEntry entry = utils::makeIndexEntry(block_metadata[block_num], block_num);
+        for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+            ObjectIndex index(store_id, order);
+            if (index.open()) {
+                index.remove(entry);
+            }
+        }
+    }
+
+public:
+    StorePut(int id) : store_id(id) {}
+
+    /**
+     * @brief Generates a globally unique ID by combining a timestamp and 64 random
+     *        bits, so IDs do not collide across stores and can be looked up without
+     *        knowing the store (hearty-store-find).
+     * 
+     * @return std::string A unique identifier string in the format "timestamp_randomHex".
+     *         Example: "1637359000000_9f2c4e01d3b87a65".
+     */
+    static std::string generateUniqueId() {
+        // Generate a random ID using timestamp and random number
+        auto now = std::chrono::system_clock::now();
+        auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now.time_since_epoch()
+        ).count();
+        
+        // One generator per thread, seeded from the random device
+        thread_local std::mt19937_64 gen(std::random_device{}() ^
+                                         (static_cast<uint64_t>(std::random_device{}()) << 32));
+        char random_hex[17];
+        std::snprintf(random_hex, sizeof(random_hex), "%016llx",
+                      static_cast<unsigned long long>(gen()));
+        
+        return std::to_string(timestamp) + "_" + random_hex;
+    }
+
+    /**
+     * @brief   Writes an object into a given block, keeping the metadata (ID, timestamp,
+     *          checksum) of a record received from another store. Any object previously
+     *          in that block is replaced. Used to apply send/receive streams.
+     * 
+     * @param block_num     The index of the block to write.
+     * @param source        Metadata of the object as recorded by the sending store.
+     * @param input         Stream positioned at the object's data (exactly data_size bytes),
+     *                      which is read and checksummed before the block is touched.
+     * @param expected      If given, what the caller last saw in the block; the write is
+     *                      refused if the block changed since (checked under the store lock).
+     * @return true if the object is written and its checksum matches.
+     * @return false if the block is pinned by a snapshot or changed since `expected`,
+     *         the data is short or corrupt, or the store could not be updated.
+     */
+    bool putAt(int block_num, const BlockMetadata& source, std::istream& input,
+               const BlockMetadata* expected = nullptr) {
+        // Stage and check the object first, so a short or corrupt stream never
+        // touches the block (or the object it currently holds)
+        if (source.data_size > BLOCK_SIZE) {
+            std::cerr << "Invalid size for block " << block_num << std::endl;
+            return false;
+        }
+        std::string staged(source.data_size, '\0');
+        input.read(staged.data(), staged.size());
+        if (static_cast<size_t>(input.gcount()) != staged.size()) {
+            std::cerr << "Stream ended early in block " << block_num << std::endl;
+            return false;
+        }
+        if (utils::crc32(0, staged.data(), staged.size()) != source.checksum) {
+            std::cerr << "Checksum mismatch for block " << block_num << std::endl;
+            return false;
+        }
+        std::istringstream staged_input(std::move(staged));
+
+        FileLock store_lock(utils::getStorePath(store_id));
+        if (!loadMetadata()) {
+            return false;
+        }
+
+        if (utils::loadPinMap(store_id)[block_num] != 0) {
+            std::cerr << "Block " << block_num << " is pinned by a snapshot" << std::endl;
+            return false;
+        }
+        if (expected != nullptr && !sameObject(block_metadata[block_num], *expected)) {
+            std::cerr << "Block " << block_num << " changed while it was being written" << std::endl;
+            return false;
+        }
+
+        // Replace whatever the block held before
+        dropFromIndex(block_num);
+        if (block_metadata[block_num].is_used) {
+            block_metadata[block_num].is_used = false;
+            store_metadata.used_blocks--;
+        }
+
+        if (!writeToBlock(staged_input, block_num, source.object_id, source.data_size)) {
+            if (saveMetadata()) {   // Keep the block free, with its raised extent
+                updateTree(block_num);
+            }
+            return false;
+        }
+        block_metadata[block_num].timestamp = source.timestamp;
+
+        if (!saveMetadata()) {
+            return false;
+        }
+        updateTree(block_num);
+        return updateIndex(block_num);
+    }
+
+    /**
+     * @brief   Stores a batch of objects under their own IDs and timestamps, with one
+     *          metadata load and one commit for the whole batch: free blocks are picked
+     *          for all objects at once, each object is written (parity included), then
+     *          the metadata, Merkle tree, indexes, filter and replica are updated once.
+     *          Used by hearty-store-import.
+     * 
+     * @param objects       Objects to store.
+     * @return One flag per object: stored, or not (its ID already exists in the store,
+     *         it is too large, no block is free or writing it failed).
+     */
+    std::vector<bool> putBatch(const std::vector<BatchObject>& objects) {
+        std::vector<bool> stored(objects.size(), false);
+        FileLock store_lock(utils::getStorePath(store_id));
+        if (!loadMetadata()) {
+            return stored;
+        }
+
+        std::unordered_set<std::string> existing;
+        for (const auto& block : block_metadata) {
+            if (block.is_used) existing.insert(block.object_id);
+        }
+        std::vector<uint16_t> pins = utils::loadPinMap(store_id);
+        size_t next_free = 0;
+
+        std::vector<int> written;
+        for (size_t i = 0; i < objects.size(); i++) {
+            const BatchObject& object = objects[i];
+            if (object.object_id.empty() || object.object_id.size() >= OBJECT_ID_SIZE ||
+                object.data.size() > BLOCK_SIZE || !existing.insert(object.object_id).second) {
+                std::cerr << "Skipping object " << object.object_id
+                          << ": invalid, too large or already exists" << std::endl;
+                continue;
+            }
+
+            while (next_free < NUM_BLOCKS && (block_metadata[next_free].is_used || pins[next_free] != 0)) {
+                next_free++;
+            }
+            if (next_free == NUM_BLOCKS) {
+                std::cerr << "No free blocks available" << std::endl;
+                break;
+            }
+
+            int block_num = static_cast<int>(next_free);
+            std::istringstream input(object.data);
+            if (!writeToBlock(input, block_num, object.object_id, object.data.size())) {
+                existing.erase(object.object_id);
+                continue;
+            }
+            block_metadata[block_num].timestamp = object.timestamp;
+            written.push_back(block_num);
+            stored[i] = true;
+        }
+
+        // Commit the batch (and the raised extents of failed writes) at once
+        if (!saveMetadata()) {
+            return std::vector<bool>(objects.size(), false);
+        }
+
+        MerkleTree tree(store_id);
+        bool tree_ok = tree.load();
+        std::vector<IndexEntry> entries;
+        std::vector<std::string> ids;
+        for (int block_num : written) {
+            tree_ok = tree_ok && tree.refresh(block_num, block_metadata[block_num]);
+            entries.push_back(utils::makeIndexEntry(block_metadata[block_num], block_num));
+            ids.push_back(block_metadata[block_num].object_id);
+        }
+        if (!tree_ok || !tree.save()) {
+            std::cerr << "Warning: Failed to update Merkle tree of store " << store_id << std::endl;
+        }
+
+        bool indexed = true;
+        for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+            ObjectIndex index(store_id, order);
+            indexed = indexed && index.open() && index.insertAll(entries);
+        }
+        if (!indexed || !ObjectFilter(store_id).insertAll(ids)) {
+            std::cerr << "Warning: Failed to update object index" << std::endl;
+        }
+
+        if (!written.empty() && !syncWithReplica()) {
+            std::cerr << "Warning: Failed to sync with replica" << std::endl;
+        }
+        return stored;
+    }
+
+    /**
+     * @brief   Frees a block so that it no longer holds an object. The data is left in
+     *          place, so the parity of an HA group stays valid.
+     * 
+     * @param block_num     The index of the block to free.
+     * @param expected      If given, what the caller last saw in the block; the block is
+     *                      left alone if it changed since (checked under the store lock).
+     * @return true if the block is freed (or was already free).
+     * @return false if the block changed since `expected` or the metadata could not be updated.
+     */
+    bool removeAt(int block_num, const BlockMetadata* expected = nullptr) {
+        FileLock store_lock(utils::getStorePath(store_id));
+        if (!loadMetadata()) {
+            return false;
+        }
+        if (expected != nullptr && !sameObject(block_metadata[block_num], *expected)) {
+            std::cerr << "Block " << block_num << " changed while it was being freed" << std::endl;
+            return false;
+        }
+        if (!block_metadata[block_num].is_used) {
+            return true;
+        }
+
+        dropFromIndex(block_num);
+        block_metadata[block_num].is_used = false;
+        store_metadata.used_blocks--;
+        if (!saveMetadata()) {
+            return false;
+        }
+        updateTree(block_num);
+        return true;
+    }
+
+    /**
+     * @brief   Reports which blocks a new object may be written to: free and not
+     *          pinned by a snapshot.
+     * 
+     * @return One flag per block, or an empty vector if the metadata could not be loaded.
+     */
+    std::vector<bool> freeBlockMap() {
+        if (!loadMetadata()) {
+            return {};
+        }
+        std::vector<uint16_t> pins = utils::loadPinMap(store_id);
+        std::vector<bool> free_blocks(NUM_BLOCKS);
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            free_blocks[i] = !block_metadata[i].is_used && pins[i] == 0;
+        }
+        return free_blocks;
+    }
+
+    /**
+     * @brief   Writes an in-memory object into a free block as part of a full-stripe
+     *          write. The first `extent` bytes of the block are written in one pass
+     *          (the object zero-padded to the extent) and the parity is NOT touched:
+     *          the caller computes the stripe's parity from the new data, and must
+     *          hold the store lock. The replica is not synchronized.
+     * 
+     * @param block_num     The index of the free block to write.
+     * @param object_id     ID of the new object.
+     * @param data          Contents of the object (at most `extent` bytes).
+     * @param extent        Number of bytes of the block covered by the stripe's parity update.
+     * @return true if the object is written and committed.
+     * @return false if the block is not free or the store could not be updated.
+     */
+    bool writeAt(int block_num, const std::string& object_id,
+                 const std::vector<char>& data, size_t extent) {
+        if (!loadMetadata()) {
+            return false;
+        }
+        if (block_metadata[block_num].is_used || data.size() > extent || extent > BLOCK_SIZE) {
+            return false;
+        }
+
+        std::vector<char> padded(extent, 0);
+        std::copy(data.begin(), data.end(), padded.begin());
+        {
+            std::shared_ptr<RawFile> data_file = io::openShared(utils::getDataPath(store_id));
+            IOGrant grant(IOClass::FOREGROUND_WRITE, extent);
+            if (!data_file ||
+                !data_file->writeAt(padded.data(), extent, static_cast<size_t>(block_num) * BLOCK_SIZE) ||
+                !data_file->sync(io::commitDurability())) {
+                std::cerr << "Failed to write data at block " << block_num << std::endl;
+                return false;
+            }
+        }
+
+        block_metadata[block_num].is_used = true;
+        utils::setObjectId(block_metadata[block_num], object_id);
+        block_metadata[block_num].data_size = data.size();
+        block_metadata[block_num].timestamp = std::time(nullptr);
+        block_metadata[block_num].checksum = utils::crc32(0, data.data(), data.size());
+        block_metadata[block_num].extent = std::max(block_metadata[block_num].extent, extent);
+        store_metadata.used_blocks++;
+
+        if (!saveMetadata()) {
+            return false;
+        }
+        updateTree(block_num);
+        return updateIndex(block_num);
+    }
+
+    /**
+     * @brief   Undoes writeAt when the rest of a full-stripe write failed: frees the
+     *          block again, leaving its data in place for the stripe's parity. The
+     *          caller must hold the store lock.
+     * 
+     * @param block_num     The index of the block written by writeAt.
+     * @return true if the block is free again.
+     * @return false if the metadata could not be updated.
+     */
+    bool discardAt(int block_num) {
+        if (!loadMetadata()) {
+            return false;
+        }
+        if (!block_metadata[block_num].is_used) {
+            return true;
+        }
+
+        dropFromIndex(block_num);
+        block_metadata[block_num].is_used = false;
+        store_metadata.used_blocks--;
+        if (!saveMetadata()) {
+            return false;
+        }
+        updateTree(block_num);
+        return true;
+    }
+
+    /**
+     * @brief   Frees the block holding the object with the given ID.
+     * 
+     * @param object_id     ID of the object to remove.
+     * @return true if the object is removed.
+     * @return false if the object does not exist or the metadata could not be updated.
+     */
+    bool remove(const std::string& object_id) {
+        int block_num = -1;
+        {
+            FileLock store_lock(utils::getStorePath(store_id));
+            if (!loadMetadata()) {
+                return false;
+            }
+            for (size_t i = 0; i < NUM_BLOCKS; i++) {
+                if (block_metadata[i].is_used && object_id == block_metadata[i].object_id) {
+                    block_num = static_cast<int>(i);
+                    break;
+                }
+            }
+        }
+        if (block_num == -1) {
+            std::cerr << "Object not found: " << object_id << std::endl;
+            return false;
+        }
+        return removeAt(block_num);
+    }
+
+    /**
+     * @brief   Makes another store a block-for-block copy of this one (anti-entropy
+     *          repair). Both stores are locked, their Merkle trees compared and only
+     *          the differing blocks copied; the target keeps its own store header.
+     * 
+     * @param target_id     ID of the store to repair.
+     * @param deep          Rebuild both trees from the blocks first instead of trusting
+     *                      the saved ones (also catches on-disk corruption).
+     * @return The number of blocks copied, or -1 on failure (e.g. a differing block
+     *         of the target is pinned by a snapshot, or the target is an HA member,
+     *         whose group parity the copied blocks would not be reflected in).
+     */
+    int repairTo(int target_id, bool deep = false) {
+        // Lock both stores in ascending ID order so repairs cannot deadlock
+        FileLock first_lock(utils::getStorePath(std::min(store_id, target_id)));
+        FileLock second_lock(utils::getStorePath(std::max(store_id, target_id)));
+        if (!loadMetadata()) {
+            return -1;
+        }
+
+        StoreMetadata target_metadata;
+        if (!utils::loadStoreMetadata(target_id, target_metadata)) {
+            return -1;
+        }
+        if (target_metadata.ha_group_id != -1) {
+            std::cerr << "Store " << target_id << " is in HA group " << target_metadata.ha_group_id
+                      << "; rebuild it with hearty-store-rebuild instead" << std::endl;
+            return -1;
+        }
+
+        MerkleTree source_tree(store_id);
+        MerkleTree target_tree(target_id);
+        if (deep ? !(source_tree.rebuild() && source_tree.save() &&
+                     target_tree.rebuild() && target_tree.save())
+                 : !(source_tree.load() && target_tree.load())) {
+            std::cerr << "Failed to load Merkle trees" << std::endl;
+            return -1;
+        }
+
+        std::vector<int> blocks = MerkleTree::diff(source_tree, target_tree);
+        if (blocks.empty()) {
+            return 0;
+        }
+        if (!copyBlocksTo(target_id, blocks)) {
+            return -1;
+        }
+        target_metadata.used_blocks = store_metadata.used_blocks;
+        if (!commitCopyTo(target_id, target_metadata, source_tree)) {
+            return -1;
+        }
+        return static_cast<int>(blocks.size());
+    }
+
+    /**
+     * @brief   Propagates the store's current state to its replica, if it has one.
+     * 
+     * @return true if the replica is in sync or the store has no replica.
+     * @return false if synchronization fails.
+     */
+    bool syncReplica() {
+        return loadMetadata() && syncWithReplica();
+    }
+
+    /**
+     * @brief   Stores a file in the storage system and performs associated updates.
+     * 
+     * @param file_path     The path of the file to be stored.
+     * @param object_id     ID to store the object under (default: a generated unique ID).
+     * @param preferred_block Block to store the object in if it is free (default: the
+     *                      first free block), e.g. to put objects of different group
+     *                      members into one stripe.
+     * @return std::string The unique object ID assigned to the stored file, or an empty string on failure.
+     */
+    std::string put(const std::string& file_path, const std::string& object_id = "",
+                    int preferred_block = -1) {
+        // Check file size up front so oversized files fail without touching the store
+        std::error_code error;
+        uintmax_t file_size = std::filesystem::file_size(file_path, error);
+        if (error) {
+            std::cerr << "Failed to open input file " << file_path << ": " << error.message() << std::endl;
+            return "";
+        }
+        if (file_size > BLOCK_SIZE) {
+            std::cerr << "File too large (max 1MB)" << std::endl;
+            return "";
+        }
+
+        std::ifstream input_file(file_path, std::ios::binary);
+        if (!input_file) {
+            std::cerr << "Failed to open input file" << std::endl;
+            return "";
+        }
+
+        return put(input_file, object_id, preferred_block);
+    }
+
+    /**
+     * @brief   Stores an object read from a (possibly non-seekable) stream, such as stdin
+     *          or a pipe. Metadata is only committed once the end of the stream is reached.
+     * 
+     * @param input         The stream to read the object from.
+     * @param requested_id  ID to store the object under (default: a generated unique ID).
+     *                      Fails if an object with this ID already exists in the store.
+     * @param preferred_block Block to store the object in if it is free (default: the
+     *                      first free block).
+     * @return std::string The unique object ID assigned to the stored object, or an empty string on failure.
+     */
+    std::string put(std::istream& input, const std::string& requested_id = "",
+                    int preferred_block = -1) {
+        // Serialize writers of this store (other processes or threads)
+        FileLock store_lock(utils::getStorePath(store_id));
+
+        // Check if store exists and load metadata
+        if (!loadMetadata()) {
+            return "";
+        }
+
+        // Find free block
+        int block_num = findFreeBlock(preferred_block);
+        if (block_num == -1) {
+            std::cerr << "No free blocks available" << std::endl;
+            return "";
+        }
+
+        // Generate unique ID unless the caller chose one
+        std::string object_id = requested_id.empty() ? generateUniqueId() : requested_id;
+        if (object_id.size() >= OBJECT_ID_SIZE) {
+            std::cerr << "Object ID too long (max " << OBJECT_ID_SIZE - 1 << " characters)" << std::endl;
+            return "";
+        }
+        if (!requested_id.empty()) {
+            for (const auto& block : block_metadata) {
+                if (block.is_used && object_id == block.object_id) {
+                    std::cerr << "Object already exists: " << object_id << std::endl;
+                    return "";
+                }
+            }
+        }
+
+        // Stream object into block (parity is updated chunk by chunk)
+        if (!writeToBlock(input, block_num, object_id)) {
+            if (saveMetadata()) {   // Keep the raised extent of the unused block
+                updateTree(block_num);
+            }
+            return "";
+        }
+
+        // Save updated metadata
+        if (!saveMetadata()) {
+            return "";
+        }
+        updateTree(block_num);
+
+        // Make the object visible to hearty-store-ls
+        if (!updateIndex(block_num)) {
+            std::cerr << "Warning: Failed to update object index" << std::endl;
+        }
+
+        // Sync with replica if necessary
+        if (!syncWithReplica()) {
+            std::cerr << "Warning: Failed to sync with replica" << std::endl;
+        }
+
+        return object_id;
+    }
+
+    /**
+     * @brief   Stores an object under a given ID, replacing the object that has it
+     *          (if any) in one step: the new object is written to a free block and
+     *          the old block is freed in the same metadata commit, all under the
+     *          store lock. If the write fails, the old object is left untouched.
+     * 
+     * @param input         The stream to read the object from.
+     * @param object_id     ID to store the object under.
+     * @return true if the object is stored (and any old one replaced).
+     * @return false if the store is full, the ID is too long or the write failed.
+     */
+    bool replace(std::istream& input, const std::string& object_id) {
+        FileLock store_lock(utils::getStorePath(store_id));
+        if (!loadMetadata()) {
+            return false;
+        }
+        if (object_id.empty() || object_id.size() >= OBJECT_ID_SIZE) {
+            std::cerr << "Invalid object ID: " << object_id << std::endl;
+            return false;
+        }
+
+        int old_block = -1;
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            if (block_metadata[i].is_used && object_id == block_metadata[i].object_id) {
+                old_block = static_cast<int>(i);
+                break;
+            }
+        }
+        int block_num = findFreeBlock();
+        if (block_num == -1) {
+            std::cerr << "No free blocks available" << std::endl;
+            return false;
+        }
+
+        if (!writeToBlock(input, block_num, object_id)) {
+            if (saveMetadata()) {   // Keep the raised extent of the unused block
+                updateTree(block_num);
+            }
+            return false;
+        }
+
+        // One commit makes the new object live and frees the old one
+        if (old_block != -1) {
+            dropFromIndex(old_block);
+            block_metadata[old_block].is_used = false;
+            store_metadata.used_blocks--;
+        }
+        if (!saveMetadata()) {
+            return false;
+        }
+        updateTree(block_num);
+        if (old_block != -1) {
+            updateTree(old_block);
+        }
+        if (!updateIndex(block_num)) {
+            std::cerr << "Warning: Failed to update object index" << std::endl;
+        }
+
+        if (!syncWithReplica()) {
+            std::cerr << "Warning: Failed to sync with replica" << std::endl;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,78 @@
+/**
+ * @file hearty-store-rebuild.cpp
+ * @author Nathadon Samairat
+ * @brief Manages the hot-spare pool and rebuilds destroyed HA group members onto
+ *        hot spares. hearty-store-destroy starts this tool in the background when
+ *        it destroys a member; running it by hand resumes an interrupted rebuild.
+ * @version 0.1
+ * @date 2024-12-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-rebuild.hpp"
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [store-id]" << std::endl
+              << "       " << program << " --add-spare [store-id...]" << std::endl
+              << "       " << program << " --spares" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::string command = argv[1];
+        if (command == "--add-spare" && argc > 2) {
+            for (int i = 2; i < argc; i++) {
+                int store_id = std::stoi(argv[i]);
+                if (!utils::storeExists(store_id)) {
+                    std::cerr << "Store " << store_id << " does not exist" << std::endl;
+                    return 1;
+                }
+                if (!HotSpares::add(store_id)) {
+                    return 1;
+                }
+                std::cout << "Added store " << store_id << " as a hot spare" << std::endl;
+            }
+            return 0;
+        }
+        if (command == "--spares" && argc == 2) {
+            for (int store_id : HotSpares::list()) {
+                std::cout << store_id << std::endl;
+            }
+            return 0;
+        }
+        if (argc != 2 || command.rfind("--", 0) == 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        int store_id = std::stoi(command);
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreRebuild rebuild(store_id);
+        size_t rebuilt = 0;
+        if (!rebuild.load() || !rebuild.run(rebuilt)) {
+            return 1;
+        }
+        std::cout << "Rebuilt store " << store_id << " onto hot spare " << rebuild.spareId()
+                  << " (" << rebuilt << " blocks), which replaces it" << std::endl;
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,448 @@
+/**
+ * @file hearty-store-rebuild.hpp
+ * @author Nathadon Samairat
+ * @brief Hot spares and member rebuilds for HA groups. Hot spares are initialized,
+ *        empty stores listed in /tmp/hot_spares.bin. When a member of an HA group
+ *        is destroyed, the group claims a spare and rebuilds the member's blocks
+ *        onto it in block order, reconstructing each from the parity and the other
+ *        members. The progress (a watermark) is kept in the group's rebuild.bin:
+ *        gets and puts of the destroyed member use the spare for blocks below it
+ *        and parity reconstruction above it. Once every block is rebuilt, the
+ *        spare takes over the member's objects and its slot in the group, and the
+ *        member's store is removed.
+ * @version 0.1
+ * @date 2024-12-14
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-filter.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-iosched.hpp"
+#include "hearty-store-merkle.hpp"
+#include "hearty-store-parity-buffer.hpp"
+#include "hearty-store-topology.hpp"
+
+class HotSpares {
+private:
+    /**
+     * @brief Reads the spare list. The file holds a count followed by the IDs;
+     *        bytes past them are left over from longer lists and ignored.
+     */
+    static std::vector<int> loadLocked(const RawFile& file) {
+        int count = 0;
+        if (!file.readFull(reinterpret_cast<char*>(&count), sizeof(count), 0) || count <= 0) {
+            return {};
+        }
+        std::vector<int> spares(count);
+        if (!file.readFull(reinterpret_cast<char*>(spares.data()), count * sizeof(int), sizeof(count))) {
+            return {};
+        }
+        return spares;
+    }
+
+    static bool saveLocked(const RawFile& file, const std::vector<int>& spares) {
+        int count = static_cast<int>(spares.size());
+        return file.writeAt(reinterpret_cast<const char*>(&count), sizeof(count), 0) &&
+               file.writeAt(reinterpret_cast<const char*>(spares.data()), count * sizeof(int), sizeof(count)) &&
+               file.sync(io::commitDurability());
+    }
+
+    /**
+     * @brief Opens (creating if needed) and locks the spare list. The file is
+     *        updated in place, so the lock on it stays meaningful.
+     */
+    static RawFile openLocked(std::unique_ptr<FileLock>& lock) {
+        RawFile file(utils::getSparesPath(), O_RDWR | O_CREAT);
+        lock = std::make_unique<FileLock>(utils::getSparesPath());
+        return file;
+    }
+
+public:
+    /**
+     * @brief Checks that a store can serve as a spare: empty and not part of an
+     *        HA group or replica pair.
+     */
+    static bool eligible(int store_id) {
+        StoreMetadata metadata;
+        return utils::loadStoreMetadata(store_id, metadata) && metadata.used_blocks == 0 &&
+               metadata.ha_group_id == -1 && !metadata.is_replica &&
+               metadata.replica_of == -1 && !metadata.is_destroyed;
+    }
+
+    /**
+     * @brief Adds a store to the spare pool.
+     *
+     * @return true if the store is a spare; false if it is not eligible or the
+     *         list could not be written.
+     */
+    static bool add(int store_id) {
+        if (!eligible(store_id)) {
+            std::cerr << "Store " << store_id << " must be empty and not part of an HA group or replica pair"
+                      << std::endl;
+            return false;
+        }
+
+        std::unique_ptr<FileLock> lock;
+        RawFile file = openLocked(lock);
+        if (!file.isOpen() || !lock->locked()) {
+            return false;
+        }
+        std::vector<int> spares = loadLocked(file);
+        if (std::find(spares.begin(), spares.end(), store_id) != spares.end()) {
+            return true;
+        }
+        spares.push_back(store_id);
+        return saveLocked(file, spares);
+    }
+
+    /**
+     * @brief Returns the stores in the spare pool.
+     */
+    static std::vector<int> list() {
+        RawFile file(utils::getSparesPath(), O_RDONLY);
+        return file.isOpen() ? loadLocked(file) : std::vector<int>{};
+    }
+
+    /**
+     * @brief Takes the first eligible spare out of the pool. Spares that are no
+     *        longer eligible (written to, destroyed, joined a group) are dropped.
+     *
+     * @return ID of the claimed spare, or -1 if none is available.
+     */
+    static int claim() {
+        std::unique_ptr<FileLock> lock;
+        RawFile file = openLocked(lock);
+        if (!file.isOpen() || !lock->locked()) {
+            return -1;
+        }
+
+        std::vector<int> spares = loadLocked(file);
+        int claimed = -1;
+        while (!spares.empty() && claimed == -1) {
+            if (eligible(spares.front())) {
+                claimed = spares.front();
+            }
+            spares.erase(spares.begin());
+        }
+        return saveLocked(file, spares) ? claimed : -1;
+    }
+};
+
+class StoreRebuild {
+private:
+    int store_id;
+    StoreMetadata store_metadata;
+    std::shared_ptr<const HATopology> group;
+    RebuildState state;
+
+    /**
+     * @brief Writes the rebuild progress, atomically so readers see the old or
+     *        the new watermark.
+     */
+    bool saveState() {
+        std::vector<iovec> iov = {{&state, sizeof(RebuildState)}};
+        return io::replaceFile(utils::getRebuildPath(store_metadata.ha_group_id), iov);
+    }
+
+    /**
+     * @brief Checks that the rebuild recorded in the group is still this one (the
+     *        group is deleted if a second member is destroyed).
+     */
+    bool stillRebuilding() {
+        RebuildState current;
+        return utils::loadRebuildState(store_metadata.ha_group_id, current) &&
+               current.store_id == state.store_id && current.spare_id == state.spare_id;
+    }
+
+    /**
+     * @brief Reconstructs the first `extent` bytes of a block of the destroyed
+     *        member from the parity and the other members. The caller holds the
+     *        members' locks.
+     */
+    bool reconstruct(size_t block_num, char* data, size_t extent) {
+        size_t offset = block_num * BLOCK_SIZE;
+        std::string parity_path = utils::getHAPath(store_metadata.ha_group_id) + PARITY_FILENAME;
+        std::shared_ptr<RawFile> parity_file = io::openShared(parity_path);
+        if (!parity_file) {
+            return false;
+        }
+        {
+            FileLock parity_lock(parity_path);
+            journal::replayOrphans(store_metadata.ha_group_id);
+            if (!parity_file->readFull(data, extent, offset)) {
+                return false;
+            }
+            journal::overlayPending(store_metadata.ha_group_id, offset, data, extent);
+        }
+
+        BlockBuffer buffer;
+        for (int member_id : group->members()) {
+            if (member_id == store_id) continue;
+
+            BlockMetadata member_block;
+            if (!utils::loadBlockMetadata(member_id, block_num, member_block)) {
+                return false;
+            }
+            size_t span = std::min(extent, std::min(member_block.extent, BLOCK_SIZE));
+            if (span == 0) continue;   // Zero past the member's extent
+
+            std::string data_path = utils::memberDataPath(group->groupId(), member_id,
+                                                         group->isDestroyed(member_id), block_num);
+            std::shared_ptr<RawFile> member_file = data_path.empty() ? nullptr : io::openShared(data_path);
+            if (!member_file || !member_file->readFull(buffer.data(), span, offset)) {
+                return false;
+            }
+            utils::xorInto(data, buffer.data(), span);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Reconstructs one block of the destroyed member onto the spare and
+     *        advances the watermark past it. Every member is locked (in ascending
+     *        order, as full-stripe writes do) so no put can change the stripe while
+     *        it is read, and the member's puts see the watermark move atomically.
+     *
+     * @param block_num Block to rebuild; must be the watermark.
+     * @param written Set to whether any data was written for the block.
+     *
+     * @return true if the block is rebuilt; false otherwise.
+     */
+    bool rebuildBlock(size_t block_num, bool& written) {
+        written = false;
+        size_t offset = block_num * BLOCK_SIZE;
+
+        // Pay the background budget before taking locks that foreground puts wait on
+        BlockMetadata block;
+        BlockMetadata spare_block;
+        if (!utils::loadBlockMetadata(store_id, block_num, block) ||
+            !utils::loadBlockMetadata(state.spare_id, block_num, spare_block)) {
+            return false;
+        }
+        size_t budget = std::min(block.extent, BLOCK_SIZE) * (group->members().size() + 1);
+        IOGrant grant(IOClass::BACKGROUND, budget);
+
+        std::vector<int> lock_order = group->members();
+        std::sort(lock_order.begin(), lock_order.end());
+        std::vector<std::unique_ptr<FileLock>> locks;
+        for (int member_id : lock_order) {
+            locks.push_back(std::make_unique<FileLock>(utils::getStorePath(member_id)));
+        }
+        if (!stillRebuilding()) {
+            std::cerr << "Rebuild of store " << store_id << " was cancelled" << std::endl;
+            return false;
+        }
+
+        // Reload under the locks: a put may have raised the extent meanwhile
+        if (!utils::loadBlockMetadata(store_id, block_num, block)) {
+            return false;
+        }
+        size_t extent = std::min(block.extent, BLOCK_SIZE);
+        size_t length = std::max(extent, std::min(spare_block.extent, BLOCK_SIZE));
+
+        if (length > 0) {
+            BlockBuffer data;
+            std::memset(data.data() + extent, 0, length - extent);
+
+            // The member's data is the parity (as of now) XOR every other member
+            if (extent > 0 && !reconstruct(block_num, data.data(), extent)) {
+                return false;
+            }
+
+            std::shared_ptr<RawFile> spare_file = io::openShared(utils::getDataPath(state.spare_id));
+            if (!spare_file || !spare_file->writeAt(data.data(), length, offset) ||
+                !spare_file->sync(io::commitDurability())) {
+                return false;
+            }
+            written = true;
+        }
+
+        state.next_block = block_num + 1;
+        return saveState();
+    }
+
+    /**
+     * @brief Gives the spare the member's contents: its header (under the spare's
+     *        ID), block metadata, object indexes and snapshots, then its own ID
+     *        filter and Merkle tree. The spare's data file already holds every
+     *        rebuilt block. The caller holds the member's and the spare's locks.
+     */
+    bool adoptMember() {
+        StoreMetadata metadata;
+        std::vector<BlockMetadata> block_metadata(NUM_BLOCKS);
+        RawFile file(utils::getMetadataPath(store_id), O_RDONLY);
+        std::vector<iovec> read_iov = utils::metadataIov(metadata, block_metadata);
+        if (!file.isOpen() || !file.readVec(read_iov, 0)) {
+            return false;
+        }
+
+        std::error_code error;
+        for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+            std::filesystem::copy_file(utils::getIndexPath(store_id, order),
+                                       utils::getIndexPath(state.spare_id, order),
+                                       std::filesystem::copy_options::overwrite_existing, error);
+            if (error) {
+                return false;
+            }
+        }
+        if (std::filesystem::exists(utils::getSnapshotDir(store_id))) {
+            std::filesystem::copy(utils::getSnapshotDir(store_id), utils::getSnapshotDir(state.spare_id),
+                                  std::filesystem::copy_options::recursive |
+                                  std::filesystem::copy_options::overwrite_existing, error);
+            if (error) {
+                return false;
+            }
+        }
+
+        metadata.store_id = state.spare_id;
+        metadata.is_destroyed = false;
+        std::vector<iovec> write_iov = utils::metadataIov(metadata, block_metadata);
+        if (!io::replaceFile(utils::getMetadataPath(state.spare_id), write_iov)) {
+            return false;
+        }
+
+        ObjectFilter filter(state.spare_id);
+        MerkleTree tree(state.spare_id);
+        if (!filter.rebuild() || !filter.save() || !tree.rebuild() || !tree.save()) {
+            std::cerr << "Warning: Failed to update filter or Merkle tree of store " << state.spare_id
+                      << std::endl;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Puts the rebuilt spare in service: the spare takes over the member's
+     *        contents and its slot in the group manifest (so the stripe layout is
+     *        unchanged), then the rebuild record and the member's store are removed.
+     *        Once the manifest names the spare, a rerun only does the cleanup.
+     */
+    bool finish() {
+        FileLock store_lock(utils::getStorePath(store_id));
+
+        std::shared_ptr<const HATopology> current = topology::load(store_metadata.ha_group_id);
+        if (!current) {
+            return false;
+        }
+        if (current->contains(store_id)) {
+            if (!adoptMember()) {
+                std::cerr << "Failed to move store " << store_id << " onto hot spare " << state.spare_id
+                          << std::endl;
+                return false;
+            }
+
+            // The member's reads go to the spare until this swap, and to the spare
+            // as a healthy member after it
+            int store = store_id;
+            int spare = state.spare_id;
+            bool swapped = topology::update(store_metadata.ha_group_id, [store, spare](HAManifest& manifest) {
+                for (int i = 0; i < manifest.member_count; i++) {
+                    if (manifest.members[i].store_id == store) {
+                        manifest.members[i] = HAMember{spare, MemberHealth::HEALTHY};
+                    }
+                }
+            });
+            if (!swapped) {
+                std::cerr << "Failed to update manifest of HA group " << store_metadata.ha_group_id << std::endl;
+                return false;
+            }
+        }
+
+        std::filesystem::remove(utils::getRebuildPath(store_metadata.ha_group_id));
+        std::filesystem::remove_all(utils::getStorePath(store_id));
+        return true;
+    }
+
+public:
+    StoreRebuild(int id) : store_id(id) {}
+
+    /**
+     * @brief Loads the destroyed member and its group.
+     *
+     * @return true if the store is a destroyed member of an HA group; false otherwise.
+     */
+    bool load() {
+        if (!utils::loadStoreMetadata(store_id, store_metadata)) {
+            std::cerr << "Failed to load metadata of store " << store_id << std::endl;
+            return false;
+        }
+        if (!store_metadata.is_destroyed || store_metadata.ha_group_id == -1) {
+            std::cerr << "Store " << store_id << " is not a destroyed HA group member" << std::endl;
+            return false;
+        }
+        group = topology::load(store_metadata.ha_group_id);
+        if (!group) {
+            std::cerr << "Failed to load HA group " << store_metadata.ha_group_id << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Claims a hot spare for the member and records an empty rebuild, unless
+     *        one is already recorded. From then on the member's puts and gets
+     *        follow the watermark.
+     *
+     * @return ID of the spare, or -1 if no spare is available.
+     */
+    int start() {
+        if (utils::loadRebuildState(store_metadata.ha_group_id, state) && state.store_id == store_id) {
+            return state.spare_id;
+        }
+
+        int spare_id = HotSpares::claim();
+        if (spare_id == -1) {
+            return -1;
+        }
+        state = RebuildState{store_id, spare_id, 0};
+        return saveState() ? spare_id : -1;
+    }
+
+    /**
+     * @brief Rebuilds the remaining blocks (resuming at the watermark) and puts the
+     *        spare in the member's place. Runs as background I/O, so
+     *        HEARTY_IO_BG_RATE limits it.
+     *
+     * @param rebuilt Receives the number of blocks written.
+     *
+     * @return true if the spare has replaced the member; false otherwise.
+     */
+    bool run(size_t& rebuilt) {
+        rebuilt = 0;
+        if (start() == -1) {
+            std::cerr << "No hot spare available for store " << store_id << std::endl;
+            return false;
+        }
+
+        // One rebuild at a time: the claimed spare is locked for the whole run
+        FileLock spare_lock(utils::getStorePath(state.spare_id));
+        if (!spare_lock.locked() || !stillRebuilding()) {
+            std::cerr << "Rebuild of store " << store_id << " is no longer in progress" << std::endl;
+            return false;
+        }
+        utils::loadRebuildState(store_metadata.ha_group_id, state);
+
+        for (size_t block_num = state.next_block; block_num < NUM_BLOCKS; block_num++) {
+            bool written = false;
+            if (!rebuildBlock(block_num, written)) {
+                std::cerr << "Failed to rebuild block " << block_num << " of store " << store_id << std::endl;
+                return false;
+            }
+            rebuilt += written ? 1 : 0;
+        }
+        return finish();
+    }
+
+    int spareId() const { return state.spare_id; }
+};
@@ -0,0 +1,221 @@
+/**
+ * @file hearty-store-receive.cpp
+ * @author Nathadon Samairat
+ * @brief Applies a send/receive stream from stdin to a store. Every record is
+ *        checksummed and committed on its own, and blocks that already match the
+ *        record are skipped, so an interrupted receive can simply be re-run. A full
+ *        stream also frees the blocks that only the target still uses.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include "hearty-store-common.hpp"
+#include "hearty-store-stream.hpp"
+#include "hearty-store-put.hpp"
+
+class StoreReceive {
+private:
+    int store_id;
+    std::vector<BlockMetadata> block_metadata;
+
+    /**
+     * @brief Loads the block metadata of the target store or of one of its snapshots.
+     *
+     * @param metadata_path Path to the metadata file.
+     * @param blocks Vector to fill with the block records.
+     *
+     * @return true if the metadata is successfully loaded; false otherwise.
+     */
+    bool loadBlockMetadata(const std::string& metadata_path, std::vector<BlockMetadata>& blocks) {
+        std::ifstream file(metadata_path, std::ios::binary);
+        if (!file) return false;
+
+        file.seekg(sizeof(StoreMetadata));
+        blocks.resize(NUM_BLOCKS);
+        for (auto& block : blocks) {
+            file.read(reinterpret_cast<char*>(&block), sizeof(BlockMetadata));
+        }
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Checks that the target holds the snapshot an incremental stream is
+     *        relative to, with the same contents as the source's base snapshot.
+     */
+    bool hasBase(const StreamHeader& header) {
+        std::vector<BlockMetadata> base;
+        if (!loadBlockMetadata(utils::getSnapshotPath(store_id, header.base_snapshot_id) + META_FILENAME,
+                               base)) {
+            std::cerr << "Store " << store_id << " has no snapshot " << header.base_snapshot_id
+                      << " to apply the incremental stream to" << std::endl;
+            return false;
+        }
+        if (utils::snapshotRoot(base) != header.base_root) {
+            std::cerr << "Snapshot " << header.base_snapshot_id << " of store " << store_id
+                      << " does not match the stream's base snapshot" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks whether the target block already holds the object of a record.
+     */
+    bool alreadyApplied(const StreamRecord& record) {
+        const BlockMetadata& current = block_metadata[record.block_num];
+        if (record.type == RECORD_FREE) {
+            return !current.is_used;
+        }
+        return current.is_used &&
+               std::strncmp(current.object_id, record.block.object_id, OBJECT_ID_SIZE) == 0 &&
+               current.data_size == record.block.data_size &&
+               current.checksum == record.block.checksum;
+    }
+
+public:
+    StoreReceive(int id) : store_id(id) {}
+
+    /**
+     * @brief Reads a stream and applies each record to the store.
+     *
+     * @param in Input stream produced by hearty-store-send.
+     *
+     * @return true if the whole stream is applied; false otherwise.
+     */
+    bool receive(std::istream& in) {
+        StreamHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(StreamHeader));
+        if (!in || header.magic != STREAM_MAGIC || header.version != STREAM_VERSION) {
+            std::cerr << "Input is not a hearty-store stream" << std::endl;
+            return false;
+        }
+        if (header.base_snapshot_id != -1 && !hasBase(header)) {
+            return false;
+        }
+
+        // Each record is applied only if its block still holds what was loaded here,
+        // so a put landing in the target during the receive is never overwritten
+        if (!loadBlockMetadata(utils::getMetadataPath(store_id), block_metadata)) {
+            std::cerr << "Failed to load store metadata" << std::endl;
+            return false;
+        }
+
+        StorePut writer(store_id);
+        std::vector<bool> named(NUM_BLOCKS, false);
+        uint64_t records = 0;
+        uint64_t skipped = 0;
+        while (true) {
+            StreamRecord record;
+            in.read(reinterpret_cast<char*>(&record), sizeof(StreamRecord));
+            if (!in) {
+                std::cerr << "Stream ended early after " << records << " records" << std::endl;
+                return false;
+            }
+            if (record.magic != STREAM_MAGIC || 
+                record.record_crc != utils::recordChecksum(record)) {
+                std::cerr << "Corrupt record after " << records << " records" << std::endl;
+                return false;
+            }
+
+            if (record.type == RECORD_END) {
+                if (record.block.data_size != records) {
+                    std::cerr << "Stream holds " << records << " records, expected "
+                              << record.block.data_size << std::endl;
+                    return false;
+                }
+                break;
+            }
+
+            if (record.block_num < 0 || record.block_num >= static_cast<int>(NUM_BLOCKS) ||
+                record.block.data_size > BLOCK_SIZE) {
+                std::cerr << "Invalid record for block " << record.block_num << std::endl;
+                return false;
+            }
+
+            named[record.block_num] = true;
+
+            // Skip records applied by an earlier, interrupted receive
+            if (alreadyApplied(record)) {
+                if (record.type == RECORD_BLOCK) {
+                    in.ignore(record.block.data_size);
+                }
+                skipped++;
+                records++;
+                continue;
+            }
+
+            BlockMetadata& current = block_metadata[record.block_num];
+            bool applied = record.type == RECORD_BLOCK ? 
+                writer.putAt(record.block_num, record.block, in, &current) : 
+                writer.removeAt(record.block_num, &current);
+            if (!applied) {
+                std::cerr << "Failed to apply record for block " << record.block_num << std::endl;
+                return false;
+            }
+            if (record.type == RECORD_BLOCK) {
+                current = record.block;
+            } else {
+                current.is_used = false;
+            }
+            records++;
+        }
+
+        // A full stream names every block the source uses; anything else the
+        // target still holds is gone from the source
+        uint64_t freed = 0;
+        if (header.base_snapshot_id == -1) {
+            for (size_t block = 0; block < NUM_BLOCKS; block++) {
+                if (named[block] || !block_metadata[block].is_used) {
+                    continue;
+                }
+                if (!writer.removeAt(block, &block_metadata[block])) {
+                    std::cerr << "Failed to free block " << block << std::endl;
+                    return false;
+                }
+                freed++;
+            }
+        }
+
+        if (!writer.syncReplica()) {
+            std::cerr << "Warning: Failed to sync with replica" << std::endl;
+        }
+
+        std::cerr << "Received " << records << " records from store " << header.source_store_id
+                  << " (" << skipped << " already applied, " << freed
+                  << " blocks freed)" << std::endl;
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " [store-id]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreReceive receiver(store_id);
+        if (!receiver.receive(std::cin)) {
+            return 1;
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -12,6 +12,11 @@
 #include <fstream>
 #include <random>
 #include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-buffer.hpp"
+#include "hearty-store-merkle.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-filter.hpp"
 
 class StoreReplicate {
 private:
@@ -43,31 +48,26 @@ private:
      * @return true if the data copy is successful; false otherwise.
      */
     bool copyStoreData(int source_id, int replica_id) {
-        std::ifstream src(utils::getDataPath(source_id), std::ios::binary);
-        std::ofstream dst(utils::getDataPath(replica_id), std::ios::binary);
+        RawFile src(utils::getDataPath(source_id), O_RDONLY);
+        RawFile dst(utils::getDataPath(replica_id), O_WRONLY | O_CREAT | O_TRUNC);
         
-        if (!src || !dst) {
+        if (!src.isOpen() || !dst.isOpen()) {
             std::cerr << "Failed to open data files" << std::endl;
             return false;
         }
 
-        // Copy in chunks to handle large files efficiently
-        constexpr size_t CHUNK_SIZE = 8192;
-        std::vector<char> buffer(CHUNK_SIZE);
-        
-        while (src) {
-            src.read(buffer.data(), buffer.size());
-            std::streamsize bytes_read = src.gcount();
-            if (bytes_read > 0) {
-                dst.write(buffer.data(), bytes_read);
-                if (!dst) {
-                    std::cerr << "Failed to write data" << std::endl;
-                    return false;
-                }
+        // Copy a block at a time with positional I/O
+        BlockBuffer buffer;
+        for (off_t offset = 0;; offset += BLOCK_SIZE) {
+            ssize_t bytes_read = src.readAt(buffer.data(), buffer.size(), offset);
+            if (bytes_read < 0 || !dst.writeAt(buffer.data(), bytes_read, offset)) {
+                std::cerr << "Failed to write data" << std::endl;
+                return false;
             }
+            if (static_cast<size_t>(bytes_read) < buffer.size()) break;
         }
 
-        return true;
+        return dst.sync(io::commitDurability());
     }
 
     /**
@@ -110,10 +110,11 @@ private:
     bool createReplicaMetadata(int source_id, int replica_id) {
         // First read source metadata
         StoreMetadata source_metadata;
+        std::vector<BlockMetadata> block_metadata(NUM_BLOCKS);
         {
-            std::ifstream src(utils::getMetadataPath(source_id), std::ios::binary);
-            if (!src) return false;
-            src.read(reinterpret_cast<char*>(&source_metadata), sizeof(StoreMetadata));
+            RawFile src(utils::getMetadataPath(source_id), O_RDONLY);
+            std::vector<iovec> iov = utils::metadataIov(source_metadata, block_metadata);
+            if (!src.isOpen() || !src.readVec(iov, 0)) return false;
         }
 
         // Create and initialize replica metadata
@@ -122,26 +123,9 @@ private:
         replica_metadata.is_replica = true;
         replica_metadata.replica_of = source_id;
 
-        // Write replica metadata
-        std::ofstream dst(utils::getMetadataPath(replica_id), std::ios::binary);
-        if (!dst) return false;
-        
-        dst.write(reinterpret_cast<char*>(&replica_metadata), sizeof(StoreMetadata));
-
-        // Copy block metadata
-        std::ifstream src(utils::getMetadataPath(source_id), std::ios::binary);
-        src.seekg(sizeof(StoreMetadata));  // Skip the store metadata we already handled
-
-        char buffer[1024];
-        while (src) {
-            src.read(buffer, sizeof(buffer));
-            std::streamsize bytes_read = src.gcount();
-            if (bytes_read > 0) {
-                dst.write(buffer, bytes_read);
-            }
-        }
-
-        return true;
+        // Write replica metadata, block metadata copied unchanged
+        std::vector<iovec> iov = utils::metadataIov(replica_metadata, block_metadata);
+        return io::replaceFile(utils::getMetadataPath(replica_id), iov);
     }
 
     /**
@@ -197,6 +181,34 @@ public:
             return -1;
         }
 
+        // Copy object indexes
+        try {
+            for (IndexOrder order : {IndexOrder::BY_ID, IndexOrder::BY_TIME}) {
+                std::filesystem::copy_file(utils::getIndexPath(source_id, order),
+                                           utils::getIndexPath(replica_id, order));
+            }
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Failed to copy object index: " << e.what() << std::endl;
+            std::filesystem::remove_all(utils::getStorePath(replica_id));
+            return -1;
+        }
+
+        // Build the replica's ID filter from its copied index
+        ObjectFilter filter(replica_id);
+        if (!filter.rebuild() || !filter.save()) {
+            std::cerr << "Failed to build object ID filter" << std::endl;
+            std::filesystem::remove_all(utils::getStorePath(replica_id));
+            return -1;
+        }
+
+        // Copy the Merkle tree; the replica holds the same blocks
+        MerkleTree tree(source_id);
+        if (!tree.load() || !tree.saveTo(replica_id)) {
+            std::cerr << "Failed to copy Merkle tree" << std::endl;
+            std::filesystem::remove_all(utils::getStorePath(replica_id));
+            return -1;
+        }
+
         // Update source metadata
         if (!updateSourceMetadata(source_id, replica_id)) {
             std::filesystem::remove_all(utils::getStorePath(replica_id));
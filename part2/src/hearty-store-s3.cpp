@@ -0,0 +1,837 @@
+/**
+ * @file hearty-store-s3.cpp
+ * @author Nathadon Samairat
+ * @brief S3-compatible HTTP/1.1 front end for the stores, listening on 127.0.0.1
+ *        or a Unix socket. Each store is a bucket named by its ID (path-style
+ *        addressing: /<store-id>/<key>) and each object ID a key. It serves
+ *        PUT/GET/HEAD/DELETE of objects, ListObjects (v1 and v2) of a bucket and
+ *        ListBuckets, without authentication (the socket is local only).
+ *
+ *        One thread runs a non-blocking epoll loop over the connections; store
+ *        operations run on the shared executor and hand their responses back
+ *        through an eventfd, so a slow disk or a store lock never stalls other
+ *        connections. GET bodies are sent from data.bin with sendfile, so object
+ *        data is never copied through user space; the block stays pinned in the
+ *        store's pin map until it is sent, so no PUT can reuse it meanwhile.
+ *        Degraded and striped objects are assembled in memory instead.
+ * @version 0.1
+ * @date 2024-12-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include <csignal>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-metadata.hpp"
+#include "hearty-store-index.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-get.hpp"
+#include "hearty-store-stripe.hpp"
+#include "hearty-store-http.hpp"
+
+const int DEFAULT_S3_PORT = 9000;
+const int S3_MAX_EVENTS = 64;                  // Events taken per epoll_wait
+const size_t S3_READ_CHUNK = 64 * 1024;        // Bytes read from a socket per call
+const size_t S3_MAX_KEYS = 1000;               // Keys per ListObjects page
+const std::string S3_XML_NAMESPACE = "http://s3.amazonaws.com/doc/2006-03-01/";
+
+/**
+ * @brief A block counted in its store's pin map (snapshots/pinned.bin) while a GET
+ *        sends it from data.bin: puts never take or overwrite a pinned block, and
+ *        a DELETE or replacing PUT only frees its metadata, so the bytes stay those
+ *        of the ETag. The pin is dropped, under the store lock, with the last
+ *        reference; the server drops it on an executor thread.
+ */
+class SendPin {
+private:
+    int store_id;
+    int block_num;
+
+    SendPin(int store, int block) : store_id(store), block_num(block) {}
+
+    // Adds delta to one block's pin count; the caller holds the store lock
+    static bool adjust(int store_id, int block_num, int delta) {
+        std::vector<uint16_t> pins = utils::loadPinMap(store_id);
+        pins[block_num] = static_cast<uint16_t>(std::max(0, pins[block_num] + delta));
+        std::vector<iovec> iov = {{pins.data(), NUM_BLOCKS * sizeof(uint16_t)}};
+        return io::replaceFile(utils::getPinMapPath(store_id), iov);
+    }
+
+public:
+    /**
+     * @brief Pins a block. The caller holds the store lock.
+     *
+     * @return The pin, or nullptr if the pin map could not be written.
+     */
+    static std::shared_ptr<SendPin> acquire(int store_id, int block_num) {
+        std::error_code error;
+        std::filesystem::create_directories(utils::getSnapshotDir(store_id), error);
+        if (error || !adjust(store_id, block_num, 1)) {
+            return nullptr;
+        }
+        return std::shared_ptr<SendPin>(new SendPin(store_id, block_num));
+    }
+
+    ~SendPin() {
+        FileLock store_lock(utils::getStorePath(store_id));
+        if (store_lock.locked() && !adjust(store_id, block_num, -1)) {
+            std::cerr << "Warning: Failed to unpin block " << block_num << " of store " << store_id << std::endl;
+        }
+    }
+
+    SendPin(const SendPin&) = delete;
+    SendPin& operator=(const SendPin&) = delete;
+};
+
+// Maps S3 requests onto the stores. Runs on executor threads.
+class S3Handler {
+private:
+    static HttpResponse xmlResponse(int status, const std::string& document) {
+        HttpResponse response;
+        response.status = status;
+        response.setHeader("Content-Type", "application/xml");
+        response.body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" + document;
+        return response;
+    }
+
+    static std::string etagOf(uint32_t checksum) {
+        char etag[16];
+        std::snprintf(etag, sizeof(etag), "\"%08x\"", checksum);
+        return etag;
+    }
+
+    static bool parseBucket(const std::string& bucket, int& store_id) {
+        if (bucket.empty() || bucket.size() > 9 ||
+            bucket.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        store_id = std::stoi(bucket);
+        return true;
+    }
+
+    static HttpResponse listBuckets() {
+        std::vector<int> store_ids;
+        for (const auto& entry : std::filesystem::directory_iterator(BASE_PATH)) {
+            std::string dirname = entry.path().filename().string();
+            int store_id;
+            if (entry.is_directory() && dirname.rfind("store_", 0) == 0 &&
+                parseBucket(dirname.substr(6), store_id)) {
+                store_ids.push_back(store_id);
+            }
+        }
+        std::sort(store_ids.begin(), store_ids.end());
+
+        std::string document = "<ListAllMyBucketsResult xmlns=\"" + S3_XML_NAMESPACE + "\">"
+                               "<Owner><ID>hearty</ID><DisplayName>hearty</DisplayName></Owner><Buckets>";
+        for (int store_id : store_ids) {
+            struct stat st;
+            time_t created = ::stat(utils::getStorePath(store_id).c_str(), &st) == 0 ? st.st_mtime : 0;
+            document += "<Bucket><Name>" + std::to_string(store_id) + "</Name><CreationDate>" +
+                        http::formatIsoDate(created) + "</CreationDate></Bucket>";
+        }
+        document += "</Buckets></ListAllMyBucketsResult>";
+        return xmlResponse(200, document);
+    }
+
+    /**
+     * @brief ListObjects (v1) and ListObjectsV2 over the store's ID index: one
+     *        binary search to the first key after the marker, then a sequential
+     *        read of the page of entries.
+     */
+    static HttpResponse listObjects(int store_id, const HttpRequest& request, const std::string& resource) {
+        auto param = [&request](const std::string& name) {
+            auto found = request.query.find(name);
+            return found == request.query.end() ? std::string() : found->second;
+        };
+        bool v2 = param("list-type") == "2";
+        std::string prefix = param("prefix");
+        std::string after = v2 ? (request.query.count("continuation-token") ? param("continuation-token")
+                                                                            : param("start-after"))
+                               : param("marker");
+        size_t max_keys = S3_MAX_KEYS;
+        if (request.query.count("max-keys")) {
+            std::string value = param("max-keys");
+            if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+                return error(400, "InvalidArgument", "max-keys must be a non-negative integer", resource);
+            }
+            max_keys = std::min(S3_MAX_KEYS, static_cast<size_t>(std::stoul(value)));
+        }
+
+        ObjectIndex index(store_id, IndexOrder::BY_ID);
+        MetadataReader metadata(utils::getMetadataPath(store_id), store_id);
+        if (!index.open() || !metadata.open()) {
+            return error(500, "InternalError", "Failed to read the object index", resource);
+        }
+
+        // Chunks of striped objects are stored under their own IDs; they are not keys
+        bool hide_chunks = metadata.store().ha_group_id != -1;
+
+        IndexEntry probe{};
+        std::strncpy(probe.object_id, std::max(prefix, after).c_str(), OBJECT_ID_SIZE - 1);
+        std::string contents;
+        std::string last_key;
+        size_t count = 0;
+        bool truncated = false;
+        IndexEntry entry;
+        for (uint64_t pos = index.lowerBound(probe); index.read(pos, entry); pos++) {
+            std::string key = entry.object_id;
+            if (key <= after) continue;
+            if (key.compare(0, prefix.size(), prefix) != 0) break;
+            if (hide_chunks && utils::isStripeChunkId(key)) continue;
+            if (count == max_keys) {
+                truncated = true;
+                break;
+            }
+            BlockMetadata block;
+            uint32_t checksum = metadata.block(entry.block_num, block) ? block.checksum : 0;
+            contents += "<Contents><Key>" + http::xmlEscape(key) + "</Key><LastModified>" +
+                        http::formatIsoDate(entry.timestamp) + "</LastModified><ETag>" +
+                        http::xmlEscape(etagOf(checksum)) + "</ETag><Size>" + std::to_string(entry.data_size) +
+                        "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+            last_key = key;
+            count++;
+        }
+
+        std::string document = "<ListBucketResult xmlns=\"" + S3_XML_NAMESPACE + "\"><Name>" +
+                               std::to_string(store_id) + "</Name><Prefix>" + http::xmlEscape(prefix) +
+                               "</Prefix><MaxKeys>" + std::to_string(max_keys) + "</MaxKeys><IsTruncated>" +
+                               (truncated ? "true" : "false") + "</IsTruncated>";
+        if (v2) {
+            document += "<KeyCount>" + std::to_string(count) + "</KeyCount>";
+            if (request.query.count("continuation-token")) {
+                document += "<ContinuationToken>" + http::xmlEscape(after) + "</ContinuationToken>";
+            }
+            if (truncated) {
+                document += "<NextContinuationToken>" + http::xmlEscape(last_key) + "</NextContinuationToken>";
+            }
+        } else {
+            document += "<Marker>" + http::xmlEscape(after) + "</Marker>";
+            if (truncated) {
+                document += "<NextMarker>" + http::xmlEscape(last_key) + "</NextMarker>";
+            }
+        }
+        document += contents + "</ListBucketResult>";
+        return xmlResponse(200, document);
+    }
+
+    /**
+     * @brief GET and HEAD of an object. The body of a live object is a range of
+     *        data.bin for the server to sendfile, with the block pinned until it is
+     *        sent; objects of a destroyed HA member (reconstructed) and striped
+     *        objects are read into memory.
+     */
+    static HttpResponse getObject(int store_id, const std::string& key, bool head,
+                                  const std::string& resource) {
+        HttpResponse response;
+        response.setHeader("Content-Type", "application/octet-stream");
+
+        StoreStripe stripe(store_id);
+        if (stripe.load() && stripe.isStriped(key)) {
+            std::ostringstream out;
+            if (!stripe.get(key, out)) {
+                return error(500, "InternalError", "Failed to read the striped object", resource);
+            }
+            response.body = out.str();
+            response.setHeader("ETag", etagOf(utils::crc32(0, response.body.data(), response.body.size())));
+            return response;
+        }
+
+        // Found and pinned under the lock, so the block still holds this object
+        FileLock store_lock(utils::getStorePath(store_id));
+        MetadataReader metadata(utils::getMetadataPath(store_id), store_id);
+        BlockMetadata block;
+        if (!metadata.open()) {
+            return error(500, "InternalError", "Failed to read the store metadata", resource);
+        }
+        int block_num = metadata.find(key, block);
+        if (block_num == -1) {
+            return error(404, "NoSuchKey", "The specified key does not exist.", resource);
+        }
+        response.setHeader("ETag", etagOf(block.checksum));
+        response.setHeader("Last-Modified", http::formatDate(block.timestamp));
+        if (head) {
+            response.head_only = true;
+            response.content_length = block.data_size;
+            return response;
+        }
+
+        if (!metadata.store().is_destroyed) {
+            auto data_file = std::make_shared<RawFile>(utils::getDataPath(store_id), O_RDONLY);
+            std::shared_ptr<SendPin> pin = data_file->isOpen() ? SendPin::acquire(store_id, block_num) : nullptr;
+            if (pin) {
+                response.file = data_file;
+                response.file_offset = static_cast<off_t>(block_num) * BLOCK_SIZE;
+                response.file_length = block.data_size;
+                response.file_hold = pin;
+                return response;
+            }
+        }
+
+        // Read (and checksummed) under the lock, so the body matches the ETag
+        std::ostringstream out;
+        StoreGet store_get(store_id);
+        if (!store_get.get(key, out)) {
+            return error(500, "InternalError", "Failed to read the object", resource);
+        }
+        response.body = out.str();
+        return response;
+    }
+
+    /**
+     * @brief PUT of an object. An existing object with the key is replaced in the
+     *        same store commit, so the key is never absent and a failed PUT keeps it.
+     */
+    static HttpResponse putObject(int store_id, const std::string& key, const std::string& body,
+                                  const std::string& resource) {
+        if (key.size() >= OBJECT_ID_SIZE) {
+            return error(400, "KeyTooLongError", "Keys are at most " + std::to_string(OBJECT_ID_SIZE - 1) +
+                         " bytes", resource);
+        }
+        if (body.size() > BLOCK_SIZE) {
+            return error(400, "EntityTooLarge", "Objects are at most 1MB", resource);
+        }
+        StoreStripe stripe(store_id);
+        if (stripe.load() && stripe.isStriped(key)) {
+            return error(409, "OperationAborted", "A striped object has this key", resource);
+        }
+        if (stripe.load() && utils::isStripeChunkId(key)) {
+            return error(400, "InvalidArgument", "Keys ending in .s<number> are reserved for stripe chunks",
+                         resource);
+        }
+
+        std::istringstream input(body);
+        if (!StorePut(store_id).replace(input, key)) {
+            return error(500, "InternalError", "Failed to store the object", resource);
+        }
+
+        HttpResponse response;
+        response.setHeader("ETag", etagOf(utils::crc32(0, body.data(), body.size())));
+        return response;
+    }
+
+    /**
+     * @brief DELETE of an object; a striped object is removed with all its chunks.
+     */
+    static HttpResponse deleteObject(int store_id, const std::string& key, const std::string& resource) {
+        StoreStripe stripe(store_id);
+        if (stripe.load() && stripe.isStriped(key)) {
+            if (!stripe.remove(key)) {
+                return error(500, "InternalError", "Failed to remove the striped object", resource);
+            }
+            HttpResponse response;
+            response.status = 204;
+            return response;
+        }
+
+        MetadataReader metadata(utils::getMetadataPath(store_id), store_id);
+        BlockMetadata block;
+        if (metadata.open() && metadata.find(key, block) != -1) {
+            StorePut(store_id).remove(key);
+        }
+        HttpResponse response;
+        response.status = 204;  // Also for missing keys, as S3 does
+        return response;
+    }
+
+public:
+    static HttpResponse error(int status, const std::string& code, const std::string& message,
+                              const std::string& resource) {
+        return xmlResponse(status, "<Error><Code>" + code + "</Code><Message>" + http::xmlEscape(message) +
+                                   "</Message><Resource>" + http::xmlEscape(resource) + "</Resource></Error>");
+    }
+
+    /**
+     * @brief Handles one request.
+     *
+     * @param request Parsed request with its body.
+     *
+     * @return The response; HEAD responses are trimmed to their head by the caller.
+     */
+    static HttpResponse handle(const HttpRequest& request) {
+        const std::string& path = request.path;
+        const std::string& method = request.method;
+        if (path == "/") {
+            return method == "GET" ? listBuckets() :
+                   error(405, "MethodNotAllowed", "Only GET is allowed on the service", path);
+        }
+
+        size_t slash = path.find('/', 1);
+        std::string bucket = path.substr(1, slash == std::string::npos ? std::string::npos : slash - 1);
+        std::string key = slash == std::string::npos ? "" : path.substr(slash + 1);
+        int store_id;
+        if (!parseBucket(bucket, store_id) || !utils::storeExists(store_id)) {
+            return error(404, "NoSuchBucket", "The specified bucket does not exist.", path);
+        }
+
+        if (key.empty()) {
+            if (method == "GET") return listObjects(store_id, request, path);
+            if (method == "HEAD") return HttpResponse();
+            if (method == "PUT" || method == "DELETE") {
+                return error(501, "NotImplemented",
+                             "Buckets are created with hearty-store-init and removed with hearty-store-destroy", path);
+            }
+            return error(405, "MethodNotAllowed", "The method is not allowed on a bucket", path);
+        }
+
+        for (const auto& [name, value] : request.query) {
+            if (name != "x-id") {
+                return error(501, "NotImplemented", "Subresource " + name + " is not supported", path);
+            }
+        }
+        if (method == "GET" || method == "HEAD") return getObject(store_id, key, method == "HEAD", path);
+        if (method == "PUT") return putObject(store_id, key, request.body, path);
+        if (method == "DELETE") return deleteObject(store_id, key, path);
+        return error(405, "MethodNotAllowed", "The method is not allowed on an object", path);
+    }
+};
+
+struct S3Connection {
+    uint64_t id;
+    std::string input;              // Received bytes not yet consumed by a request
+    std::string output;             // Response head (and in-memory body) to send
+    size_t output_sent = 0;
+    std::shared_ptr<RawFile> file;  // File range to send after `output`
+    off_t file_offset = 0;
+    size_t file_left = 0;
+    std::shared_ptr<void> file_hold;    // Pin of the file range, dropped once it is sent
+    bool busy = false;              // A request is being handled on the executor
+    bool continue_sent = false;     // "100 Continue" was sent for the pending request
+    bool close_after = false;       // Close once the output is sent
+};
+
+struct S3Completion {
+    int fd;
+    uint64_t connection_id;
+    HttpResponse response;
+    bool keep_alive;
+};
+
+class S3Server {
+private:
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;       // eventfd signaled by executor tasks when responses are ready
+    int signal_fd = -1;     // SIGINT / SIGTERM
+    bool is_unix = false;
+    std::string unix_path;
+
+    std::unordered_map<int, S3Connection> connections;
+    uint64_t next_connection_id = 1;
+    size_t in_flight = 0;
+    bool stopping = false;
+
+    std::mutex done_mutex;
+    std::vector<S3Completion> done;
+
+    bool watch(int fd, uint32_t events, int op = EPOLL_CTL_MOD) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd, op, fd, &event) == 0;
+    }
+
+    // Drops a pin on the executor, since releasing it waits for the store lock
+    static void releaseHold(std::shared_ptr<void>& hold) {
+        if (hold) {
+            Executor::shared().submit([hold = std::move(hold)]() mutable { hold.reset(); });
+        }
+    }
+
+    void releaseFile(S3Connection& connection) {
+        connection.file.reset();
+        connection.file_left = 0;
+        releaseHold(connection.file_hold);
+    }
+
+    void closeConnection(int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        releaseFile(connections[fd]);
+        connections.erase(fd);
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;     // EAGAIN: no more pending connections
+            if (!is_unix) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            if (!watch(fd, EPOLLIN, EPOLL_CTL_ADD)) {
+                close(fd);
+                continue;
+            }
+            connections[fd].id = next_connection_id++;
+        }
+    }
+
+    // Sends an error the loop itself detected, then closes the connection
+    void reject(int fd, int status, const std::string& code, const std::string& message) {
+        HttpResponse response = S3Handler::error(status, code, message, "");
+        S3Connection& connection = connections[fd];
+        connection.input.clear();
+        connection.output = http::serializeHead(response, false) + response.body;
+        connection.output_sent = 0;
+        connection.close_after = true;
+        flush(fd);
+    }
+
+    /**
+     * @brief Starts the next request buffered on a connection, once its head and
+     *        body have arrived, by handing it to the executor.
+     */
+    void dispatch(int fd) {
+        S3Connection& connection = connections[fd];
+        if (connection.busy || !connection.output.empty() || connection.input.empty()) return;
+
+        HttpRequest request;
+        size_t head_length = 0;
+        HttpParse parsed = http::parseHead(connection.input, request, head_length);
+        if (parsed == HttpParse::INCOMPLETE) return;
+        if (parsed == HttpParse::INVALID) {
+            reject(fd, 400, "BadRequest", "Malformed or oversized request head");
+            return;
+        }
+        if (!request.header("transfer-encoding").empty()) {
+            reject(fd, 501, "NotImplemented", "Chunked uploads are not supported; send Content-Length");
+            return;
+        }
+
+        std::string length_text = request.header("content-length");
+        if (length_text.empty() && request.method == "PUT") {
+            reject(fd, 411, "MissingContentLength", "PUT requires a Content-Length");
+            return;
+        }
+        if (length_text.size() > 18 || length_text.find_first_not_of("0123456789") != std::string::npos) {
+            reject(fd, 400, "BadRequest", "Invalid Content-Length");
+            return;
+        }
+        size_t content_length = length_text.empty() ? 0 : std::stoull(length_text);
+        if (content_length > BLOCK_SIZE) {
+            reject(fd, 400, "EntityTooLarge", "Objects are at most 1MB");
+            return;
+        }
+
+        if (connection.input.size() < head_length + content_length) {
+            if (http::toLower(request.header("expect")) == "100-continue" && !connection.continue_sent) {
+                connection.continue_sent = true;
+                connection.output = "HTTP/1.1 100 Continue\r\n\r\n";
+                connection.output_sent = 0;
+                flush(fd);
+            }
+            return;
+        }
+
+        request.body = connection.input.substr(head_length, content_length);
+        connection.input.erase(0, head_length + content_length);
+        connection.continue_sent = false;
+        connection.busy = true;
+        in_flight++;
+        watch(fd, 0);   // Read no further requests until this one is answered
+
+        uint64_t connection_id = connection.id;
+        Executor::shared().submit([this, fd, connection_id, request = std::move(request)]() {
+            HttpResponse response;
+            try {
+                response = S3Handler::handle(request);
+            } catch (const std::exception& e) {
+                response = S3Handler::error(500, "InternalError", e.what(), request.path);
+            }
+            if (request.method == "HEAD" && !response.head_only) {
+                response.head_only = true;
+                response.content_length = response.body.size();
+            }
+            {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                done.push_back(S3Completion{fd, connection_id, std::move(response), request.keep_alive});
+            }
+            uint64_t one = 1;
+            ssize_t written = write(wake_fd, &one, sizeof(one));
+            (void)written;
+        });
+    }
+
+    void onReadable(int fd) {
+        char buffer[S3_READ_CHUNK];
+        while (true) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                connections[fd].input.append(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            closeConnection(fd);    // Closed by the peer, or failed
+            return;
+        }
+        dispatch(fd);
+    }
+
+    /**
+     * @brief Sends as much of the pending response as the socket takes: the head
+     *        (and in-memory body) with send(), then the file range with sendfile.
+     *        Waits for EPOLLOUT when the socket is full; once the response is sent,
+     *        goes back to reading and starts any pipelined request.
+     */
+    void flush(int fd) {
+        S3Connection& connection = connections[fd];
+        while (connection.output_sent < connection.output.size()) {
+            int flags = MSG_NOSIGNAL | (connection.file_left > 0 ? MSG_MORE : 0);
+            ssize_t n = send(fd, connection.output.data() + connection.output_sent,
+                             connection.output.size() - connection.output_sent, flags);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(fd, EPOLLOUT);
+                return;
+            }
+            if (n <= 0) {
+                closeConnection(fd);
+                return;
+            }
+            connection.output_sent += n;
+        }
+        while (connection.file_left > 0) {
+            ssize_t n = connection.file->sendTo(fd, connection.file_offset, connection.file_left);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(fd, EPOLLOUT);
+                return;
+            }
+            if (n <= 0) {
+                closeConnection(fd);
+                return;
+            }
+            connection.file_left -= n;
+        }
+
+        connection.output.clear();
+        connection.output_sent = 0;
+        releaseFile(connection);
+        if (connection.close_after) {
+            closeConnection(fd);
+            return;
+        }
+        watch(fd, EPOLLIN);
+        dispatch(fd);
+    }
+
+    /**
+     * @brief Queues the responses finished by executor tasks on their connections.
+     */
+    void onWake() {
+        uint64_t count;
+        ssize_t n = read(wake_fd, &count, sizeof(count));
+        (void)n;
+
+        std::vector<S3Completion> finished;
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            finished.swap(done);
+        }
+        for (S3Completion& completion : finished) {
+            in_flight--;
+            auto found = connections.find(completion.fd);
+            if (found == connections.end() || found->second.id != completion.connection_id) {
+                releaseHold(completion.response.file_hold);
+                continue;   // The client went away meanwhile
+            }
+            S3Connection& connection = found->second;
+            HttpResponse& response = completion.response;
+            bool keep_alive = completion.keep_alive && !stopping;
+            connection.busy = false;
+            connection.close_after = !keep_alive;
+            connection.output = http::serializeHead(response, keep_alive);
+            connection.output_sent = 0;
+            if (!response.head_only) {
+                connection.output += response.body;
+                connection.file = response.file;
+                connection.file_offset = response.file_offset;
+                connection.file_left = response.file ? response.file_length : 0;
+                connection.file_hold = std::move(response.file_hold);
+            }
+            flush(completion.fd);
+        }
+    }
+
+    bool startLoop() {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        return epoll_fd >= 0 && wake_fd >= 0 && signal_fd >= 0 &&
+               listen(listen_fd, SOMAXCONN) == 0 &&
+               watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD) &&
+               watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD) &&
+               watch(signal_fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+public:
+    S3Server() = default;
+
+    ~S3Server() {
+        for (auto& [fd, connection] : connections) close(fd);
+        for (int fd : {listen_fd, epoll_fd, wake_fd, signal_fd}) {
+            if (fd >= 0) close(fd);
+        }
+        if (!unix_path.empty()) unlink(unix_path.c_str());
+    }
+
+    S3Server(const S3Server&) = delete;
+    S3Server& operator=(const S3Server&) = delete;
+
+    /**
+     * @brief Binds to 127.0.0.1.
+     *
+     * @param port TCP port (0 picks a free one).
+     *
+     * @return The bound port, or -1 on failure.
+     */
+    int bindLoopback(int port) {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return -1;
+        }
+        return ntohs(address.sin_port);
+    }
+
+    /**
+     * @brief Binds to a Unix socket, replacing a stale socket file at the path.
+     *
+     * @return true if the socket is bound; false otherwise.
+     */
+    bool bindUnix(const std::string& path) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) return false;
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(path.c_str());
+        }
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            return false;
+        }
+        is_unix = true;
+        unix_path = path;
+        return true;
+    }
+
+    /**
+     * @brief Serves until SIGINT or SIGTERM. Then stops accepting, finishes the
+     *        requests already handed to the executor and returns.
+     *
+     * @return true on a clean stop; false if the loop could not start or failed.
+     */
+    bool run() {
+        if (!startLoop()) {
+            return false;
+        }
+
+        epoll_event events[S3_MAX_EVENTS];
+        while (!stopping || in_flight > 0) {
+            int count = epoll_wait(epoll_fd, events, S3_MAX_EVENTS, -1);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0) return false;
+
+            for (int i = 0; i < count; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd) {
+                    acceptConnections();
+                } else if (fd == wake_fd) {
+                    onWake();
+                } else if (fd == signal_fd) {
+                    signalfd_siginfo info;
+                    ssize_t n = read(signal_fd, &info, sizeof(info));
+                    (void)n;
+                    stopping = true;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+                } else if (connections.count(fd)) {
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        closeConnection(fd);
+                    } else if (events[i].events & EPOLLOUT) {
+                        flush(fd);
+                    } else if (events[i].events & EPOLLIN) {
+                        onReadable(fd);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 1 && !(argc == 3 && (std::string(argv[1]) == "--port" || std::string(argv[1]) == "--socket"))) {
+        std::cerr << "Usage: " << argv[0] << " [--port port | --socket path]" << std::endl;
+        return 1;
+    }
+
+    try {
+        // Signals are taken by the event loop (signalfd); block them before the
+        // executor starts its threads so they inherit the mask
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        S3Server server;
+        if (argc == 3 && std::string(argv[1]) == "--socket") {
+            if (!server.bindUnix(argv[2])) {
+                std::cerr << "Failed to bind " << argv[2] << ": " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            std::cout << "Serving stores on unix:" << argv[2] << std::endl;
+        } else {
+            int port = server.bindLoopback(argc == 3 ? std::stoi(argv[2]) : DEFAULT_S3_PORT);
+            if (port == -1) {
+                std::cerr << "Failed to bind 127.0.0.1: " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            std::cout << "Serving stores on http://127.0.0.1:" << port << std::endl;
+        }
+
+        if (!server.run()) {
+            std::cerr << "Event loop failed: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
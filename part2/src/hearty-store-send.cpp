@@ -0,0 +1,167 @@
+/**
+ * @file hearty-store-send.cpp
+ * @author Nathadon Samairat
+ * @brief Writes a store's blocks and block metadata to stdout as a send/receive
+ *        stream. With --since, only the blocks that changed after a snapshot are sent.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include "hearty-store-common.hpp"
+#include "hearty-store-stream.hpp"
+
+class StoreSend {
+private:
+    int store_id;
+
+    /**
+     * @brief Loads block metadata from a store or snapshot metadata file.
+     *
+     * @param metadata_path Path to the metadata file.
+     * @param block_metadata Vector to fill with the block records.
+     *
+     * @return true if the metadata is successfully loaded; false otherwise.
+     */
+    bool loadBlockMetadata(const std::string& metadata_path,
+                           std::vector<BlockMetadata>& block_metadata) {
+        std::ifstream file(metadata_path, std::ios::binary);
+        if (!file) return false;
+
+        file.seekg(sizeof(StoreMetadata));
+        block_metadata.resize(NUM_BLOCKS);
+        for (auto& block : block_metadata) {
+            file.read(reinterpret_cast<char*>(&block), sizeof(BlockMetadata));
+        }
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Checks whether a block differs between the base snapshot and the live store.
+     */
+    bool blockChanged(const BlockMetadata& base, const BlockMetadata& live) {
+        return base.is_used != live.is_used ||
+               (live.is_used && (std::strncmp(base.object_id, live.object_id, OBJECT_ID_SIZE) != 0 ||
+                                 base.data_size != live.data_size ||
+                                 base.checksum != live.checksum ||
+                                 base.timestamp != live.timestamp));
+    }
+
+    /**
+     * @brief Writes one framed record to the output.
+     */
+    void writeRecord(std::ostream& out, StreamRecordType type, int block_num,
+                     const BlockMetadata& block) {
+        StreamRecord record;
+        std::memset(&record, 0, sizeof(StreamRecord));
+        record.magic = STREAM_MAGIC;
+        record.type = type;
+        record.block_num = block_num;
+        std::memcpy(&record.block, &block, sizeof(BlockMetadata));
+        record.record_crc = utils::recordChecksum(record);
+        out.write(reinterpret_cast<const char*>(&record), sizeof(StreamRecord));
+    }
+
+public:
+    StoreSend(int id) : store_id(id) {}
+
+    /**
+     * @brief Sends every used block, or only the blocks changed since a snapshot.
+     *
+     * @param base_snapshot_id Snapshot to send changes from, or -1 for a full stream.
+     * @param out Output stream for the send stream.
+     *
+     * @return true if the stream is successfully written; false otherwise.
+     */
+    bool send(int base_snapshot_id, std::ostream& out) {
+        std::vector<BlockMetadata> live;
+        if (!loadBlockMetadata(utils::getMetadataPath(store_id), live)) {
+            std::cerr << "Failed to load store metadata" << std::endl;
+            return false;
+        }
+
+        std::vector<BlockMetadata> base(NUM_BLOCKS, BlockMetadata{});
+        if (base_snapshot_id != -1 &&
+            !loadBlockMetadata(utils::getSnapshotPath(store_id, base_snapshot_id) + META_FILENAME,
+                               base)) {
+            std::cerr << "Snapshot " << base_snapshot_id << " does not exist" << std::endl;
+            return false;
+        }
+
+        std::ifstream data_file(utils::getDataPath(store_id), std::ios::binary);
+        if (!data_file) {
+            std::cerr << "Failed to open data file" << std::endl;
+            return false;
+        }
+
+        StreamHeader header{STREAM_MAGIC, STREAM_VERSION, store_id, base_snapshot_id,
+                            base_snapshot_id == -1 ? 0 : utils::snapshotRoot(base)};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(StreamHeader));
+
+        std::vector<char> buffer(BLOCK_SIZE);
+        uint64_t records = 0;
+        for (size_t block = 0; block < NUM_BLOCKS; block++) {
+            if (!blockChanged(base[block], live[block])) {
+                continue;
+            }
+
+            if (!live[block].is_used) {
+                writeRecord(out, RECORD_FREE, block, live[block]);
+                records++;
+                continue;
+            }
+
+            data_file.seekg(block * BLOCK_SIZE);
+            data_file.read(buffer.data(), live[block].data_size);
+            if (!data_file) {
+                std::cerr << "Failed to read block " << block << std::endl;
+                return false;
+            }
+
+            writeRecord(out, RECORD_BLOCK, block, live[block]);
+            out.write(buffer.data(), live[block].data_size);
+            records++;
+        }
+
+        BlockMetadata end{};
+        end.data_size = records;
+        writeRecord(out, RECORD_END, -1, end);
+        out.flush();
+
+        std::cerr << "Sent " << records << " records from store " << store_id << std::endl;
+        return static_cast<bool>(out);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "--since")) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] [--since snapshot-id]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+        int base_snapshot_id = argc == 4 ? std::stoi(argv[3]) : -1;
+
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreSend sender(store_id);
+        if (!sender.send(base_snapshot_id, std::cout)) {
+            return 1;
+        }
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,220 @@
+/**
+ * @file hearty-store-snapshot.cpp
+ * @author Nathadon Samairat
+ * @brief Creates, lists and deletes point-in-time snapshots of a store.
+ *        A snapshot is a copy of the store's metadata only; its blocks are shared
+ *        with the live store and pinned so that later puts are redirected to
+ *        other blocks (redirect-on-write) and the snapshot stays stable.
+ * @version 0.1
+ * @date 2024-12-03
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+
+class StoreSnapshot {
+private:
+    int store_id;
+
+    /**
+     * @brief Loads the block metadata of the live store or of a snapshot.
+     *
+     * @param metadata_path Path to the metadata file.
+     * @param block_metadata Vector to fill with the block records.
+     *
+     * @return true if the metadata is successfully loaded; false otherwise.
+     */
+    bool loadBlockMetadata(const std::string& metadata_path,
+                           std::vector<BlockMetadata>& block_metadata) {
+        std::ifstream file(metadata_path, std::ios::binary);
+        if (!file) return false;
+
+        file.seekg(sizeof(StoreMetadata));
+        block_metadata.resize(NUM_BLOCKS);
+        for (auto& block : block_metadata) {
+            file.read(reinterpret_cast<char*>(&block), sizeof(BlockMetadata));
+        }
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Adds delta to the pin count of every block used by a snapshot.
+     *        The caller must hold the store lock; pinned.bin is replaced atomically
+     *        so a concurrent put never reads a partly written pin map.
+     *
+     * @param snapshot_id ID of the snapshot.
+     * @param delta +1 when creating the snapshot, -1 when deleting it.
+     *
+     * @return true if the pin map is successfully updated; false otherwise.
+     */
+    bool updatePins(int snapshot_id, int delta) {
+        std::vector<BlockMetadata> block_metadata;
+        if (!loadBlockMetadata(utils::getSnapshotPath(store_id, snapshot_id) + META_FILENAME,
+                               block_metadata)) {
+            std::cerr << "Failed to load snapshot metadata" << std::endl;
+            return false;
+        }
+
+        std::vector<uint16_t> pins = utils::loadPinMap(store_id);
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            if (block_metadata[i].is_used) {
+                pins[i] = static_cast<uint16_t>(std::max(0, pins[i] + delta));
+            }
+        }
+
+        std::vector<iovec> iov = {{pins.data(), NUM_BLOCKS * sizeof(uint16_t)}};
+        if (!io::replaceFile(utils::getPinMapPath(store_id), iov)) {
+            std::cerr << "Failed to write pin map" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns the IDs of all snapshots of the store in ascending order.
+     */
+    std::vector<int> snapshotIds() {
+        std::vector<int> ids;
+        if (!std::filesystem::exists(utils::getSnapshotDir(store_id))) {
+            return ids;
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(utils::getSnapshotDir(store_id))) {
+            if (entry.is_directory()) {
+                ids.push_back(std::stoi(entry.path().filename().string()));
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+public:
+    StoreSnapshot(int id) : store_id(id) {}
+
+    /**
+     * @brief Creates a snapshot by copying the store's metadata and pinning its blocks.
+     *
+     * @return The ID of the new snapshot, or -1 on failure.
+     */
+    int create() {
+        // Held across choosing the ID, copying the metadata and pinning, so
+        // puts and other snapshot commands see either none or all of it
+        FileLock store_lock(utils::getStorePath(store_id));
+
+        std::vector<int> ids = snapshotIds();
+        int snapshot_id = ids.empty() ? 1 : ids.back() + 1;
+        std::string snapshot_path = utils::getSnapshotPath(store_id, snapshot_id);
+
+        try {
+            std::filesystem::create_directories(snapshot_path);
+            std::filesystem::copy_file(utils::getMetadataPath(store_id),
+                                       snapshot_path + META_FILENAME);
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Failed to create snapshot: " << e.what() << std::endl;
+            std::filesystem::remove_all(snapshot_path);
+            return -1;
+        }
+
+        if (!updatePins(snapshot_id, 1)) {
+            std::filesystem::remove_all(snapshot_path);
+            return -1;
+        }
+        return snapshot_id;
+    }
+
+    /**
+     * @brief Deletes a snapshot and releases the blocks it pinned.
+     *
+     * @param snapshot_id ID of the snapshot to delete.
+     *
+     * @return true if the snapshot is successfully deleted; false otherwise.
+     */
+    bool remove(int snapshot_id) {
+        FileLock store_lock(utils::getStorePath(store_id));
+
+        std::string snapshot_path = utils::getSnapshotPath(store_id, snapshot_id);
+        if (!std::filesystem::exists(snapshot_path)) {
+            std::cerr << "Snapshot " << snapshot_id << " does not exist" << std::endl;
+            return false;
+        }
+
+        if (!updatePins(snapshot_id, -1)) {
+            return false;
+        }
+        std::filesystem::remove_all(snapshot_path);
+        return true;
+    }
+
+    /**
+     * @brief Prints every snapshot with the number of objects it holds.
+     */
+    void list() {
+        std::vector<int> ids = snapshotIds();
+        if (ids.empty()) {
+            std::cout << "No snapshots found" << std::endl;
+            return;
+        }
+
+        for (int snapshot_id : ids) {
+            std::ifstream file(utils::getSnapshotPath(store_id, snapshot_id) + META_FILENAME,
+                               std::ios::binary);
+            StoreMetadata metadata;
+            file.read(reinterpret_cast<char*>(&metadata), sizeof(StoreMetadata));
+            std::cout << snapshot_id << " (used: " << metadata.used_blocks << "/"
+                      << metadata.total_blocks << " blocks)" << std::endl;
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    if (argc != 2 && !(argc == 3 && std::string(argv[2]) == "--list") &&
+        !(argc == 4 && std::string(argv[2]) == "--delete")) {
+        std::cerr << "Usage: " << argv[0] << " [store-id] [--list | --delete snapshot-id]"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        int store_id = std::stoi(argv[1]);
+        if (!utils::storeExists(store_id)) {
+            std::cerr << "Store " << store_id << " does not exist" << std::endl;
+            return 1;
+        }
+
+        StoreSnapshot snapshots(store_id);
+        if (argc == 3) {
+            snapshots.list();
+            return 0;
+        }
+
+        if (argc == 4) {
+            int snapshot_id = std::stoi(argv[3]);
+            if (!snapshots.remove(snapshot_id)) {
+                return 1;
+            }
+            std::cout << "Snapshot " << snapshot_id << " deleted successfully" << std::endl;
+            return 0;
+        }
+
+        int snapshot_id = snapshots.create();
+        if (snapshot_id == -1) {
+            std::cerr << "Failed to create snapshot" << std::endl;
+            return 1;
+        }
+
+        // Output the snapshot ID
+        std::cout << snapshot_id << std::endl;
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file hearty-store-stream.hpp
+ * @author Nathadon Samairat
+ * @brief Framing of the send/receive stream. A stream is a StreamHeader followed by
+ *        one StreamRecord per changed block (BLOCK records are followed by the
+ *        object's data) and a closing END record.
+ * @version 0.1
+ * @date 2024-12-04
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include "hearty-store-common.hpp"
+
+const uint32_t STREAM_MAGIC = 0x48535353;   // "HSSS"
+const uint32_t STREAM_VERSION = 2;
+
+enum StreamRecordType : uint32_t {
+    RECORD_BLOCK = 1,   // Block holds an object; data_size bytes of data follow
+    RECORD_FREE = 2,    // Block no longer holds an object
+    RECORD_END = 3      // End of stream; block.data_size holds the record count
+};
+
+struct StreamHeader {
+    uint32_t magic;             // STREAM_MAGIC
+    uint32_t version;           // STREAM_VERSION
+    int32_t source_store_id;    // Store the stream was sent from
+    int32_t base_snapshot_id;   // Snapshot the stream is relative to (-1 for full)
+    uint64_t base_root;         // utils::snapshotRoot of the base snapshot (0 for full)
+};
+
+struct StreamRecord {
+    uint32_t magic;             // STREAM_MAGIC
+    uint32_t type;              // StreamRecordType
+    int32_t block_num;          // Block the record applies to
+    uint32_t record_crc;        // CRC-32 of this record with record_crc = 0
+    BlockMetadata block;        // Metadata of the block in the source store
+};
+
+namespace utils {
+    // Computes the CRC-32 protecting a stream record's own fields
+    inline uint32_t recordChecksum(const StreamRecord& record) {
+        // Copy bytewise so that padding is covered exactly as it was transmitted
+        StreamRecord copy;
+        std::memcpy(&copy, &record, sizeof(StreamRecord));
+        copy.record_crc = 0;
+        return crc32(0, reinterpret_cast<const char*>(&copy), sizeof(StreamRecord));
+    }
+
+    // Computes a Merkle root over the objects a snapshot holds. Each leaf hashes a
+    // block's ID, size, timestamp and checksum (which stands for the data), so two
+    // stores holding the same objects in the same blocks get the same root whatever
+    // their extents or stale free blocks
+    inline uint64_t snapshotRoot(const std::vector<BlockMetadata>& block_metadata) {
+        std::vector<uint64_t> nodes(2 * NUM_BLOCKS, 0);
+        for (size_t i = 0; i < NUM_BLOCKS; i++) {
+            const BlockMetadata& block = block_metadata[i];
+            uint64_t h = hash64(0, &block.is_used, sizeof(block.is_used));
+            if (block.is_used) {
+                h = hash64(h, block.object_id, OBJECT_ID_SIZE);
+                h = hash64(h, &block.data_size, sizeof(block.data_size));
+                h = hash64(h, &block.timestamp, sizeof(block.timestamp));
+                h = hash64(h, &block.checksum, sizeof(block.checksum));
+            }
+            nodes[NUM_BLOCKS + i] = h;
+        }
+        for (size_t node = NUM_BLOCKS - 1; node >= 1; node--) {
+            nodes[node] = hash64(0, &nodes[2 * node], 2 * sizeof(uint64_t));
+        }
+        return nodes[1];
+    }
+}
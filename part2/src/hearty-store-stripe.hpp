@@ -0,0 +1,366 @@
+/**
+ * @file hearty-store-stripe.hpp
+ * @author Nathadon Samairat
+ * @brief Stripes large objects across the members of an HA group (RAID-0 style).
+ *        An object is cut into stripe units; unit k is stored as the object
+ *        "<id>.s<k>" on member (first + k) mod N, where chunk 0 lands on the store
+ *        the object was put into. The layout is recorded in a manifest under
+ *        /tmp/ha_group_<id>/stripes/. Chunks are written and read in parallel,
+ *        and each one is covered by the group's parity like any other object.
+ *        Complete stripes are written as full-stripe writes (no parity reads).
+ *        Each chunk occupies a whole block whatever its size, so an object takes
+ *        ceil(size / unit) blocks: a unit well below BLOCK_SIZE multiplies the
+ *        space an object uses. If a put fails, the chunks it stored are removed.
+ *        Reads stream the chunks in order with a bounded number in flight, and
+ *        removing a striped object removes its chunks, then its manifest.
+ * @version 0.1
+ * @date 2024-12-09
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <future>
+#include <deque>
+#include <algorithm>
+#include <filesystem>
+#include "hearty-store-common.hpp"
+#include "hearty-store-executor.hpp"
+#include "hearty-store-put.hpp"
+#include "hearty-store-get.hpp"
+#include "hearty-store-metadata.hpp"
+#include "hearty-store-fullstripe.hpp"
+#include "hearty-store-topology.hpp"
+
+const uint32_t STRIPE_MAGIC = 0x48535350;      // "HSSP"
+const uint32_t STRIPE_VERSION = 1;
+const size_t DEFAULT_STRIPE_UNIT = 256 * 1024;  // 256KB
+const size_t STRIPE_READ_WINDOW = 4;            // Chunks read ahead of the one being written out
+
+struct StripeManifest {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t object_size;       // Total size of the object in bytes
+    uint32_t stripe_unit;       // Bytes per chunk (the last chunk may be shorter)
+    int32_t chunk_count;        // Number of chunks
+    int32_t member_count;       // Number of member store IDs that follow
+    int32_t first_member;       // Index of the member holding chunk 0
+};
+
+class StoreStripe {
+private:
+    int store_id;
+    int ha_group_id = -1;
+    std::vector<int> members;
+    std::shared_ptr<const HATopology> group;
+
+    /**
+     * @brief Reads the manifest of a striped object.
+     *
+     * @return true if the manifest exists and is valid; false otherwise.
+     */
+    bool loadManifest(const std::string& object_id, StripeManifest& manifest,
+                      std::vector<int>& layout) {
+        if (!utils::isStripeName(object_id)) return false;
+        std::ifstream file(utils::getStripePath(ha_group_id, object_id), std::ios::binary);
+        if (!file) return false;
+
+        file.read(reinterpret_cast<char*>(&manifest), sizeof(StripeManifest));
+        if (!file || manifest.magic != STRIPE_MAGIC || manifest.version != STRIPE_VERSION ||
+            manifest.member_count <= 0 || manifest.stripe_unit == 0) {
+            return false;
+        }
+        layout.resize(manifest.member_count);
+        file.read(reinterpret_cast<char*>(layout.data()), layout.size() * sizeof(int32_t));
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * @brief Writes the manifest of a striped object; this commits the object.
+     */
+    bool saveManifest(const std::string& object_id, const StripeManifest& manifest) {
+        std::string path = utils::getStripePath(ha_group_id, object_id);
+        std::filesystem::create_directories(utils::getHAPath(ha_group_id) + STRIPE_DIR);
+        std::string temp_path = path + ".tmp";
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&manifest), sizeof(StripeManifest));
+            file.write(reinterpret_cast<const char*>(members.data()), members.size() * sizeof(int32_t));
+            if (!file) return false;
+        }
+        std::filesystem::rename(temp_path, path);
+        return true;
+    }
+
+    /**
+     * @brief Writes the chunks of one stripe. A complete stripe (one chunk per member)
+     *        goes through a full-stripe write when a common free block exists;
+     *        otherwise the chunks are put individually, in parallel.
+     *
+     * @param chunks Chunks of the stripe in chunk order, chunk 0 of the stripe
+     *               belonging to members[first_member].
+     * @param first_member Index of the member holding the stripe's first chunk.
+     * @param stored Receives the IDs of the chunks that were stored (or may have
+     *               been), so a failed put can remove them.
+     *
+     * @return true if every chunk is stored; false otherwise.
+     */
+    bool writeStripe(const std::vector<StripeObject>& chunks, int first_member,
+                     std::vector<std::string>& stored) {
+        if (chunks.size() == members.size()) {
+            std::vector<StripeObject> by_member(members.size());
+            for (size_t j = 0; j < chunks.size(); j++) {
+                by_member[(first_member + j) % members.size()] = chunks[j];
+            }
+            FullStripeWriter writer(group);
+            StripeWriteResult result = writer.write(by_member);
+            if (result == StripeWriteResult::WRITTEN) {
+                for (const StripeObject& chunk : chunks) {
+                    stored.push_back(chunk.object_id);
+                }
+                return true;
+            }
+            if (result == StripeWriteResult::FAILED) {
+                return false;   // Rolled back in every member
+            }
+        }
+
+        std::vector<std::future<bool>> results;
+        for (size_t j = 0; j < chunks.size(); j++) {
+            int member = members[(first_member + j) % members.size()];
+            const StripeObject& chunk = chunks[j];
+            results.push_back(Executor::shared().submit([member, &chunk] {
+                std::istringstream input(std::string(chunk.data.begin(), chunk.data.end()));
+                StorePut store_put(member);
+                return !store_put.put(input, chunk.object_id).empty();
+            }));
+        }
+        bool ok = true;
+        for (size_t j = 0; j < results.size(); j++) {
+            if (Executor::shared().wait(results[j])) {
+                stored.push_back(chunks[j].object_id);
+            } else {
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+public:
+    StoreStripe(int id) : store_id(id) {}
+
+    /**
+     * @brief ID under which a chunk of a striped object is stored (recognized by
+     *        utils::isStripeChunkId, so listings can hide it).
+     */
+    static std::string chunkId(const std::string& object_id, int chunk) {
+        return object_id + ".s" + std::to_string(chunk);
+    }
+
+    /**
+     * @brief Loads the HA group of the store.
+     *
+     * @return true if the store belongs to an HA group; false otherwise.
+     */
+    bool load() {
+        StoreMetadata metadata;
+        if (!utils::loadStoreMetadata(store_id, metadata) || metadata.ha_group_id == -1) {
+            return false;
+        }
+        group = topology::load(metadata.ha_group_id);
+        if (!group) {
+            return false;
+        }
+        ha_group_id = metadata.ha_group_id;
+        members = group->members();
+        return true;
+    }
+
+    /**
+     * @brief Checks whether an object ID names a striped object of the store's group.
+     */
+    bool isStriped(const std::string& object_id) {
+        return ha_group_id != -1 && utils::isStripeName(object_id) &&
+               std::filesystem::exists(utils::getStripePath(ha_group_id, object_id));
+    }
+
+    /**
+     * @brief Stores an object striped across the group members. The input is read
+     *        one stripe (one chunk per member) at a time and each stripe is written
+     *        with its chunks in parallel.
+     *
+     * @param input Stream to read the object from.
+     * @param stripe_unit Bytes per chunk (at most BLOCK_SIZE). Every chunk takes a
+     *                    whole block, so smaller units use more blocks.
+     *
+     * @return The new object's ID, or an empty string on failure.
+     */
+    std::string put(std::istream& input, size_t stripe_unit) {
+        if (stripe_unit == 0 || stripe_unit > BLOCK_SIZE) {
+            std::cerr << "Stripe unit must be between 1 and " << BLOCK_SIZE << " bytes" << std::endl;
+            return "";
+        }
+
+        std::string object_id = StorePut::generateUniqueId();
+        int first_member = static_cast<int>(
+            std::find(members.begin(), members.end(), store_id) - members.begin()) %
+            static_cast<int>(members.size());
+
+        std::vector<StripeObject> stripe;
+        std::vector<std::string> stored;
+        uint64_t object_size = 0;
+        int chunk_count = 0;
+        bool ok = true;
+
+        while (ok && input) {
+            StripeObject chunk{chunkId(object_id, chunk_count), std::vector<char>(stripe_unit)};
+            input.read(chunk.data.data(), stripe_unit);
+            size_t bytes_read = input.gcount();
+            if (bytes_read == 0) break;
+
+            chunk.data.resize(bytes_read);
+            stripe.push_back(std::move(chunk));
+            object_size += bytes_read;
+            chunk_count++;
+
+            if (stripe.size() == members.size()) {
+                ok = writeStripe(stripe, first_member, stored);
+                stripe.clear();
+            }
+        }
+        if (ok && !stripe.empty()) {
+            ok = writeStripe(stripe, first_member, stored);
+        }
+
+        StripeManifest manifest{STRIPE_MAGIC, STRIPE_VERSION, object_size,
+                                static_cast<uint32_t>(stripe_unit), chunk_count,
+                                static_cast<int32_t>(members.size()), first_member};
+        if (!ok || !saveManifest(object_id, manifest)) {
+            // Release the chunks that made it into the stores
+            for (const std::string& chunk_id : stored) {
+                int chunk = std::stoi(chunk_id.substr(chunk_id.rfind(".s") + 2));
+                int member = members[(first_member + chunk) % members.size()];
+                MetadataReader metadata(utils::getMetadataPath(member), member);
+                BlockMetadata block;
+                if (!metadata.open() || metadata.find(chunk_id, block) == -1) {
+                    continue;   // Never committed
+                }
+                if (!StorePut(member).remove(chunk_id)) {
+                    std::cerr << "Warning: Failed to remove chunk " << chunk_id
+                              << " from store " << member << std::endl;
+                }
+            }
+            return "";
+        }
+        return object_id;
+    }
+
+    /**
+     * @brief Reads a striped object (or a byte range of it). The chunks covering the
+     *        range are written out in order while up to STRIPE_READ_WINDOW of them are
+     *        read ahead in parallel, so memory stays bounded whatever the object size.
+     *        Chunks on a destroyed member are rebuilt from parity by StoreGet.
+     *
+     * @return true if the range is read; false otherwise.
+     */
+    bool get(const std::string& object_id, std::ostream& out,
+             size_t offset = 0, size_t length = WHOLE_OBJECT) {
+        StripeManifest manifest;
+        std::vector<int> layout;
+        if (!loadManifest(object_id, manifest, layout)) {
+            std::cerr << "Invalid stripe manifest for " << object_id << std::endl;
+            return false;
+        }
+
+        if (offset > manifest.object_size) {
+            std::cerr << "Range starts beyond end of object" << std::endl;
+            return false;
+        }
+        length = std::min<uint64_t>(length, manifest.object_size - offset);
+        if (length == 0) {
+            return true;
+        }
+
+        size_t unit = manifest.stripe_unit;
+        size_t first_chunk = offset / unit;
+        size_t last_chunk = (offset + length - 1) / unit;
+
+        auto readChunk = [&](size_t chunk) {
+            size_t chunk_start = chunk * unit;
+            size_t begin = std::max(offset, chunk_start) - chunk_start;
+            size_t end = std::min(offset + length, chunk_start + unit) - chunk_start;
+            int member = layout[(manifest.first_member + chunk) % layout.size()];
+            std::string chunk_id = chunkId(object_id, static_cast<int>(chunk));
+            return Executor::shared().submit([member, chunk_id, begin, end] {
+                std::ostringstream buffer;
+                StoreGet store_get(member);
+                bool ok = store_get.get(chunk_id, buffer, begin, end - begin);
+                return std::make_pair(ok, buffer.str());
+            });
+        };
+
+        std::deque<std::future<std::pair<bool, std::string>>> window;
+        size_t next_chunk = first_chunk;
+        bool all_ok = true;
+        while (all_ok && (next_chunk <= last_chunk || !window.empty())) {
+            while (next_chunk <= last_chunk && window.size() < STRIPE_READ_WINDOW) {
+                window.push_back(readChunk(next_chunk++));
+            }
+            auto [ok, data] = Executor::shared().wait(window.front());
+            window.pop_front();
+            all_ok = ok && out.write(data.data(), data.size());
+        }
+        for (auto& pending : window) {
+            Executor::shared().wait(pending);   // Drain reads still in flight
+        }
+        return all_ok;
+    }
+
+    /**
+     * @brief Removes a striped object: every chunk, then the manifest. Chunks already
+     *        gone are skipped, so a failed remove can be rerun.
+     *
+     * @return true if the object is removed; false otherwise (it stays listed).
+     */
+    bool remove(const std::string& object_id) {
+        StripeManifest manifest;
+        std::vector<int> layout;
+        if (!loadManifest(object_id, manifest, layout)) {
+            std::cerr << "Invalid stripe manifest for " << object_id << std::endl;
+            return false;
+        }
+
+        bool ok = true;
+        for (int chunk = 0; chunk < manifest.chunk_count; chunk++) {
+            int member = layout[(manifest.first_member + chunk) % layout.size()];
+            std::string chunk_id = chunkId(object_id, chunk);
+            MetadataReader metadata(utils::getMetadataPath(member), member);
+            BlockMetadata block;
+            if (!metadata.open()) {
+                std::cerr << "Failed to read the metadata of store " << member << std::endl;
+                ok = false;
+                continue;
+            }
+            if (metadata.find(chunk_id, block) == -1) {
+                continue;
+            }
+            if (!StorePut(member).remove(chunk_id)) {
+                std::cerr << "Failed to remove chunk " << chunk_id << " from store " << member << std::endl;
+                ok = false;
+            }
+        }
+        if (!ok) {
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::remove(utils::getStripePath(ha_group_id, object_id), error);
+        return !error;
+    }
+};
@@ -0,0 +1,267 @@
+/**
+ * @file hearty-store-topology.hpp
+ * @author Nathadon Samairat
+ * @brief HA group topology. Each group keeps a fixed-layout, versioned manifest
+ *        (/tmp/ha_group_<id>/manifest.bin) holding its member IDs, the health of
+ *        each member, the parity layout and a generation number that every change
+ *        bumps. A process loads a group's manifest once into an immutable
+ *        HATopology and shares it; when the manifest is replaced (changes are
+ *        written to a temp file and renamed over it) the next lookup notices the
+ *        new file with a stat() and swaps in a new topology. Callers keep the
+ *        snapshot they were given for the whole operation.
+ * @version 0.1
+ * @date 2024-12-16
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <sys/stat.h>
+#include "hearty-store-common.hpp"
+#include "hearty-store-io.hpp"
+
+const uint32_t HA_MANIFEST_MAGIC = 0x4853484d;     // "HSHM"
+const uint32_t HA_MANIFEST_VERSION = 1;
+const size_t HA_MAX_MEMBERS = 64;                  // Members a manifest can hold
+
+enum class MemberHealth : uint32_t {
+    HEALTHY = 0,    // Serves its own blocks
+    DESTROYED = 1   // Served by parity reconstruction (or a hot spare being rebuilt)
+};
+
+enum class ParityLayout : uint32_t {
+    DEDICATED = 0   // One parity file; stripe i is block i of every member
+};
+
+struct HAMember {
+    int32_t store_id;
+    MemberHealth health;
+};
+
+struct HAManifest {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;        // Bumped by every change of the manifest
+    int32_t group_id;
+    int32_t member_count;
+    ParityLayout parity_layout;
+    uint32_t reserved;
+    uint64_t stripe_unit;       // Bytes of each member per stripe (BLOCK_SIZE)
+    uint64_t stripe_count;      // Stripes in parity.bin (NUM_BLOCKS)
+    HAMember members[HA_MAX_MEMBERS];
+};
+
+static_assert(std::is_trivially_copyable<HAManifest>::value, "HAManifest is written raw");
+
+class HATopology {
+private:
+    HAManifest manifest;
+    std::vector<int> store_ids;
+
+public:
+    explicit HATopology(const HAManifest& source) : manifest(source) {
+        for (int i = 0; i < manifest.member_count; i++) {
+            store_ids.push_back(manifest.members[i].store_id);
+        }
+    }
+
+    int groupId() const { return manifest.group_id; }
+    uint64_t generation() const { return manifest.generation; }
+    const HAManifest& raw() const { return manifest; }
+
+    /**
+     * @brief Member store IDs in group order (the order stripes are laid out in).
+     */
+    const std::vector<int>& members() const { return store_ids; }
+
+    bool contains(int store_id) const {
+        return std::find(store_ids.begin(), store_ids.end(), store_id) != store_ids.end();
+    }
+
+    bool isDestroyed(int store_id) const {
+        for (int i = 0; i < manifest.member_count; i++) {
+            if (manifest.members[i].store_id == store_id) {
+                return manifest.members[i].health == MemberHealth::DESTROYED;
+            }
+        }
+        return false;
+    }
+
+    int destroyedCount() const {
+        int count = 0;
+        for (int i = 0; i < manifest.member_count; i++) {
+            count += manifest.members[i].health == MemberHealth::DESTROYED;
+        }
+        return count;
+    }
+
+    std::string parityPath() const {
+        return utils::getHAPath(manifest.group_id) + PARITY_FILENAME;
+    }
+};
+
+namespace topology {
+    /**
+     * @brief Reads a group's manifest from disk.
+     *
+     * @return true if a valid manifest is read; false otherwise.
+     */
+    inline bool readManifest(int ha_group_id, HAManifest& manifest) {
+        RawFile file(utils::getManifestPath(ha_group_id), O_RDONLY);
+        return file.isOpen() &&
+               file.readFull(reinterpret_cast<char*>(&manifest), sizeof(HAManifest), 0) &&
+               manifest.magic == HA_MANIFEST_MAGIC && manifest.version == HA_MANIFEST_VERSION &&
+               manifest.group_id == ha_group_id &&
+               manifest.member_count > 0 && static_cast<size_t>(manifest.member_count) <= HA_MAX_MEMBERS;
+    }
+
+    /**
+     * @brief Builds the manifest of a new group with every member healthy.
+     */
+    inline HAManifest makeManifest(int ha_group_id, const std::vector<int>& store_ids) {
+        HAManifest manifest{};
+        manifest.magic = HA_MANIFEST_MAGIC;
+        manifest.version = HA_MANIFEST_VERSION;
+        manifest.generation = 0;
+        manifest.group_id = ha_group_id;
+        manifest.member_count = static_cast<int32_t>(store_ids.size());
+        manifest.parity_layout = ParityLayout::DEDICATED;
+        manifest.stripe_unit = BLOCK_SIZE;
+        manifest.stripe_count = NUM_BLOCKS;
+        for (size_t i = 0; i < store_ids.size(); i++) {
+            manifest.members[i] = HAMember{store_ids[i], MemberHealth::HEALTHY};
+        }
+        return manifest;
+    }
+
+    // Topologies loaded by this process, with the manifest file they came from
+    class Cache {
+    private:
+        struct Entry {
+            ino_t inode;
+            struct timespec modified;
+            std::shared_ptr<const HATopology> topology;
+        };
+
+        std::mutex mutex;
+        std::map<int, Entry> entries;
+
+        static bool sameFile(const Entry& entry, const struct stat& st) {
+            return entry.inode == st.st_ino &&
+                   entry.modified.tv_sec == st.st_mtim.tv_sec &&
+                   entry.modified.tv_nsec == st.st_mtim.tv_nsec;
+        }
+
+    public:
+        /**
+         * @brief Current topology of a group. Reuses the loaded one while the
+         *        manifest file is unchanged; otherwise loads and swaps in the new one.
+         *
+         * @return The topology, or nullptr if the group has no valid manifest.
+         */
+        std::shared_ptr<const HATopology> get(int ha_group_id) {
+            struct stat st;
+            if (::stat(utils::getManifestPath(ha_group_id).c_str(), &st) != 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                entries.erase(ha_group_id);
+                return nullptr;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto found = entries.find(ha_group_id);
+                if (found != entries.end() && sameFile(found->second, st)) {
+                    return found->second.topology;
+                }
+            }
+
+            HAManifest manifest;
+            if (!readManifest(ha_group_id, manifest)) {
+                return nullptr;
+            }
+            auto topology = std::make_shared<const HATopology>(manifest);
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry& entry = entries[ha_group_id];
+            if (!entry.topology || entry.topology->generation() <= topology->generation()) {
+                entry = Entry{st.st_ino, st.st_mtim, topology};
+            }
+            return entry.topology;
+        }
+
+        void forget(int ha_group_id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.erase(ha_group_id);
+        }
+
+        static Cache& shared() {
+            static Cache cache;
+            return cache;
+        }
+    };
+
+    /**
+     * @brief Current topology of a group, shared by the whole process.
+     *
+     * @return The topology, or nullptr if the group has no valid manifest.
+     */
+    inline std::shared_ptr<const HATopology> load(int ha_group_id) {
+        return Cache::shared().get(ha_group_id);
+    }
+
+    /**
+     * @brief Writes a manifest as the next generation, replacing the old file
+     *        atomically. The caller holds the group directory lock (or is creating
+     *        the group).
+     *
+     * @return true if the manifest is written; false otherwise.
+     */
+    inline bool save(HAManifest& manifest) {
+        manifest.generation++;
+        std::vector<iovec> iov = {{&manifest, sizeof(HAManifest)}};
+        if (!io::replaceFile(utils::getManifestPath(manifest.group_id), iov)) {
+            return false;
+        }
+        Cache::shared().forget(manifest.group_id);
+        return true;
+    }
+
+    /**
+     * @brief Applies a change to a group's manifest under the group directory lock,
+     *        so concurrent changes (destroys, rebuilds) are not lost.
+     *
+     * @param ha_group_id ID of the group.
+     * @param change Edits the manifest read from disk.
+     *
+     * @return true if the changed manifest is written; false otherwise.
+     */
+    inline bool update(int ha_group_id, const std::function<void(HAManifest&)>& change) {
+        FileLock lock(utils::getHAPath(ha_group_id));
+        HAManifest manifest;
+        if (!lock.locked() || !readManifest(ha_group_id, manifest)) {
+            return false;
+        }
+        change(manifest);
+        return save(manifest);
+    }
+
+    /**
+     * @brief Sets the health of one member of a group.
+     */
+    inline bool setHealth(int ha_group_id, int store_id, MemberHealth health) {
+        return update(ha_group_id, [store_id, health](HAManifest& manifest) {
+            for (int i = 0; i < manifest.member_count; i++) {
+                if (manifest.members[i].store_id == store_id) {
+                    manifest.members[i].health = health;
+                }
+            }
+        });
+    }
+}
@@ -0,0 +1,132 @@
+/**
+ * @file hearty-store-verify.cpp
+ * @author Nathadon Samairat
+ * @brief Checks that two stores (typically a replica pair) hold the same blocks by
+ *        comparing their Merkle trees, descending only into differing subtrees, and
+ *        optionally repairs the second store from the first by copying only the
+ *        differing blocks.
+ * @version 0.1
+ * @date 2024-12-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "hearty-store-common.hpp"
+#include "hearty-store-merkle.hpp"
+#include "hearty-store-put.hpp"
+
+class StoreVerify {
+private:
+    int source_id;
+    int target_id;
+
+    /**
+     * @brief Loads the tree of a store, or rebuilds it from the blocks when deep.
+     */
+    bool loadTree(MerkleTree& tree, bool deep) {
+        return deep ? tree.rebuild() : tree.load();
+    }
+
+    static std::string toHex(uint64_t value) {
+        std::ostringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << value;
+        return out.str();
+    }
+
+public:
+    StoreVerify(int a, int b) : source_id(a), target_id(b) {}
+
+    /**
+     * @brief Compares the two stores and prints the roots and the differing blocks.
+     *
+     * @param deep Recompute both trees from the blocks instead of using the saved ones.
+     * @param differing Receives the number of differing blocks.
+     *
+     * @return true if both trees are loaded; false otherwise.
+     */
+    bool compare(bool deep, size_t& differing) {
+        MerkleTree source_tree(source_id);
+        MerkleTree target_tree(target_id);
+        if (!loadTree(source_tree, deep) || !loadTree(target_tree, deep)) {
+            std::cerr << "Failed to load Merkle trees" << std::endl;
+            return false;
+        }
+
+        size_t compared = 0;
+        std::vector<int> blocks = MerkleTree::diff(source_tree, target_tree, &compared);
+        std::cout << "Store " << source_id << " root: " << toHex(source_tree.root()) << std::endl;
+        std::cout << "Store " << target_id << " root: " << toHex(target_tree.root()) << std::endl;
+        std::cout << "Compared " << compared << " of " << 2 * NUM_BLOCKS - 1 << " tree nodes" << std::endl;
+        std::cout << "Differing blocks: " << blocks.size() << std::endl;
+        for (int block : blocks) {
+            std::cout << "  block " << block << std::endl;
+        }
+        differing = blocks.size();
+        return true;
+    }
+
+    /**
+     * @brief Copies the differing blocks from the first store to the second.
+     *
+     * @return true if the second store now matches the first; false otherwise.
+     */
+    bool repair(bool deep) {
+        StorePut store_put(source_id);
+        int copied = store_put.repairTo(target_id, deep);
+        if (copied < 0) {
+            std::cerr << "Failed to repair store " << target_id << std::endl;
+            return false;
+        }
+        std::cout << "Repaired " << copied << " blocks of store " << target_id
+                  << " from store " << source_id << std::endl;
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // Check command usages
+    bool deep = false;
+    bool repair = false;
+    for (int i = 3; i < argc; i++) {
+        std::string option = argv[i];
+        deep = deep || option == "--deep";
+        repair = repair || option == "--repair";
+    }
+    if (argc < 3 || argc - 3 != static_cast<int>(deep) + static_cast<int>(repair)) {
+        std::cerr << "Usage: " << argv[0] << " [store-id-a] [store-id-b] [--deep] [--repair]" << std::endl;
+        return 1;
+    }
+
+    try {
+        int a = std::stoi(argv[1]);
+        int b = std::stoi(argv[2]);
+        for (int store_id : {a, b}) {
+            if (!utils::storeExists(store_id)) {
+                std::cerr << "Store " << store_id << " does not exist" << std::endl;
+                return 1;
+            }
+        }
+
+        StoreVerify verify(a, b);
+        size_t differing = 0;
+        if (!verify.compare(deep, differing)) {
+            return 1;
+        }
+        if (differing == 0) {
+            return 0;
+        }
+        if (!repair) {
+            return 1;
+        }
+        return verify.repair(deep) ? 0 : 1;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -13,6 +13,75 @@ cd ../bin
 ./hearty-store-put 0 ../src/Makefile
 ./hearty-store-put 2 ../src/Makefile
 
+# Range read cases
+OBJ=$(./hearty-store-put 0 ../src/Makefile | awk '{print $5}')
+./hearty-store-get 0 $OBJ --range 0:64
+./hearty-store-get 0 $OBJ --range 64:
+OBJ2=$(./hearty-store-put 0 ../src/testcase.sh | awk '{print $5}')
+HEARTY_THREADS=4 ./hearty-store-get 0 $OBJ $OBJ2
+
+# Streaming put cases
+cat ../src/testcase.sh | ./hearty-store-put 0 -
+./hearty-store-batch-put 0 ../src/Makefile ../src/testcase.sh
+
+# Object listing cases
+./hearty-store-ls 0
+./hearty-store-ls 0 --limit 2
+./hearty-store-ls 0 --prefix 1 --since 0
+
+# Find cases
+./hearty-store-find $OBJ $OBJ2 --stats
+
+# Snapshot cases
+SNAP=$(./hearty-store-snapshot 0)
+./hearty-store-put 0 ../src/Makefile
+./hearty-store-get 0 $OBJ --snapshot $SNAP
+./hearty-store-snapshot 0 --list
+./hearty-store-snapshot 0 --delete $SNAP
+
+# Send/receive cases
+./hearty-store-send 0 | ./hearty-store-receive 1
+SNAP=$(./hearty-store-snapshot 0)
+./hearty-store-snapshot 1
+./hearty-store-put 0 ../src/Makefile
+./hearty-store-send 0 --since $SNAP | ./hearty-store-receive 1
+./hearty-store-ls 1
+
+# Export/import cases
+./hearty-store-export 0 > /tmp/hearty-export.tar
+tar tvf /tmp/hearty-export.tar
+./hearty-store-init 6
+./hearty-store-import 6 < /tmp/hearty-export.tar
+# Same objects (IDs, sizes, timestamps, data) in the same order; the block
+# layout and so the Merkle root may differ from the source's
+./hearty-store-export 6 | cmp - /tmp/hearty-export.tar
+rm -f /tmp/hearty-export.tar
+
+# S3 front end cases
+./hearty-store-s3 --port 9070 &
+S3_PID=$!
+sleep 0.5
+curl -s -T ../README.md http://127.0.0.1:9070/6/readme
+curl -s http://127.0.0.1:9070/6/readme | cmp - ../README.md
+curl -s -I http://127.0.0.1:9070/6/readme
+curl -s "http://127.0.0.1:9070/6?list-type=2&prefix=read"
+curl -s -X DELETE http://127.0.0.1:9070/6/readme
+kill $S3_PID
+wait $S3_PID
+
+# Pool cases
+./hearty-store-init 4
+./hearty-store-pool 1 create 0 1
+./hearty-store-pool 1 put readme ../README.md makefile ../src/Makefile
+./hearty-store-pool 1 add 4
+./hearty-store-pool 1 get readme makefile
+./hearty-store-pool 1 rm readme
+
+# Verify cases
+./hearty-store-verify 0 1
+./hearty-store-verify 0 1 --deep --repair
+./hearty-store-verify 0 1
+
 # Replicated Cases
 # ./hearty-store-list
 # ./hearty-store-replicate 0
@@ -33,7 +102,25 @@ cd ../bin
 # ./hearty-store-destroy 3
 
 # Parity cases
-./hearty-store-ha 1 2 3
+HEARTY_IO_BG_RATE=2000 HEARTY_HUGE_PAGES=1 ./hearty-store-ha 1 2 3
+./hearty-store-list
+STRIPED=$(./hearty-store-put 1 ../src/testcase.sh --stripe 512 | awk '{print $5}')
+HEARTY_HEDGE_MIN_MS=0 ./hearty-store-get 1 $STRIPED
+./hearty-store-batch-put 1 --spread ../src/Makefile ../src/testcase.sh ../README.md
+# A partial stripe: both puts land at one block index, so one parity write
+./hearty-store-batch-put 1 --spread ../src/Makefile ../README.md
+HEARTY_SYNC=data ./hearty-store-put 3 ../README.md
+HEARTY_PARITY_BUFFER_STRIPES=1 ./hearty-store-batch-put 1 ../src/Makefile ../src/testcase.sh ../README.md
+./hearty-store-init 5
+./hearty-store-rebuild --add-spare 5
+HEARTY_AUTO_REBUILD=0 ./hearty-store-destroy 2
+./hearty-store-get 1 $STRIPED
+./hearty-store-put 2 ../src/testcase.sh
+# Rebuild the destroyed member onto the hot spare
+./hearty-store-rebuild 2
 ./hearty-store-list
-./hearty-store-destroy 2
-./hearty-store-put 2 ../src/testcase.sh
\ No newline at end of file
+# Small objects only touch the written extent of their stripe
+./hearty-store-put 1 ../src/Makefile
+# Check every store and HA group, then their data and parity
+./hearty-store-fsck
+./hearty-store-fsck --data